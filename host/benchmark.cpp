@@ -0,0 +1,559 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "bus_simulator.hpp"
+#include "ingestion.hpp"
+#include "receiver.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace dou::host {
+
+  namespace {
+
+    enum class Output_ {
+      /// One line per benchmark, for humans.
+      Text,
+      /// `name,ns_per_op,ops_per_s,checksum` with a header line, so that runs
+      /// before and after a change can be compared by script, followed by a
+      /// blank line and the latencies as `name,p50_ns,p99_ns,max_ns` with a
+      /// header line of their own.
+      Csv
+    };
+
+    auto output_ = Output_::Text;
+
+    /// Runs `body`, which performs `operations` operations and returns a
+    /// checksum of their results, `repetitions` times and reports the time
+    /// per operation.
+    template <typename Body_>
+    void run_(const char *const name, const std::size_t operations,
+              const int repetitions, Body_ &&body) {
+      auto checksum = int64_t{0};
+      const auto start = std::chrono::steady_clock::now();
+      for (auto repetition = 0; repetition < repetitions; ++repetition) {
+        checksum += body();
+      }
+      const auto elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+      const auto total = static_cast<double>(operations) * repetitions;
+      if (output_ == Output_::Csv) {
+        std::printf("%s,%.3f,%.0f,%lld\n", name, elapsed * 1e9 / total,
+                    total / elapsed, static_cast<long long>(checksum));
+      } else {
+        std::printf("%-24s %10.2f ns/op %14.0f ops/s (checksum %lld)\n", name,
+                    elapsed * 1e9 / total, total / elapsed,
+                    static_cast<long long>(checksum));
+      }
+    }
+
+    /// \return `count` lines of synthetic DOU output in all units.
+    std::string make_stream_(const int count) {
+      constexpr auto units = Array<Unit, 5>{
+          {Unit::ms, Unit::us, Unit::MHz, Unit::kHz, Unit::None}};
+
+      auto random = std::minstd_rand{42};
+      auto stream = std::string{};
+      stream.reserve(static_cast<std::size_t>(count) * 13);
+
+      for (auto i = 0; i < count; ++i) {
+        const auto unit = units[static_cast<Size>(random() % units.size())];
+        const auto decimal_point_digit =
+            unit == Unit::None ? 0 : static_cast<int>(2 + (random() % 3));
+        stream += (random() % 16) == 0 ? '>' : ' ';
+        for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+          if (strobe == decimal_point_digit) {
+            stream += '.';
+          }
+          stream += static_cast<char>('0' + (random() % 10));
+        }
+        stream += unit_text(unit);
+        stream += "\r\n";
+      }
+      return stream;
+    }
+
+    /// \return The port samples of `readings` simulated measurement windows.
+    std::vector<Port_sample> make_samples_(const int readings) {
+      auto random = std::minstd_rand{1};
+      auto simulator = Bus_simulator{Bus_timing{}, Sampling{}, 1};
+      auto samples = std::vector<Port_sample>{};
+      for (auto i = 0; i < readings; ++i) {
+        auto reading = Reading{};
+        for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+          reading.set_digit(static_cast<i8>(strobe),
+                            static_cast<i8>(random() % 10));
+        }
+        reading.decimal_point_digit = static_cast<i8>(random() % 5);
+        simulator.simulate(reading, samples);
+      }
+      return samples;
+    }
+
+    void benchmark_receiver_() {
+      constexpr auto readings = 1'000'000;
+      constexpr auto chunk_size = std::size_t{64}; // typical USB packet
+
+      const auto stream = make_stream_(readings);
+
+      auto receiver = Receiver{};
+      run_("receiver", readings, 10, [&] {
+        auto checksum = int64_t{0};
+        for (auto offset = std::size_t{0}; offset < stream.size();
+             offset += chunk_size) {
+          receiver.feed(stream.data() + offset,
+                        static_cast<Size>(
+                            std::min(chunk_size, stream.size() - offset)),
+                        [&](const Sample &sample) {
+                          checksum += sample.mantissa;
+                        });
+        }
+        return checksum;
+      });
+    }
+
+    /// Latencies of `name`, which are printed in a section of their own as
+    /// `name,p50_ns,p99_ns,max_ns` in CSV output.
+    struct Latency_ {
+        std::string name;
+        double p50_ns;
+        double p99_ns;
+        double max_ns;
+    };
+
+    auto latencies_ = std::vector<Latency_>{};
+
+    void report_latency_(const std::string &name,
+                         const std::vector<int64_t> &sorted_ns) {
+      const auto percentile = [&sorted_ns](const double fraction) {
+        return static_cast<double>(sorted_ns[static_cast<std::size_t>(
+            fraction * static_cast<double>(sorted_ns.size() - 1))]);
+      };
+      const auto latency = Latency_{name, percentile(0.5), percentile(0.99),
+                                    percentile(1.0)};
+      if (output_ == Output_::Csv) {
+        latencies_.push_back(latency);
+      } else {
+        std::printf("%-24s %10.1f us\n", (name + " p50").c_str(),
+                    latency.p50_ns / 1e3);
+        std::printf("%-24s %10.1f us\n", (name + " p99").c_str(),
+                    latency.p99_ns / 1e3);
+        std::printf("%-24s %10.1f us\n", (name + " max").c_str(),
+                    latency.max_ns / 1e3);
+      }
+    }
+
+    /// What `run_ingestion_()` has measured.
+    struct Ingestion_run_ {
+        double elapsed_ns{0};
+        int64_t checksum{0};
+        /// From writing each reading to popping it from the queue of its
+        /// port, sorted.
+        std::vector<int64_t> latencies_ns{};
+    };
+
+    /// Feeds `ports` pseudo-terminals with `readings_per_port` readings each
+    /// through `Ingestion` to a consumer thread.
+    ///    If `period_ns` is 0, the readings are written as fast as they are
+    /// taken, but with no more than `max_in_flight_` of a port in flight, so
+    /// that none can be dropped, however the threads are scheduled.
+    /// Otherwise, each port is written one reading per `period_ns`, open
+    /// loop, with the ports staggered over the period. As `Ingestion::poll()`
+    /// returns 0 also when it has only received part of a line, only a lack
+    /// of progress counts as a stall.
+    ///
+    /// \return Whether all readings have been received and none dropped.
+    bool run_ingestion_(const std::string &name, const int ports,
+                        const int readings_per_port, const int64_t period_ns,
+                        Ingestion_run_ &run) {
+      constexpr auto max_in_flight_ = 64;
+      static_assert(max_in_flight_ * 8
+                    <= static_cast<int>(Sample_queue::capacity()));
+      constexpr auto stall_timeout_ns = int64_t{5'000'000'000};
+      const auto readings = readings_per_port * ports;
+
+      auto terminals = std::vector<std::unique_ptr<Pseudo_terminal>>{};
+      auto ingestion = Ingestion{};
+      for (auto port = 0; port < ports; ++port) {
+        terminals.push_back(std::make_unique<Pseudo_terminal>());
+        if (not terminals.back()->is_open()
+            or (ingestion.open(terminals.back()->port()) < 0)) {
+          std::fprintf(stderr, "%s: cannot open pseudo-terminal\n",
+                       name.c_str());
+          return false;
+        }
+      }
+
+      // The digits of each reading are its number, which tells the time at
+      // which it has been written.
+      auto sent_ns = std::vector<std::atomic<int64_t>>(
+          static_cast<std::size_t>(readings));
+      const auto now_ns = [] {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+      };
+
+      run = Ingestion_run_{};
+      run.latencies_ns.reserve(static_cast<std::size_t>(readings));
+      const auto dropped = [&ingestion] {
+        auto sum = uint64_t{0};
+        for (auto port = std::size_t{0}; port < ingestion.ports(); ++port) {
+          sum += ingestion.dropped(port);
+        }
+        return static_cast<int>(sum);
+      };
+      auto consumed = std::vector<std::atomic<int>>(
+          static_cast<std::size_t>(ports));
+      auto stop = std::atomic<bool>{false};
+      auto consumer = std::thread{[&] {
+        auto total = 0;
+        while (((total + dropped()) < readings)
+               and not stop.load(std::memory_order_relaxed)) {
+          auto popped = 0;
+          for (auto port = std::size_t{0}; port < ingestion.ports(); ++port) {
+            auto received = Received_sample{};
+            auto popped_port = 0;
+            while (ingestion.queue(port).pop(received)) {
+              const auto index = received.sample.reading.counts();
+              run.latencies_ns.push_back(
+                  now_ns()
+                  - sent_ns[static_cast<std::size_t>(index)].load(
+                      std::memory_order_relaxed));
+              run.checksum += index;
+              ++popped_port;
+            }
+            if (popped_port != 0) {
+              consumed[port].fetch_add(popped_port,
+                                       std::memory_order_release);
+              popped += popped_port;
+            }
+          }
+          if (popped == 0) {
+            std::this_thread::yield();
+          }
+          total += popped;
+        }
+      }};
+
+      const auto start = now_ns();
+      auto writer = std::thread{[&] {
+        auto line = Array<char, 10>{};
+        for (auto reading = 0; reading < readings_per_port; ++reading) {
+          for (auto port = 0; port < ports; ++port) {
+            const auto index = (reading * ports) + port;
+            if (period_ns == 0) {
+              while ((reading
+                      - consumed[static_cast<std::size_t>(port)].load(
+                          std::memory_order_acquire))
+                     >= max_in_flight_) {
+                if (stop.load(std::memory_order_relaxed)) {
+                  return;
+                }
+                std::this_thread::yield();
+              }
+            } else {
+              const auto due_ns = start + (index * period_ns / ports);
+              for (auto wait_ns = due_ns - now_ns(); wait_ns > 0;
+                   wait_ns = due_ns - now_ns()) {
+                if (stop.load(std::memory_order_relaxed)) {
+                  return;
+                }
+                if (wait_ns > 100'000) {
+                  std::this_thread::sleep_for(
+                      std::chrono::nanoseconds{wait_ns - 50'000});
+                } else {
+                  std::this_thread::yield();
+                }
+              }
+            }
+            // six digits, as on the display
+            std::snprintf(line.data(), line.size(), " %06u\r\n",
+                          static_cast<unsigned>(index) % 1'000'000U);
+            sent_ns[static_cast<std::size_t>(index)].store(
+                now_ns(), std::memory_order_relaxed);
+            (void)terminals[static_cast<std::size_t>(port)]->write(
+                line.data(), 9);
+          }
+        }
+      }};
+
+      auto received = 0;
+      auto progress_ns = now_ns();
+      while ((received < readings)
+             and ((now_ns() - progress_ns) < stall_timeout_ns)) {
+        const auto completed = ingestion.poll(100);
+        if (completed < 0) {
+          break;
+        }
+        if (completed > 0) {
+          received += completed;
+          progress_ns = now_ns();
+        }
+      }
+      if (received < readings) {
+        stop = true;
+      }
+      writer.join();
+      consumer.join();
+      run.elapsed_ns = static_cast<double>(now_ns() - start);
+
+      if ((received < readings) or (dropped() != 0)) {
+        std::fprintf(stderr,
+                     "%s: failed with %d of %d readings received, %d of "
+                     "these dropped by full queues\n",
+                     name.c_str(), received, readings, dropped());
+        return false;
+      }
+      std::sort(run.latencies_ns.begin(), run.latencies_ns.end());
+      return true;
+    }
+
+    /// Reports the readings per second that `Ingestion` passes from `ports`
+    /// pseudo-terminals to a consumer thread, and the latency from writing
+    /// each reading to popping it from the queue of its port while each
+    /// port delivers 1000 readings per second. The latter is the load of a
+    /// DOU at its fastest, with little time between the strobes, rather
+    /// than one that keeps the queues filled.
+    ///
+    /// \return Whether all readings have been received and none dropped.
+    bool benchmark_ingestion_(const int ports) {
+      constexpr auto total_readings = 100'000;
+      constexpr auto paced_readings_per_port = 500;
+      constexpr auto paced_period_ns = int64_t{1'000'000};
+      const auto name = "ingestion (" + std::to_string(ports) + " ports)";
+
+      auto run = Ingestion_run_{};
+      if (not run_ingestion_(name, ports, total_readings / ports, 0, run)) {
+        return false;
+      }
+      const auto readings = static_cast<double>(total_readings / ports
+                                                * ports);
+      if (output_ == Output_::Csv) {
+        std::printf("%s,%.3f,%.0f,%lld\n", name.c_str(),
+                    run.elapsed_ns / readings, readings * 1e9 / run.elapsed_ns,
+                    static_cast<long long>(run.checksum));
+      } else {
+        std::printf("%-24s %10.2f ns/op %14.0f ops/s (checksum %lld)\n",
+                    name.c_str(), run.elapsed_ns / readings,
+                    readings * 1e9 / run.elapsed_ns,
+                    static_cast<long long>(run.checksum));
+      }
+
+      if (not run_ingestion_(name, ports, paced_readings_per_port,
+                             paced_period_ns, run)) {
+        return false;
+      }
+      report_latency_(name, run.latencies_ns);
+      return true;
+    }
+
+    /// Compares the table-driven `decode_signals()` with the reference
+    /// implementation.
+    void benchmark_decoding_(const std::vector<Port_sample> &samples) {
+      const auto decode = [&samples](auto &&decode_signals) {
+        return [&samples, decode_signals] {
+          auto checksum = int64_t{0};
+          for (const auto &sample : samples) {
+            const auto state = decode_signals(sample.port1, sample.port2);
+            checksum += state.digit_strobe + state.out
+                        + (state.decimal_strobe ? 1 : 0);
+          }
+          return checksum;
+        };
+      };
+
+      run_("decode_signals_by_bits", samples.size(), 20,
+           decode([](const u8 port1, const u8 port2) {
+             return decode_signals_by_bits(port1, port2);
+           }));
+      run_("decode_signals", samples.size(), 20,
+           decode([](const u8 port1, const u8 port2) {
+             return decode_signals(port1, port2);
+           }));
+    }
+
+    /// Feeds `Bus_decoder::transit()` with the bus states of `samples`,
+    /// which have been decoded beforehand, and hands over the reading at the
+    /// end of each window like the main loop does.
+    void benchmark_transit_(const char *const name,
+                            const std::vector<Port_sample> &samples) {
+      auto states = std::vector<std::pair<bool, Input_state>>{};
+      states.reserve(samples.size());
+      for (const auto &sample : samples) {
+        states.emplace_back((sample.port2 & nmup_mask_) == u8{0},
+                            decode_signals(sample.port1, sample.port2));
+      }
+
+      run_(name, states.size(), 20, [&states] {
+        auto decoder = Bus_decoder{};
+        auto in_window = false;
+        auto checksum = int64_t{0};
+        for (const auto &[update_memory, state] : states) {
+          if (update_memory) {
+            decoder.transit(state);
+            in_window = true;
+          } else if (in_window) {
+            const auto &window = decoder.window();
+            if (window.complete) {
+              checksum += window.reading.counts();
+            }
+            decoder.start_window();
+            in_window = false;
+          }
+        }
+        return checksum;
+      });
+    }
+
+    /// Compares formatting the unit and line ending of readings by the
+    /// variadic `print()` with copying the precomputed suffix, as done once
+    /// per reading by `Bus_decoder`.
+    void benchmark_print_() {
+      constexpr auto operations = 1'000'000;
+      auto random = std::minstd_rand{3};
+      auto units = std::vector<Unit>(operations);
+      for (auto &unit : units) {
+        unit = static_cast<Unit>(random() % 5);
+      }
+
+      run_("print_unit_crlf", operations, 20, [&units] {
+        auto buffer = Array<char, max_unit_length + 3>{};
+        auto checksum = int64_t{0};
+        for (const auto unit : units) {
+          checksum += print(buffer.data(), buffer.size(), unit, "\r\n")
+                      + buffer[0];
+        }
+        return checksum;
+      });
+
+      run_("reading_suffixes", operations, 20, [&units] {
+        auto buffer = Array<char, max_unit_length + 3>{};
+        auto checksum = int64_t{0};
+        for (const auto unit : units) {
+          const auto &suffix = reading_suffixes[to_integral(unit)];
+          std::copy_n(suffix.text.data(), suffix.length + 1, buffer.data());
+          checksum += suffix.length + buffer[0];
+        }
+        return checksum;
+      });
+    }
+
+    void benchmark_get_unit_() {
+      constexpr auto operations = 1'000'000;
+      auto random = std::minstd_rand{4};
+      auto flags = std::vector<uint8_t>(operations);
+      for (auto &flag : flags) {
+        flag = static_cast<uint8_t>(random() % 8);
+      }
+
+      run_("get_unit", operations, 20, [&flags] {
+        auto checksum = int64_t{0};
+        for (const auto flag : flags) {
+          checksum += to_integral(get_unit((flag & 1U) != 0, (flag & 2U) != 0,
+                                           (flag & 4U) != 0));
+        }
+        return checksum;
+      });
+    }
+
+    /// Drains full queues of the transmitter bit by bit, as the timer
+    /// interrupt does.
+    void benchmark_get_next_bit_() {
+      constexpr auto line = std::string_view{" 123.456kHz\r\n"};
+      constexpr auto lines = 10'000;
+      const auto bits_per_line = line.size() * serial_frame_bits;
+
+      auto transmitter = Serial_transmitter{};
+      run_("get_next_bit", lines * bits_per_line, 20, [&] {
+        auto checksum = int64_t{0};
+        for (auto i = 0; i < lines; ++i) {
+          (void)transmitter.write(line.data(), static_cast<Size>(line.size()));
+          auto bit = u8{0};
+          while (transmitter.get_next_bit(bit)) {
+            checksum += to_integral(bit);
+          }
+        }
+        return checksum;
+      });
+    }
+
+    int usage_() {
+      std::fprintf(stderr, "usage: dou_benchmarks [--csv] [TRACE]\n"
+                           "  --csv   print comma-separated values\n"
+                           "  TRACE   trace recorded by dou_simulator to "
+                           "decode in addition\n");
+      return EXIT_FAILURE;
+    }
+
+  } // namespace
+
+} // namespace dou::host
+
+int main(const int argc, const char *const argv[]) {
+  using namespace dou::host;
+
+  const char *trace_path = nullptr;
+  for (auto i = 1; i < argc; ++i) {
+    const auto argument = std::string_view{argv[i]};
+    if (argument == "--csv") {
+      output_ = Output_::Csv;
+    } else if ((trace_path == nullptr) and not argument.starts_with("-")) {
+      trace_path = argv[i];
+    } else {
+      return usage_();
+    }
+  }
+
+  auto recorded = std::vector<dou::Port_sample>{};
+  if (trace_path != nullptr) {
+    auto *const file = std::fopen(trace_path, "rb");
+    auto sample_period_ns = uint32_t{0};
+    if ((file == nullptr)
+        or not read_trace(file, sample_period_ns, recorded)) {
+      std::fprintf(stderr, "%s: cannot read trace\n", trace_path);
+      return EXIT_FAILURE;
+    }
+    std::fclose(file);
+  }
+
+  if (output_ == Output_::Csv) {
+    std::printf("name,ns_per_op,ops_per_s,checksum\n");
+  }
+
+  const auto synthetic = make_samples_(10'000);
+
+  benchmark_receiver_();
+  benchmark_decoding_(synthetic);
+  benchmark_transit_("transit", synthetic);
+  if (not recorded.empty()) {
+    benchmark_transit_("transit (trace)", recorded);
+  }
+  benchmark_print_();
+  benchmark_get_unit_();
+  benchmark_get_next_bit_();
+  auto ingested = true;
+  for (const auto ports : {1, 16, 128}) {
+    ingested = benchmark_ingestion_(ports) and ingested;
+  }
+
+  if ((output_ == Output_::Csv) and not latencies_.empty()) {
+    std::printf("\nname,p50_ns,p99_ns,max_ns\n");
+    for (const auto &latency : latencies_) {
+      std::printf("%s,%.0f,%.0f,%.0f\n", latency.name.c_str(),
+                  latency.p50_ns, latency.p99_ns, latency.max_ns);
+    }
+  }
+  return ingested ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,175 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "bus_simulator.hpp"
+
+namespace dou::host {
+
+  namespace {
+
+    constexpr auto strobe_masks_ =
+        Array<std::pair<bool, u8>, number_of_digits>{{{true, as_1_mask_},
+                                                      {true, as_2_mask_},
+                                                      {true, as_3_mask_},
+                                                      {false, as_4_mask_},
+                                                      {false, as_5_mask_},
+                                                      {false, as_6_mask_}}};
+
+    u8 if_(const bool condition, const u8 mask) {
+      return condition ? mask : u8{0};
+    }
+
+    uint32_t to_threshold(const double probability) {
+      constexpr auto max = static_cast<double>(std::minstd_rand::max());
+      return static_cast<uint32_t>(probability * max);
+    }
+
+  } // namespace
+
+  Port_sample encode_signals(const Input_state &state,
+                             const bool update_memory) {
+    auto sample = Port_sample{
+        if_(((state.out & 2) != 0), out_b_mask_)
+            | if_(state.overflow, ovfl_mask_) | if_(state.nml, nml_mask_)
+            | if_(state.rng_2, rng_2_mask_),
+        if_(not update_memory, nmup_mask_)
+            | if_(((state.out & 1) != 0), out_a_mask_)
+            | if_(((state.out & 4) != 0), out_c_mask_)
+            | if_(((state.out & 8) != 0), out_d_mask_)
+            | if_(state.decimal_strobe, ds_mask_)};
+
+    if ((state.digit_strobe > 0) and (state.digit_strobe <= number_of_digits)) {
+      const auto &[on_port1, mask] = strobe_masks_[state.digit_strobe - 1];
+      if (on_port1) {
+        sample.port1 = sample.port1 | mask;
+      } else {
+        sample.port2 = sample.port2 | mask;
+      }
+    }
+
+    return sample;
+  }
+
+  Reading random_reading(std::minstd_rand &random) {
+    auto reading = Reading{};
+    for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+      reading.set_digit(static_cast<i8>(strobe),
+                        static_cast<i8>(random() % 10));
+    }
+    reading.decimal_point_digit = static_cast<i8>(random() % 5);
+    reading.overflow = (random() % 8) == 0;
+    reading.nml = (random() % 2) == 0;
+    reading.rng_2 = (random() % 2) == 0;
+    return reading;
+  }
+
+  Bus_simulator::Bus_simulator(const Bus_timing &timing,
+                               const Sampling &sampling, const uint32_t seed)
+      : timing_{timing}, sampling_{sampling}, random_{seed},
+        bit_error_threshold_{to_threshold(sampling.bit_error_rate)},
+        glitch_threshold_{to_threshold(sampling.glitch_rate)} {}
+
+  bool Bus_simulator::chance(const uint32_t threshold) {
+    return (threshold != 0) and (random_() < threshold);
+  }
+
+  void Bus_simulator::simulate(const Reading &reading,
+                               std::vector<Port_sample> &samples) {
+    const auto slot_ns = uint64_t{timing_.strobe_width_ns}
+                         + timing_.blanking_ns;
+    const auto scan_ns = slot_ns * number_of_digits;
+    const auto window_ns = scan_ns * timing_.passes;
+    const auto end_ns = window_ns + timing_.idle_ns;
+    const auto phase_ns = random_() % scan_ns;
+
+    auto glitch_slot = ~uint64_t{0};
+    auto glitch_strobe = i8{0};
+    auto last_slot = ~uint64_t{0};
+
+    const auto jitter = [this] {
+      return sampling_.jitter_ns == 0
+                 ? 0U
+                 : static_cast<uint32_t>(random_() % (sampling_.jitter_ns + 1));
+    };
+
+    auto time_ns = uint64_t{next_sample_ns_};
+    for (; time_ns < end_ns; time_ns += sampling_.period_ns + jitter()) {
+      const auto slot = (time_ns + phase_ns) / slot_ns;
+      const auto digit = static_cast<i8>(
+          number_of_digits - static_cast<int>(slot % number_of_digits));
+      const auto slot_time_ns = (time_ns + phase_ns) % slot_ns;
+      const auto is_strobed = slot_time_ns < timing_.strobe_width_ns;
+
+      if (slot != last_slot) {
+        last_slot = slot;
+        if (chance(glitch_threshold_)) {
+          glitch_slot = slot;
+          glitch_strobe = static_cast<i8>(1 + (random_() % number_of_digits));
+        }
+      }
+
+      auto state = Input_state{0,
+                               reading.digit(digit),
+                               false,
+                               reading.overflow,
+                               reading.nml,
+                               reading.rng_2};
+      if (is_strobed) {
+        state.digit_strobe = digit;
+        state.decimal_strobe = digit == reading.decimal_point_digit;
+      } else if ((slot == glitch_slot)
+                 and (slot_time_ns < (timing_.strobe_width_ns
+                                      + (timing_.blanking_ns / 2)))) {
+        state.digit_strobe = glitch_strobe;
+      }
+
+      auto sample = encode_signals(state, time_ns < window_ns);
+
+      if (bit_error_threshold_ != 0) {
+        for (auto bit = 0U; bit < 16U; ++bit) {
+          if (chance(bit_error_threshold_)) {
+            if (bit < 8U) {
+              sample.port1 = sample.port1 ^ (u8{1} << bit);
+            } else {
+              sample.port2 = sample.port2 ^ (u8{1} << (bit - 8U));
+            }
+          }
+        }
+      }
+
+      samples.push_back(sample);
+    }
+
+    next_sample_ns_ = static_cast<uint32_t>(time_ns - end_ns);
+  }
+
+  bool write_trace(std::FILE *const file, const uint32_t sample_period_ns,
+                   const std::vector<Port_sample> &samples) {
+    const auto header = Trace_header{trace_magic, sample_period_ns, 0};
+    return (std::fwrite(&header, sizeof(header), 1, file) == 1)
+           and (std::fwrite(samples.data(), sizeof(Port_sample), samples.size(),
+                            file)
+                == samples.size());
+  }
+
+  bool read_trace(std::FILE *const file, uint32_t &sample_period_ns,
+                  std::vector<Port_sample> &samples) {
+    auto header = Trace_header{};
+    if ((std::fread(&header, sizeof(header), 1, file) != 1)
+        or not std::equal(header.magic.begin(), header.magic.end(),
+                          trace_magic.begin())) {
+      return false;
+    }
+    sample_period_ns = header.sample_period_ns;
+
+    auto chunk = Array<Port_sample, 4096>{};
+    auto count = std::size_t{0};
+    while ((count = std::fread(chunk.data(), sizeof(Port_sample),
+                               static_cast<std::size_t>(chunk.size()), file))
+           > 0) {
+      samples.insert(samples.end(), chunk.begin(),
+                     chunk.begin() + static_cast<Size>(count));
+    }
+    return std::ferror(file) == 0;
+  }
+
+} // namespace dou::host
@@ -0,0 +1,168 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef BUS_SIMULATOR_HPP_
+#define BUS_SIMULATOR_HPP_
+
+#include "bus.hpp"
+#include "dou.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace dou::host {
+
+  /// \return The port levels for the bus `state`, which is the inverse of
+  /// `decode_signals()`.
+  Port_sample encode_signals(const Input_state &state, bool update_memory);
+
+  /// \return A reading of random digits, decimal point, overflow and unit.
+  Reading random_reading(std::minstd_rand &random);
+
+  /// Timing of the multiplexed display bus. The defaults are estimates and
+  /// should be replaced by measurements of the actual instrument.
+  struct Bus_timing {
+      /// Duration of each of the digit strobes AS_6..AS_1.
+      uint32_t strobe_width_ns{min_strobe_width_ns};
+      /// Duration between two digit strobes, where no strobe is active.
+      uint32_t blanking_ns{min_blanking_ns};
+      /// Number of complete MSD..LSD scans while /MUP is low.
+      uint32_t passes{2};
+      /// Duration for which /MUP is high between two readings.
+      uint32_t idle_ns{1'000'000};
+  };
+
+  /// Properties of the sampling by the main loop and of the disturbances on
+  /// the bus.
+  struct Sampling {
+      /// Nominal time between two consecutive samples.
+      uint32_t period_ns{5'000};
+      /// Maximum additional delay of a sample, uniformly distributed.
+      uint32_t jitter_ns{0};
+      /// Probability of each bit of a sample being flipped.
+      double bit_error_rate{0.0};
+      /// Probability of a spurious strobe appearing during each blanking
+      /// period, as caused by actuating the front panel switches.
+      double glitch_rate{0.0};
+  };
+
+  /// Generates the samples that the firmware takes of the display bus of a
+  /// Fluke 1900A, which keeps scanning the digits independently of /MUP.
+  class Bus_simulator {
+    public:
+      Bus_simulator(const Bus_timing &timing, const Sampling &sampling,
+                    uint32_t seed);
+
+      /// Appends the samples taken during one measurement window to
+      /// `samples`, i.e., while /MUP is low for showing `reading`, followed by
+      /// the time where /MUP is high. The window starts at a random point of
+      /// the scan.
+      void simulate(const Reading &reading, std::vector<Port_sample> &samples);
+
+    private:
+      [[nodiscard]] bool chance(uint32_t threshold);
+
+      Bus_timing timing_;
+      Sampling sampling_;
+      std::minstd_rand random_;
+      uint32_t bit_error_threshold_;
+      uint32_t glitch_threshold_;
+      /// Time from the end of the last window to the next sample.
+      uint32_t next_sample_ns_{0};
+  };
+
+  /// Processes samples the same way as the main loop of the firmware: the bus
+  /// is decoded while /MUP is low and the reading is taken once /MUP has
+  /// returned to high.
+  ///    When capturing by edge, only the samples at which a digit strobe has
+  /// been asserted are decoded, which requires the samples to be taken at
+  /// least as often as the latency of the port interrupt.
+  template <typename Instrument_ = Instrument> class Basic_bus_replay {
+    public:
+      using Reading = Basic_reading<Instrument_>;
+
+      explicit Basic_bus_replay(
+          const Strobe_capture capture = Strobe_capture::Polling)
+          : capture_{capture} {}
+
+      /// \return Whether a complete reading has been taken with `sample`,
+      /// which is then stored in `reading`.
+      bool feed(const Port_sample &sample, Reading &reading) {
+        // The strobes are asserted while they differ from their idle levels.
+        const auto asserting =
+            ((sample.port1 ^ port1_idle_of_<Instrument_>)
+             & ~(previous_.port1 ^ port1_idle_of_<Instrument_>)
+             & port1_strobes_mask_)
+            | ((sample.port2 ^ port2_idle_of_<Instrument_>)
+               & ~(previous_.port2 ^ port2_idle_of_<Instrument_>)
+               & port2_strobes_mask_);
+        previous_ = sample;
+
+        if ((sample.port2 & nmup_mask_) == u8{0}) {
+          if (capture_ == Strobe_capture::Polling) {
+            decoder_.transit(decode(sample));
+          } else if (asserting != u8{0}) {
+            decoder_.latch(decode(sample));
+          }
+          in_window_ = true;
+          return false;
+        }
+        if (not in_window_) {
+          return false;
+        }
+        in_window_ = false;
+        health_.update(decoder_);
+        const auto complete = decoder_.is_complete();
+        if (complete) {
+          reading = decoder_.captured();
+        }
+        decoder_.start_window();
+        return complete;
+      }
+
+      /// \return The counters of the windows since the last reset.
+      Bus_health &health() { return health_; }
+
+    private:
+      /// The tables of `decode_signals()` only serve `Instrument`.
+      static Input_state decode(const Port_sample &sample) {
+        if constexpr (std::is_same_v<Instrument_, Instrument>) {
+          return decode_signals(sample.port1, sample.port2);
+        } else {
+          return decode_signals_by_bits<Instrument_>(sample.port1,
+                                                     sample.port2);
+        }
+      }
+
+      Strobe_capture capture_;
+      Basic_bus_decoder<Instrument_> decoder_{};
+      Bus_health health_{};
+      Port_sample previous_{port1_idle_of_<Instrument_>,
+                            port2_idle_of_<Instrument_>};
+      bool in_window_{false};
+  };
+
+  using Bus_replay = Basic_bus_replay<Instrument>;
+
+  /// Captures of the port samples are stored as a `Trace_header`, followed
+  /// by the samples as pairs of bytes (P1IN, P2IN), until the end of the
+  /// file. This also allows converting captures of a logic analyzer.
+  struct Trace_header {
+      Array<char, 8> magic;
+      uint32_t sample_period_ns;
+      uint32_t reserved;
+  };
+
+  constexpr auto trace_magic = Array<char, 8>{"DOUTRC1"};
+
+  bool write_trace(std::FILE *file, uint32_t sample_period_ns,
+                   const std::vector<Port_sample> &samples);
+
+  bool read_trace(std::FILE *file, uint32_t &sample_period_ns,
+                  std::vector<Port_sample> &samples);
+
+} // namespace dou::host
+
+#endif // BUS_SIMULATOR_HPP_
@@ -0,0 +1,391 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "capture_log.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dou::host {
+
+  namespace {
+
+    constexpr auto header_ = Log_header{log_magic, sizeof(Log_record),
+                                        scaled_frequency_exponent,
+                                        scaled_period_exponent,
+                                        log_ordered};
+
+    bool is_compatible_(const Log_header &header) {
+      return std::equal(header.magic.begin(), header.magic.end(),
+                        log_magic.begin())
+             and (header.record_size == header_.record_size)
+             and (header.frequency_exponent == header_.frequency_exponent)
+             and (header.period_exponent == header_.period_exponent);
+    }
+
+    /// \return Nanoseconds of `ticks` of `timestamp_frequency_Hz`, without
+    /// overflowing for long captures.
+    int64_t ticks_to_ns_(const int64_t ticks) {
+      constexpr auto frequency = int64_t{timestamp_frequency_Hz};
+      return ((ticks / frequency) * 1'000'000'000)
+             + (((ticks % frequency) * 1'000'000'000) / frequency);
+    }
+
+  } // namespace
+
+  Log_record make_record(const Reading &reading, const int64_t time_ns,
+                         const uint16_t device) {
+    return {time_ns,
+            scaled_value(reading),
+            device,
+            reading.bcd,
+            reading.decimal_point_digit,
+            static_cast<uint8_t>(to_integral(reading.unit())),
+            static_cast<uint8_t>((reading.overflow ? 0x01U : 0U)
+                                 | (reading.nml ? 0x02U : 0U)
+                                 | (reading.rng_2 ? 0x04U : 0U))};
+  }
+
+  Log_record make_record(const Scaled_reading &reading, const int64_t time_ns,
+                         const uint16_t device) {
+    auto record = Log_record{};
+    record.time_ns = time_ns;
+    record.value = reading.value;
+    record.device = device;
+    record.unit = static_cast<uint8_t>(to_integral(reading.unit));
+    record.flags = static_cast<uint8_t>((reading.overflow ? 0x01U : 0U)
+                                        | 0x08U);
+    return record;
+  }
+
+  Log_writer::~Log_writer() { (void)close(); }
+
+  bool Log_writer::open(const char *const path) {
+    (void)close();
+    fd_ = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      return false;
+    }
+
+    struct stat status {};
+    auto header = Log_header{};
+    auto valid = fstat(fd_, &status) == 0;
+    latest_ns_ = std::numeric_limits<int64_t>::min();
+    ordered_ = true;
+    if (valid and (status.st_size == 0)) {
+      valid = ::write(fd_, &header_, sizeof(header_))
+              == static_cast<ssize_t>(sizeof(header_));
+    } else if (valid) {
+      valid = (::pread(fd_, &header, sizeof(header), 0)
+               == static_cast<ssize_t>(sizeof(header)))
+              and is_compatible_(header);
+      if (not valid) {
+        errno = EINVAL;
+      }
+      // drop a record that has been cut short
+      constexpr auto header_size = static_cast<off_t>(sizeof(Log_header));
+      constexpr auto record_size = static_cast<off_t>(sizeof(Log_record));
+      const auto records = (status.st_size - header_size) / record_size;
+      ordered_ = (header.flags & log_ordered) != 0;
+      valid = valid
+              and (ftruncate(fd_, header_size + (records * record_size)) == 0)
+              and (lseek(fd_, 0, SEEK_END) >= 0)
+              and find_latest_(static_cast<std::size_t>(records));
+    }
+    if (not valid) {
+      const auto error = errno;
+      ::close(fd_);
+      fd_ = -1;
+      errno = error;
+      return false;
+    }
+    batch_.reserve(batch_size_);
+    return true;
+  }
+
+  bool Log_writer::append(const Log_record &record) {
+    if (ordered_ and (record.time_ns < latest_ns_)) {
+      // cleared before the record can be written
+      const auto flags = uint16_t{0};
+      if (::pwrite(fd_, &flags, sizeof(flags), offsetof(Log_header, flags))
+          != static_cast<ssize_t>(sizeof(flags))) {
+        return false;
+      }
+      ordered_ = false;
+    }
+    latest_ns_ = std::max(latest_ns_, record.time_ns);
+    batch_.push_back(record);
+    return (batch_.size() < batch_size_) or flush();
+  }
+
+  bool Log_writer::find_latest_(const std::size_t records) {
+    // The last record of an ordered log is the latest; otherwise all of them
+    // are read, a batch at a time.
+    auto first = ordered_ and (records != 0) ? records - 1 : 0;
+    batch_.resize(batch_size_);
+    while (first < records) {
+      const auto count = std::min(batch_size_, records - first);
+      const auto size = count * sizeof(Log_record);
+      if (::pread(fd_, batch_.data(), size,
+                  static_cast<off_t>(sizeof(Log_header)
+                                     + (first * sizeof(Log_record))))
+          != static_cast<ssize_t>(size)) {
+        batch_.clear();
+        return false;
+      }
+      for (auto i = std::size_t{0}; i < count; ++i) {
+        latest_ns_ = std::max(latest_ns_, batch_[i].time_ns);
+      }
+      first += count;
+    }
+    batch_.clear();
+    return true;
+  }
+
+  bool Log_writer::flush() {
+    const auto *data = reinterpret_cast<const char *>(batch_.data());
+    auto remaining = batch_.size() * sizeof(Log_record);
+    while (remaining != 0) {
+      const auto written = ::write(fd_, data, remaining);
+      if ((written < 0) and (errno == EINTR)) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      remaining -= static_cast<std::size_t>(written);
+    }
+    batch_.clear();
+    return true;
+  }
+
+  bool Log_writer::close() {
+    if (fd_ < 0) {
+      return true;
+    }
+    const auto flushed = flush();
+    ::close(fd_);
+    fd_ = -1;
+    batch_.clear();
+    return flushed;
+  }
+
+  Log_reader::~Log_reader() { close(); }
+
+  bool Log_reader::open(const char *const path) {
+    close();
+    const auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat status {};
+    if ((fstat(fd, &status) != 0)
+        or (status.st_size < static_cast<off_t>(sizeof(Log_header)))) {
+      ::close(fd);
+      errno = EINVAL;
+      return false;
+    }
+    mapping_size_ = static_cast<std::size_t>(status.st_size);
+    mapping_ = mmap(nullptr, mapping_size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping_ == MAP_FAILED) {
+      mapping_ = nullptr;
+      return false;
+    }
+    if (not is_compatible_(*static_cast<const Log_header *>(mapping_))) {
+      close();
+      errno = EINVAL;
+      return false;
+    }
+    records_ = reinterpret_cast<const Log_record *>(
+        static_cast<const char *>(mapping_) + sizeof(Log_header));
+    size_ = (mapping_size_ - sizeof(Log_header)) / sizeof(Log_record);
+    ordered_ = (static_cast<const Log_header *>(mapping_)->flags
+                & log_ordered)
+               != 0;
+    if (ordered_) {
+      return true;
+    }
+
+    const auto blocks = (size_ + block_size - 1) / block_size;
+    latest_.resize(blocks);
+    earliest_.resize(blocks);
+    sorted_.resize(blocks);
+    for (auto block = std::size_t{0}; block < blocks; ++block) {
+      const auto first = block * block_size;
+      const auto last = std::min(first + block_size, size_);
+      auto latest = block == 0 ? records_[0].time_ns : latest_[block - 1];
+      auto earliest = records_[first].time_ns;
+      auto sorted = true;
+      for (auto i = first; i < last; ++i) {
+        sorted = sorted
+                 and ((i == first)
+                      or (records_[i - 1].time_ns <= records_[i].time_ns));
+        latest = std::max(latest, records_[i].time_ns);
+        earliest = std::min(earliest, records_[i].time_ns);
+      }
+      latest_[block] = latest;
+      earliest_[block] = earliest;
+      sorted_[block] = sorted;
+    }
+    for (auto block = blocks; block > 1; --block) {
+      earliest_[block - 2] = std::min(earliest_[block - 2],
+                                      earliest_[block - 1]);
+    }
+    return true;
+  }
+
+  void Log_reader::close() {
+    if (mapping_ != nullptr) {
+      munmap(mapping_, mapping_size_);
+    }
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+    records_ = nullptr;
+    size_ = 0;
+    ordered_ = false;
+    latest_.clear();
+    earliest_.clear();
+    sorted_.clear();
+  }
+
+  std::pair<std::size_t, std::size_t>
+  Log_reader::find(const int64_t from_ns, const int64_t to_ns) const {
+    const auto earlier = [](const Log_record &record, const int64_t time) {
+      return record.time_ns < time;
+    };
+    if (ordered_) {
+      const auto *const first = std::lower_bound(begin(), end(), from_ns,
+                                                 earlier);
+      const auto *const last = std::lower_bound(first, end(),
+                                                std::max(from_ns, to_ns),
+                                                earlier);
+      return {static_cast<std::size_t>(first - records_),
+              static_cast<std::size_t>(last - records_)};
+    }
+
+    // All records before the first block that reaches `from_ns` are
+    // earlier, and all from the first block that starts at `to_ns` later.
+    const auto first_block = static_cast<std::size_t>(
+        std::lower_bound(latest_.begin(), latest_.end(), from_ns)
+        - latest_.begin());
+    const auto last_block = static_cast<std::size_t>(
+        std::lower_bound(earliest_.begin(), earliest_.end(), to_ns)
+        - earliest_.begin());
+    if (first_block >= last_block) {
+      return {0, 0};
+    }
+
+    // Within the outer blocks, the bounds are narrowed down by binary search
+    // where the times are in order.
+    const auto bound = [this, &earlier](const std::size_t block,
+                                        const int64_t time) {
+      const auto *const first = records_ + (block * block_size);
+      const auto *const last = records_
+                               + std::min((block + 1) * block_size, size_);
+      if (not sorted_[block]) {
+        return std::pair{first, last};
+      }
+      const auto *const found = std::lower_bound(first, last, time, earlier);
+      return std::pair{found, found};
+    };
+    const auto first = static_cast<std::size_t>(
+        bound(first_block, from_ns).first - records_);
+    const auto last = static_cast<std::size_t>(
+        bound(last_block - 1, to_ns).second - records_);
+    return {first, last};
+  }
+
+  void Text_log_converter::feed(const char *const data, const Size length) {
+    receiver_.feed(data, length, [this](const Sample &sample) {
+      switch (sample.timestamp.mode) {
+      case Timestamp_mode::None:
+        ++ticks_;
+        break;
+      case Timestamp_mode::Absolute:
+        ticks_ += has_ticks_ ? static_cast<uint32_t>(sample.timestamp.ticks
+                                                     - last_ticks_)
+                             : sample.timestamp.ticks;
+        last_ticks_ = sample.timestamp.ticks;
+        has_ticks_ = true;
+        break;
+      case Timestamp_mode::Delta:
+        ticks_ += sample.timestamp.ticks;
+        break;
+      }
+      const auto time_ns = sample.timestamp.mode == Timestamp_mode::None
+                               ? ticks_
+                               : ticks_to_ns_(ticks_);
+      if (not has_first_) {
+        first_ns_ = time_ns;
+        has_first_ = true;
+      }
+      const auto record_ns = origin_ns_ + (time_ns - first_ns_);
+      records_.push_back(
+          sample.is_scaled
+              ? make_record(sample.scaled, record_ns, device_)
+              : make_record(sample.reading, record_ns, device_));
+    });
+  }
+
+  Text_log_merger::Text_log_merger(Log_writer &writer,
+                                   const std::size_t devices)
+      : writer_{writer}, ended_(devices, false) {
+    const auto origin_ns =
+        writer.latest_ns() == std::numeric_limits<int64_t>::min()
+            ? int64_t{0}
+            : writer.latest_ns() + 1;
+    converters_.reserve(devices);
+    for (auto device = std::size_t{0}; device < devices; ++device) {
+      converters_.emplace_back(static_cast<uint16_t>(device), origin_ns);
+    }
+  }
+
+  bool Text_log_merger::is_waiting(const std::size_t device) const {
+    return not ended_[device] and converters_[device].records().empty();
+  }
+
+  bool Text_log_merger::feed(const std::size_t device,
+                             const char *const data, const Size length) {
+    converters_[device].feed(data, length);
+    return append_due_();
+  }
+
+  bool Text_log_merger::end(const std::size_t device) {
+    ended_[device] = true;
+    return append_due_();
+  }
+
+  bool Text_log_merger::append_due_() {
+    while (true) {
+      auto *earliest = static_cast<std::deque<Log_record> *>(nullptr);
+      for (auto device = std::size_t{0}; device < converters_.size();
+           ++device) {
+        auto &records = converters_[device].records();
+        if (records.empty()) {
+          if (not ended_[device]) {
+            return true;
+          }
+        } else if ((earliest == nullptr)
+                   or (records.front().time_ns
+                       < earliest->front().time_ns)) {
+          earliest = &records;
+        }
+      }
+      if (earliest == nullptr) {
+        return true;
+      }
+      if (not writer_.append(earliest->front())) {
+        return false;
+      }
+      earliest->pop_front();
+    }
+  }
+
+} // namespace dou::host
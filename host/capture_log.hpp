@@ -0,0 +1,280 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef CAPTURE_LOG_HPP_
+#define CAPTURE_LOG_HPP_
+
+#include "dou.hpp"
+#include "receiver.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace dou::host {
+
+  /// Capture logs are stored as a `Log_header`, followed by `Log_record`s
+  /// until the end of the file, in the byte order of the host. New records
+  /// are only ever appended, so that a log can be read while it grows.
+  struct Log_header {
+      Array<char, 8> magic;
+      /// `sizeof(Log_record)`.
+      uint32_t record_size;
+      /// The base units of `Log_record::value`, see `scaled_value()`.
+      int8_t frequency_exponent;
+      int8_t period_exponent;
+      /// `log_ordered`, if set.
+      uint16_t flags;
+  };
+
+  constexpr auto log_magic = Array<char, 8>{"DOULOG1"};
+
+  /// The times of the records never decrease. Set in new logs, and cleared
+  /// by `Log_writer` before it appends a record that is earlier than one in
+  /// the log.
+  constexpr auto log_ordered = uint16_t{0x0001};
+
+  /// One reading of one DOU.
+  struct Log_record {
+      /// Nanoseconds since an arbitrary epoch, which is the same for all
+      /// records of a log.
+      int64_t time_ns;
+      /// The reading in the base unit of its quantity, see
+      /// `scaled_value()`.
+      uint64_t value;
+      uint16_t device;
+      /// As in `Reading`.
+      decltype(Reading::bcd) bcd;
+      int8_t decimal_point_digit;
+      /// The `Unit`.
+      uint8_t unit;
+      /// Overflow (bit 0), NML (1), RNG_2 (2) and scaled (3), i.e.,
+      /// received in a scaled format without the digits.
+      uint8_t flags;
+
+      /// \return The reading as displayed, which has no digits if
+      /// `is_scaled()`.
+      [[nodiscard]] Reading reading() const {
+        return {bcd, decimal_point_digit, (flags & 0x01U) != 0,
+                (flags & 0x02U) != 0, (flags & 0x04U) != 0};
+      }
+
+      [[nodiscard]] bool is_scaled() const { return (flags & 0x08U) != 0; }
+
+      [[nodiscard]] Scaled_reading scaled() const {
+        return {value, static_cast<Unit>(unit), (flags & 0x01U) != 0};
+      }
+  };
+
+  static_assert(sizeof(Log_record) == 24, "records are to be packed");
+
+  Log_record make_record(const Reading &reading, int64_t time_ns,
+                         uint16_t device);
+
+  /// \return The record of a reading that has been received in a scaled
+  /// format.
+  Log_record make_record(const Scaled_reading &reading, int64_t time_ns,
+                         uint16_t device);
+
+  /// Appends records to a capture log, writing them in batches.
+  class Log_writer {
+    public:
+      Log_writer() = default;
+      ~Log_writer();
+      Log_writer(const Log_writer &) = delete;
+      Log_writer &operator=(const Log_writer &) = delete;
+
+      /// Opens the log at `path` for appending, or creates it. A record
+      /// that has been cut short, e.g., by a crash, is removed.
+      ///
+      /// \return Whether the file is a log of the base units of this build,
+      /// or has been created as one; otherwise `errno` tells why not.
+      bool open(const char *path);
+
+      /// \return Whether the record has been queued or written.
+      bool append(const Log_record &record);
+
+      /// \return The latest time of the records in the log, or the least
+      /// `int64_t` if there are none.
+      [[nodiscard]] int64_t latest_ns() const { return latest_ns_; }
+
+      /// Writes the queued records.
+      ///
+      /// \return Whether they have all been written.
+      bool flush();
+
+      /// Flushes and closes the log.
+      ///
+      /// \return Whether the queued records have been written.
+      bool close();
+
+    private:
+      static constexpr auto batch_size_ = std::size_t{4096};
+
+      bool find_latest_(std::size_t records);
+
+      int fd_{-1};
+      std::vector<Log_record> batch_{};
+      int64_t latest_ns_{std::numeric_limits<int64_t>::min()};
+      bool ordered_{true};
+  };
+
+  /// Maps a capture log into memory and seeks records by time.
+  ///
+  /// The records of a log that is in the order of time, see `log_ordered`,
+  /// are found by binary search right away. For other logs, the time-range
+  /// index holds, for each block of `block_size` records,
+  /// the latest time up to its end and the earliest time from its start on.
+  /// These are monotonic, even where the records of several devices are
+  /// slightly out of order, so that the records of a range of time are
+  /// found by binary search.
+  class Log_reader {
+    public:
+      static constexpr auto block_size = std::size_t{4096};
+
+      Log_reader() = default;
+      ~Log_reader();
+      Log_reader(const Log_reader &) = delete;
+      Log_reader &operator=(const Log_reader &) = delete;
+
+      /// Maps the log at `path`, and builds the index unless the log is in
+      /// the order of time, which takes one pass over the times. Trailing
+      /// bytes of an incomplete record are ignored.
+      ///
+      /// \return Whether it is a log of the base units of this build;
+      /// otherwise `errno` tells why not.
+      bool open(const char *path);
+
+      void close();
+
+      [[nodiscard]] std::size_t size() const { return size_; }
+      [[nodiscard]] bool is_ordered() const { return ordered_; }
+      [[nodiscard]] const Log_record *begin() const { return records_; }
+      [[nodiscard]] const Log_record *end() const { return records_ + size_; }
+
+      [[nodiscard]] const Log_record &operator[](const std::size_t i) const {
+        return records_[i];
+      }
+
+      /// \return The indices [first, last) of the records that include all
+      /// those with `from_ns` <= `time_ns` < `to_ns`. If the times are in
+      /// order, these are exactly those.
+      [[nodiscard]] std::pair<std::size_t, std::size_t>
+      find(int64_t from_ns, int64_t to_ns) const;
+
+      /// Calls `on_record` with each record with `from_ns` <= `time_ns` <
+      /// `to_ns`, in the order of the log.
+      ///
+      /// \return The number of these records.
+      template <typename Callback_>
+      std::size_t for_each(const int64_t from_ns, const int64_t to_ns,
+                           Callback_ &&on_record) const {
+        const auto [first, last] = find(from_ns, to_ns);
+        auto count = std::size_t{0};
+        for (auto i = first; i < last; ++i) {
+          const auto &record = records_[i];
+          if ((record.time_ns >= from_ns) and (record.time_ns < to_ns)) {
+            on_record(record);
+            ++count;
+          }
+        }
+        return count;
+      }
+
+    private:
+      void *mapping_{nullptr};
+      std::size_t mapping_size_{0};
+      const Log_record *records_{nullptr};
+      std::size_t size_{0};
+      bool ordered_{false};
+      /// The latest time of each block and all blocks before.
+      std::vector<int64_t> latest_{};
+      /// The earliest time of each block and all blocks after.
+      std::vector<int64_t> earliest_{};
+      /// Whether the times within each block are in order.
+      std::vector<bool> sorted_{};
+  };
+
+  /// Converts the textual output of a DOU into log records.
+  ///
+  /// The times are taken from the timestamps of the readings, if any, which
+  /// are extended beyond their 32 bits by counting their wrap-arounds. This
+  /// requires at least one reading every 268 s. Readings without timestamp
+  /// are numbered instead, i.e., one nanosecond apart. The times count from
+  /// the first reading, which is at `origin_ns`, so that the outputs of DOUs
+  /// that have been captured from the same moment on share their epoch.
+  class Text_log_converter {
+    public:
+      explicit Text_log_converter(const uint16_t device,
+                                  const int64_t origin_ns = 0)
+          : device_{device}, origin_ns_{origin_ns} {}
+
+      /// Converts the readings that are completed by `data`.
+      void feed(const char *data, Size length);
+
+      /// The converted records that have not been taken yet, in the order
+      /// of time.
+      [[nodiscard]] std::deque<Log_record> &records() { return records_; }
+      [[nodiscard]] const std::deque<Log_record> &records() const {
+        return records_;
+      }
+
+      [[nodiscard]] const Receiver &receiver() const { return receiver_; }
+
+    private:
+      uint16_t device_;
+      int64_t origin_ns_;
+      Receiver receiver_{};
+      std::deque<Log_record> records_{};
+      int64_t ticks_{0};
+      uint32_t last_ticks_{0};
+      bool has_ticks_{false};
+      int64_t first_ns_{0};
+      bool has_first_{false};
+  };
+
+  /// Appends the textual outputs of several DOUs to a log, converted by
+  /// `Text_log_converter`s and merged in the order of time, so that the
+  /// index of the log narrows down ranges of time to the records within.
+  ///
+  /// A record is appended once it is known to be the earliest, i.e., when
+  /// each device has either a later record or ended. Until then, the output
+  /// of the devices that `is_waiting()` is to be fed. The outputs start
+  /// after the latest record of the log, so that one appended to keeps its
+  /// order.
+  class Text_log_merger {
+    public:
+      Text_log_merger(Log_writer &writer, std::size_t devices);
+
+      /// \return Whether the records of other devices wait for the output
+      /// of `device`, which has neither records left nor ended.
+      [[nodiscard]] bool is_waiting(std::size_t device) const;
+
+      /// Converts the output `data` of `device`, and appends the records
+      /// that are due.
+      ///
+      /// \return Whether these have been appended.
+      bool feed(std::size_t device, const char *data, Size length);
+
+      /// Ends the output of `device`, and appends the records that are due.
+      ///
+      /// \return Whether these have been appended.
+      bool end(std::size_t device);
+
+      [[nodiscard]] const Receiver &receiver(const std::size_t device) const {
+        return converters_[device].receiver();
+      }
+
+    private:
+      bool append_due_();
+
+      Log_writer &writer_;
+      std::vector<Text_log_converter> converters_{};
+      std::vector<bool> ended_{};
+  };
+
+} // namespace dou::host
+
+#endif // CAPTURE_LOG_HPP_
@@ -0,0 +1,360 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "bus_simulator.hpp"
+#include "emulator.hpp"
+#include "msp430.hpp"
+#include "msp430_cpu.hpp"
+#include "receiver.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dou::host {
+
+  namespace {
+
+    enum class Output_ {
+      /// One line per measurement, for humans.
+      Text,
+      /// `name,count,min_cycles,mean_cycles,max_cycles,total_cycles` with a
+      /// header line, so that builds can be compared by script.
+      Csv
+    };
+
+    auto output_ = Output_::Text;
+
+    /// Whether to fail if the main loop exceeds `max_poll_period_cycles`.
+    auto check_ = false;
+
+    constexpr auto timer_vector_ = 25;
+    constexpr auto timer_overflow_vector_ = 24;
+    constexpr auto port1_vector_ = 18;
+    constexpr auto port2_vector_ = 19;
+
+    struct Statistics_ {
+        long count{0};
+        uint64_t min{std::numeric_limits<uint64_t>::max()};
+        uint64_t max{0};
+        uint64_t total{0};
+
+        void add(const uint64_t cycles) {
+          ++count;
+          min = std::min(min, cycles);
+          max = std::max(max, cycles);
+          total += cycles;
+        }
+    };
+
+    void print_(const std::string &name, const Statistics_ &statistics) {
+      if (statistics.count == 0) {
+        return;
+      }
+      const auto mean = static_cast<double>(statistics.total)
+                        / static_cast<double>(statistics.count);
+      if (output_ == Output_::Csv) {
+        std::printf("%s,%ld,%llu,%.1f,%llu,%llu\n", name.c_str(),
+                    statistics.count,
+                    static_cast<unsigned long long>(statistics.min), mean,
+                    static_cast<unsigned long long>(statistics.max),
+                    static_cast<unsigned long long>(statistics.total));
+      } else {
+        std::printf("%-32s %8llu min %10.1f mean %8llu max cycles "
+                    "(count %ld)\n",
+                    name.c_str(),
+                    static_cast<unsigned long long>(statistics.min), mean,
+                    static_cast<unsigned long long>(statistics.max),
+                    statistics.count);
+      }
+    }
+
+    /// Attributes cycles to the functions of the firmware by the address of
+    /// the instruction that takes them.
+    class Profile_ {
+      public:
+        explicit Profile_(const std::vector<Elf_symbol> &symbols) {
+          for (const auto &symbol : symbols) {
+            if (symbol.is_function and (symbol.size != 0)) {
+              functions_.push_back(symbol);
+            }
+          }
+          std::sort(functions_.begin(), functions_.end(),
+                    [](const Elf_symbol &lhs, const Elf_symbol &rhs) {
+                      return lhs.address < rhs.address;
+                    });
+        }
+
+        void add(const uint16_t address, const uint32_t cycles) {
+          const auto function = std::upper_bound(
+              functions_.begin(), functions_.end(), address,
+              [](const uint16_t value, const Elf_symbol &symbol) {
+                return value < symbol.address;
+              });
+          if ((function == functions_.begin())
+              or (address >= (function - 1)->address + (function - 1)->size)) {
+            statistics_["(unknown)"].add(cycles);
+          } else {
+            statistics_[(function - 1)->name].add(cycles);
+          }
+        }
+
+        void add(const std::string &name, const uint32_t cycles) {
+          statistics_[name].add(cycles);
+        }
+
+        /// Prints the functions in the order of the cycles they take.
+        void print() const {
+          auto rows = std::vector<std::pair<std::string, Statistics_>>{
+              statistics_.begin(), statistics_.end()};
+          std::sort(rows.begin(), rows.end(), [](const auto &lhs,
+                                                 const auto &rhs) {
+            return lhs.second.total > rhs.second.total;
+          });
+          for (const auto &[name, statistics] : rows) {
+            print_("function " + name, statistics);
+          }
+        }
+
+      private:
+        std::vector<Elf_symbol> functions_{};
+        std::map<std::string, Statistics_> statistics_{};
+    };
+
+    /// Runs the firmware image on the instruction-set simulator against
+    /// `readings` windows and reports the cycles of its hot paths.
+    int measure_(const Elf_image &image, const long readings,
+                 const Sampling &sampling) {
+      const auto timing = Bus_timing{};
+      auto random = std::minstd_rand{1};
+      auto simulator = Bus_simulator{timing, sampling, 2};
+      auto expected = std::vector<std::string>{};
+      const auto bus_period_cycles = static_cast<uint32_t>(
+          (uint64_t{sampling.period_ns} * Emulator::cpu_frequency_Hz)
+          / 1'000'000'000);
+
+      auto peripherals = Peripherals{
+          [&](std::vector<Port_sample> &samples) {
+            if (static_cast<long>(expected.size()) >= readings) {
+              return false;
+            }
+            // leave the firmware time to set up the ports
+            if (expected.empty()) {
+              samples.assign(1'000, encode_signals(Input_state{}, false));
+            }
+            const auto reading = random_reading(random);
+            expected.push_back(reading_text(reading));
+            simulator.simulate(reading, samples);
+            return true;
+          },
+          std::max(bus_period_cycles, uint32_t{1})};
+      for (const auto &segment : image.segments) {
+        peripherals.load_image(segment.address, segment.bytes);
+      }
+
+      auto poll_period = Statistics_{};
+      auto window_end = Statistics_{};
+      auto interrupts = std::map<int, Statistics_>{};
+
+      // The main loop reads P2IN once per iteration, which tells the poll
+      // period and the end of each window.
+      const Msp430_cpu *observed = nullptr;
+      auto last_poll = uint64_t{0};
+      auto polling = false;
+      auto window_end_start = uint64_t{0};
+      auto in_window_end = false;
+      auto cpu = Msp430_cpu{
+          peripherals, [&](const uint16_t address, const uint16_t value) {
+            if ((address != msp430::P2IN.address) or (observed == nullptr)
+                or (observed->interrupt_depth() != 0)) {
+              return;
+            }
+            const auto now = peripherals.now();
+            const auto update_memory =
+                (static_cast<u8>(value) & nmup_mask_) == u8{0};
+            if (update_memory and polling) {
+              poll_period.add(now - last_poll);
+            } else if (not update_memory and polling) {
+              window_end_start = now;
+              in_window_end = true;
+            }
+            last_poll = now;
+            polling = update_memory;
+          }};
+      observed = &cpu;
+      cpu.reset();
+
+      auto profile = Profile_{image.symbols};
+      auto interrupt_start = uint64_t{0};
+      auto sleeping_cycles = uint64_t{0};
+      const auto window_ns = (uint64_t{timing.strobe_width_ns}
+                              + timing.blanking_ns)
+                                 * number_of_digits * timing.passes
+                             + timing.idle_ns;
+      const auto end = ((window_ns * static_cast<uint64_t>(readings))
+                        + 100'000'000)
+                       * Emulator::cpu_frequency_Hz / 1'000'000'000;
+
+      while (peripherals.now() < end) {
+        const auto address = cpu.reg(Msp430_cpu::pc);
+        const auto depth = cpu.interrupt_depth();
+        const auto was_sleeping = cpu.is_sleeping();
+        const auto start = peripherals.now();
+        const auto cycles = cpu.step();
+
+        if (cpu.interrupt_depth() > depth) {
+          interrupt_start = start;
+          profile.add("(interrupt entry)", cycles);
+        } else if (was_sleeping and (cpu.interrupt_depth() == depth)) {
+          sleeping_cycles += cycles;
+        } else {
+          profile.add(address, cycles);
+        }
+        if ((cpu.interrupt_depth() < depth) and (cpu.interrupt_depth() == 0)) {
+          interrupts[cpu.last_vector()].add(peripherals.now()
+                                            - interrupt_start);
+        }
+        if (in_window_end and cpu.is_sleeping()) {
+          window_end.add(peripherals.now() - window_end_start);
+          in_window_end = false;
+        }
+      }
+
+      const auto bit_cycles = static_cast<double>(Emulator::cpu_frequency_Hz)
+                              / serial_baud_rate;
+      auto max_edge_error = 0.0;
+      const auto characters = receive_uart(peripherals.tx_edges(),
+                                           bit_cycles, serial_data_bits,
+                                           max_edge_error);
+
+      // The readings are sent in order, but some may be skipped.
+      auto correct = 0L;
+      auto next_expected = expected.begin();
+      for (const auto &line : split_lines(characters)) {
+        const auto match = std::find(next_expected, expected.end(),
+                                     line.text);
+        if (match != expected.end()) {
+          ++correct;
+          next_expected = match + 1;
+        }
+      }
+
+      if (output_ == Output_::Csv) {
+        std::printf("name,count,min_cycles,mean_cycles,max_cycles,"
+                    "total_cycles\n");
+      }
+      print_("poll period (/MUP low)", poll_period);
+      print_("window end until sleep", window_end);
+      const auto names = std::map<int, std::string>{
+          {timer_vector_, "on_timer"},
+          {timer_overflow_vector_, "on_timer_overflow"},
+          {port1_vector_, "on_strobe (port 1)"},
+          {port2_vector_, "on_strobe (port 2)"}};
+      for (const auto &[vector, statistics] : interrupts) {
+        const auto name = names.find(vector);
+        print_(name != names.end() ? name->second
+                                   : "vector " + std::to_string(vector),
+               statistics);
+      }
+      const auto timer = interrupts.find(timer_vector_);
+      if ((timer != interrupts.end()) and not characters.empty()) {
+        auto per_character = Statistics_{};
+        per_character.count = static_cast<long>(characters.size());
+        per_character.min = timer->second.total / characters.size();
+        per_character.max = per_character.min;
+        per_character.total = timer->second.total;
+        print_("on_timer per character", per_character);
+      }
+      profile.print();
+
+      const auto seconds = static_cast<double>(peripherals.now())
+                           / Emulator::cpu_frequency_Hz;
+      std::fprintf(stderr,
+                   "%zu windows, %ld readings correct (%.1f/s), "
+                   "CPU load %.1f%%, max edge error %.1f%% of a bit\n",
+                   peripherals.window_ends().size(), correct,
+                   static_cast<double>(correct) / seconds,
+                   100.0
+                       - (100.0 * static_cast<double>(sleeping_cycles)
+                          / static_cast<double>(peripherals.now())),
+                   100.0 * max_edge_error / bit_cycles);
+
+      if (check_ and (poll_period.count == 0)) {
+        std::fprintf(stderr, "the main loop has not been polling\n");
+        return EXIT_FAILURE;
+      }
+      if (check_ and (correct == 0)) {
+        std::fprintf(stderr, "no reading has been received correctly\n");
+        return EXIT_FAILURE;
+      }
+      if (check_ and (poll_period.max
+                     > static_cast<uint64_t>(max_poll_period_cycles))) {
+        std::fprintf(stderr,
+                     "the main loop takes up to %llu cycles, which exceeds "
+                     "the budget of %ld cycles for sampling each strobe "
+                     "twice and the blanking once\n",
+                     static_cast<unsigned long long>(poll_period.max),
+                     static_cast<long>(max_poll_period_cycles));
+        return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+    }
+
+    int usage_() {
+      std::fprintf(stderr,
+                   "usage: dou_cycles [options] FIRMWARE\n"
+                   "  FIRMWARE        ELF file of the firmware\n"
+                   "options:\n"
+                   "  --csv           print comma-separated values\n"
+                   "  --check         fail if the main loop exceeds its "
+                   "budget or no\n"
+                   "                  reading is received correctly\n"
+                   "  -n READINGS     number of readings to simulate\n"
+                   "  -p PERIOD_NS    resolution of the simulated bus\n");
+      return EXIT_FAILURE;
+    }
+
+  } // namespace
+
+} // namespace dou::host
+
+int main(const int argc, const char *const argv[]) {
+  using namespace dou::host;
+
+  auto readings = 100L;
+  auto sampling = Sampling{};
+  sampling.period_ns = 1'000;
+
+  auto i = 1;
+  for (; i < argc; ++i) {
+    const auto option = std::string_view{argv[i]};
+    if (option == "--csv") {
+      output_ = Output_::Csv;
+    } else if (option == "--check") {
+      check_ = true;
+    } else if ((option == "-n") and ((i + 1) < argc)) {
+      readings = std::atol(argv[++i]);
+    } else if ((option == "-p") and ((i + 1) < argc)) {
+      sampling.period_ns = static_cast<uint32_t>(std::atol(argv[++i]));
+    } else {
+      break;
+    }
+  }
+  if ((i + 1) != argc) {
+    return usage_();
+  }
+
+  auto *const file = std::fopen(argv[i], "rb");
+  auto image = Elf_image{};
+  if ((file == nullptr) or not read_elf(file, image)) {
+    std::fprintf(stderr, "%s: not an MSP430 executable\n", argv[i]);
+    return EXIT_FAILURE;
+  }
+  std::fclose(file);
+
+  return measure_(image, readings, sampling);
+}
@@ -0,0 +1,110 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "ingestion.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+namespace dou::host {
+
+  namespace {
+
+    volatile std::sig_atomic_t stopping_ = 0;
+
+    void stop_(int /*signal*/) { stopping_ = 1; }
+
+    /// Writes the samples of all ports as they arrive, one line each, e.g.,
+    /// `3,123456,-3,MHz,0` for `123.456MHz` from the fourth port.
+    void print_(Ingestion &ingestion, const std::atomic<bool> &done) {
+      while (true) {
+        // read before draining, so that nothing queued before is missed
+        const auto last_round = done.load(std::memory_order_acquire);
+        auto printed = false;
+        for (auto port = std::size_t{0}; port < ingestion.ports(); ++port) {
+          auto received = Received_sample{};
+          while (ingestion.queue(port).pop(received)) {
+            const auto &sample = received.sample;
+            std::printf("%zu,%lld,%d,%s,%d\n", port,
+                        static_cast<long long>(sample.mantissa),
+                        static_cast<int>(sample.exponent),
+                        unit_text(sample.scaled.unit),
+                        sample.scaled.overflow ? 1 : 0);
+            printed = true;
+          }
+        }
+        if (printed) {
+          std::fflush(stdout);
+        } else if (last_round) {
+          return;
+        } else {
+          std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+      }
+    }
+
+    int usage_() {
+      std::fprintf(stderr, "usage: dou_daemon PORT...\n"
+                           "  PORT    serial port of a DOU, e.g., "
+                           "/dev/ttyUSB0\n");
+      return EXIT_FAILURE;
+    }
+
+  } // namespace
+
+} // namespace dou::host
+
+int main(const int argc, const char *const argv[]) {
+  using namespace dou::host;
+
+  if (argc < 2) {
+    return usage_();
+  }
+
+  auto ingestion = Ingestion{};
+  if (not ingestion.is_valid()) {
+    std::perror("epoll");
+    return EXIT_FAILURE;
+  }
+  for (auto i = 1; i < argc; ++i) {
+    if (ingestion.open(argv[i]) < 0) {
+      std::fprintf(stderr, "%s: %s\n", argv[i], std::strerror(errno));
+      return EXIT_FAILURE;
+    }
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = stop_;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  auto done = std::atomic<bool>{false};
+  auto printer = std::thread{[&] { print_(ingestion, done); }};
+
+  auto status = EXIT_SUCCESS;
+  while ((stopping_ == 0) and (ingestion.open_ports() != 0)) {
+    if (ingestion.poll(-1) < 0) {
+      std::perror("epoll_wait");
+      status = EXIT_FAILURE;
+      break;
+    }
+  }
+  done.store(true, std::memory_order_release);
+  printer.join();
+
+  for (auto port = std::size_t{0}; port < ingestion.ports(); ++port) {
+    std::fprintf(stderr, "%s: %llu readings, %llu errors, %llu dropped\n",
+                 argv[port + 1],
+                 static_cast<unsigned long long>(
+                     ingestion.receiver(port).samples()),
+                 static_cast<unsigned long long>(
+                     ingestion.receiver(port).errors()),
+                 static_cast<unsigned long long>(ingestion.dropped(port)));
+  }
+  return status;
+}
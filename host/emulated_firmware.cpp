@@ -0,0 +1,14 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "emulator.hpp"
+
+// The firmware itself, so that its reset and interrupt vectors are at hand.
+#include "msp430.cpp"
+
+namespace dou::host {
+
+  void run_firmware() { on_reset(); }
+
+  const Array<void (*)(), 32> &firmware_vectors() { return vtable_; }
+
+} // namespace dou::host
@@ -0,0 +1,492 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "emulator.hpp"
+
+#include "msp430.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+namespace dou::host {
+
+  namespace {
+
+    constexpr auto p1in_ = msp430::P1IN.address;
+    constexpr auto p1out_ = msp430::P1OUT.address;
+    constexpr auto p1dir_ = msp430::P1DIR.address;
+    constexpr auto p1ifg_ = msp430::P1IFG.address;
+    constexpr auto p1ies_ = msp430::P1IES.address;
+    constexpr auto p1ie_ = msp430::P1IE.address;
+    constexpr auto p2in_ = msp430::P2IN.address;
+    constexpr auto p2out_ = msp430::P2OUT.address;
+    constexpr auto p2dir_ = msp430::P2DIR.address;
+    constexpr auto p2ifg_ = msp430::P2IFG.address;
+    constexpr auto p2ies_ = msp430::P2IES.address;
+    constexpr auto p2ie_ = msp430::P2IE.address;
+
+    constexpr auto wdtctl_ = intptr_t{0x120};
+    constexpr auto wdt_password_ = uint16_t{0x5a};
+    constexpr auto wdt_read_password_ = uint8_t{0x69};
+    constexpr auto wdt_hold_ = uint8_t{0x80};
+    constexpr auto wdt_interval_mode_ = uint8_t{0x10};
+    constexpr auto wdt_count_clear_ = uint8_t{0x08};
+    constexpr auto wdt_aclk_ = uint8_t{0x04};
+    constexpr auto wdt_intervals_ = std::array<uint64_t, 4>{32768, 8192, 512,
+                                                            64};
+    // VLOCLK, which sources ACLK, runs at about 12 kHz.
+    constexpr auto cycles_per_aclk_ = uint64_t{Emulator::cpu_frequency_Hz
+                                               / 12'000};
+
+    constexpr auto tactl_ = intptr_t{0x160};
+    constexpr auto tacctl0_ = intptr_t{0x162};
+    constexpr auto tar_ = intptr_t{0x170};
+    constexpr auto taccr0_ = intptr_t{0x172};
+    constexpr auto taclr_ = uint16_t{0x04};
+    constexpr auto taie_ = uint16_t{0x02};
+    constexpr auto taifg_ = uint16_t{0x01};
+    constexpr auto ccie_ = uint16_t{0x10};
+    constexpr auto ccifg_ = uint16_t{0x01};
+    constexpr auto tassel_smclk_ = 2U;
+
+    enum class Timer_mode_ { Stop, Up, Continuous, Up_down };
+
+    // The vectors of the interrupt sources, in order of decreasing priority.
+    constexpr auto timer0_a0_vector_ = 25;
+    constexpr auto timer0_a1_vector_ = 24;
+    constexpr auto port2_vector_ = 19;
+    constexpr auto port1_vector_ = 18;
+
+    /// Thrown to leave the firmware once the run has ended.
+    struct Stop_ {};
+
+    /// Thrown to restart the firmware on a power-up clear.
+    struct Reset_ {};
+
+    Emulator *active_ = nullptr;
+
+    Emulator &active_emulator() { return *active_; }
+
+    uint8_t if_edges_(const uint8_t before, const uint8_t after,
+                      const uint8_t falling) {
+      const auto rising_edges = static_cast<uint8_t>(after & ~before);
+      const auto falling_edges = static_cast<uint8_t>(before & ~after);
+      return static_cast<uint8_t>((rising_edges & ~falling)
+                                  | (falling_edges & falling));
+    }
+
+  } // namespace
+
+  Peripherals::Peripherals(Bus_source bus, const uint32_t bus_period_cycles)
+      : bus_{std::move(bus)}, bus_period_cycles_{bus_period_cycles},
+        bus_sample_{u8{0}, nmup_mask_} {
+    reset();
+  }
+
+  void Peripherals::reset() {
+    std::fill_n(memory_.begin(), 0x200, uint8_t{0});
+    memory_[wdtctl_ + 1] = wdt_read_password_;
+    reset_requested_ = false;
+    timer_prescaler_ = 0;
+    watchdog_count_ = 0;
+    update_tx_line();
+  }
+
+  uint16_t Peripherals::word(const intptr_t address) const {
+    const auto index = static_cast<std::size_t>(address);
+    return static_cast<uint16_t>(memory_[index]
+                                 | (memory_[index + 1] << 8U));
+  }
+
+  void Peripherals::set_word(const intptr_t address, const uint16_t value) {
+    const auto index = static_cast<std::size_t>(address);
+    memory_[index] = static_cast<uint8_t>(value);
+    memory_[index + 1] = static_cast<uint8_t>(value >> 8U);
+  }
+
+  uint16_t Peripherals::read(const intptr_t address, const Size size) const {
+    if (address == p1in_) {
+      return static_cast<uint16_t>(
+          (to_integral(bus_sample_.port1) & ~memory_[p1dir_])
+          | (memory_[p1out_] & memory_[p1dir_]));
+    }
+    if (address == p2in_) {
+      return static_cast<uint16_t>(
+          (to_integral(bus_sample_.port2) & ~memory_[p2dir_])
+          | (memory_[p2out_] & memory_[p2dir_]));
+    }
+    return size == 2 ? word(address)
+                     : memory_[static_cast<std::size_t>(address)];
+  }
+
+  void Peripherals::write(const intptr_t address, const Size size,
+                          uint16_t value) {
+    if (address == wdtctl_) {
+      // writing without the password causes a power-up clear
+      if ((size != 2) or ((value >> 8U) != wdt_password_)) {
+        reset_requested_ = true;
+        return;
+      }
+      if ((value & wdt_count_clear_) != 0) {
+        watchdog_count_ = 0;
+      }
+      memory_[wdtctl_] = static_cast<uint8_t>(value & ~wdt_count_clear_);
+    } else if (address == tactl_) {
+      if ((value & taclr_) != 0) {
+        set_word(tar_, 0);
+        timer_prescaler_ = 0;
+        value = static_cast<uint16_t>(value & ~taclr_);
+      }
+      set_word(tactl_, value);
+    } else if ((address != p1in_) and (address != p2in_)) {
+      if (size == 2) {
+        set_word(address, value);
+      } else {
+        memory_[static_cast<std::size_t>(address)] =
+            static_cast<uint8_t>(value);
+      }
+    }
+    if ((address == p1out_) or (address == p1dir_)) {
+      update_tx_line();
+    }
+  }
+
+  void Peripherals::load_image(const intptr_t address,
+                               const std::vector<uint8_t> &bytes) {
+    std::copy_n(bytes.begin(),
+                std::min(bytes.size(), memory_.size()
+                                           - static_cast<std::size_t>(address)),
+                memory_.begin() + address);
+  }
+
+  uint64_t Peripherals::timer_ticks_to_event() const {
+    const auto control = word(tactl_);
+    const auto mode = static_cast<Timer_mode_>((control >> 4U) & 3U);
+    if ((mode == Timer_mode_::Stop)
+        or (((control >> 8U) & 3U) != tassel_smclk_)) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+
+    // Up/down mode is not used by the firmware and counts like up mode.
+    const auto count = uint64_t{word(tar_)};
+    const auto compare = uint64_t{word(taccr0_)};
+    const auto top = mode == Timer_mode_::Continuous ? uint64_t{0xffff}
+                                                     : compare;
+    const auto to_zero = count <= top ? top - count + 1 : 0x10000 - count;
+    const auto to_compare = compare > count ? compare - count
+                                            : to_zero + compare;
+    return std::min(to_zero, to_compare);
+  }
+
+  uint64_t Peripherals::cycles_to_next_event() const {
+    auto cycles = next_sample_cycle_ - now_;
+    const auto ticks = timer_ticks_to_event();
+    if (ticks != std::numeric_limits<uint64_t>::max()) {
+      const auto divider = uint64_t{1} << ((word(tactl_) >> 6U) & 3U);
+      cycles = std::min(cycles, (ticks * divider) - timer_prescaler_);
+    }
+    return std::max(cycles, uint64_t{1});
+  }
+
+  void Peripherals::advance(uint64_t cycles) {
+    while (cycles > 0) {
+      const auto step = std::min(cycles, cycles_to_next_event());
+      cycles -= step;
+      now_ += step;
+
+      const auto divider = uint64_t{1} << ((word(tactl_) >> 6U) & 3U);
+      timer_prescaler_ += step;
+      tick_timer(timer_prescaler_ / divider);
+      timer_prescaler_ %= divider;
+
+      tick_watchdog(step);
+
+      while (now_ >= next_sample_cycle_) {
+        next_bus_sample();
+      }
+    }
+  }
+
+  void Peripherals::tick_timer(uint64_t ticks) {
+    while (ticks > 0) {
+      const auto to_event = timer_ticks_to_event();
+      if (to_event == std::numeric_limits<uint64_t>::max()) {
+        return;
+      }
+      const auto step = std::min(ticks, to_event);
+      ticks -= step;
+
+      const auto control = word(tactl_);
+      const auto count = uint64_t{word(tar_)};
+      const auto top = static_cast<Timer_mode_>((control >> 4U) & 3U)
+                               == Timer_mode_::Continuous
+                           ? uint64_t{0xffff}
+                           : uint64_t{word(taccr0_)};
+      const auto to_zero = count <= top ? top - count + 1 : 0x10000 - count;
+      if (step == to_zero) {
+        set_word(tar_, 0);
+        set_word(tactl_, control | taifg_);
+      } else {
+        set_word(tar_, static_cast<uint16_t>(count + step));
+      }
+      if (word(tar_) == word(taccr0_)) {
+        set_word(tacctl0_, word(tacctl0_) | ccifg_);
+      }
+    }
+  }
+
+  void Peripherals::tick_watchdog(const uint64_t cycles) {
+    const auto control = memory_[wdtctl_];
+    if ((control & (wdt_hold_ | wdt_interval_mode_)) != 0) {
+      return;
+    }
+    watchdog_count_ += cycles;
+    const auto interval = wdt_intervals_[control & 3U]
+                          * ((control & wdt_aclk_) != 0 ? cycles_per_aclk_
+                                                        : 1);
+    if (watchdog_count_ >= interval) {
+      reset_requested_ = true;
+    }
+  }
+
+  void Peripherals::next_bus_sample() {
+    if (next_sample_ >= static_cast<Size>(samples_.size())) {
+      samples_.clear();
+      next_sample_ = 0;
+      bus_active_ = bus_active_ and bus_ and bus_(samples_)
+                    and not samples_.empty();
+      if (not bus_active_) {
+        next_sample_cycle_ = std::numeric_limits<uint64_t>::max();
+        return;
+      }
+    }
+
+    const auto previous = bus_sample_;
+    bus_sample_ = samples_[static_cast<std::size_t>(next_sample_++)];
+    next_sample_cycle_ += bus_period_cycles_;
+
+    const auto port1 = to_integral(bus_sample_.port1);
+    const auto port2 = to_integral(bus_sample_.port2);
+    memory_[p1ifg_] |= if_edges_(to_integral(previous.port1), port1,
+                                 memory_[p1ies_]);
+    memory_[p2ifg_] |= if_edges_(to_integral(previous.port2), port2,
+                                 memory_[p2ies_]);
+
+    if (((previous.port2 & nmup_mask_) == u8{0})
+        and ((bus_sample_.port2 & nmup_mask_) != u8{0})) {
+      window_ends_.push_back(now_);
+    }
+  }
+
+  void Peripherals::update_tx_line() {
+    // inverted by the line driver
+    const auto level = (memory_[p1out_] & memory_[p1dir_]
+                        & to_integral(tx_mask_))
+                       == 0;
+    if (level != tx_level_) {
+      tx_level_ = level;
+      tx_edges_.push_back({now_, level});
+    }
+  }
+
+  int Peripherals::accept_interrupt() {
+    if ((word(tacctl0_) & (ccie_ | ccifg_)) == (ccie_ | ccifg_)) {
+      set_word(tacctl0_, static_cast<uint16_t>(word(tacctl0_) & ~ccifg_));
+      return timer0_a0_vector_;
+    }
+    if ((word(tactl_) & (taie_ | taifg_)) == (taie_ | taifg_)) {
+      return timer0_a1_vector_;
+    }
+    if ((memory_[p2ie_] & memory_[p2ifg_]) != 0) {
+      return port2_vector_;
+    }
+    if ((memory_[p1ie_] & memory_[p1ifg_]) != 0) {
+      return port1_vector_;
+    }
+    return 0;
+  }
+
+  Emulator::Emulator(const Cpu_timing &timing, Bus_source bus,
+                     const uint32_t bus_period_cycles)
+      : timing_{timing}, peripherals_{std::move(bus), bus_period_cycles} {
+    active_ = this;
+  }
+
+  Emulator::~Emulator() { active_ = nullptr; }
+
+  void Emulator::run(const uint64_t cycles) {
+    end_ = now() + cycles;
+    while (true) {
+      peripherals_.reset();
+      interrupts_enabled_ = false;
+      sleeping_ = false;
+      try {
+        run_firmware();
+      } catch (const Reset_ &) {
+        ++watchdog_resets_;
+      } catch (const Stop_ &) {
+        return;
+      }
+    }
+  }
+
+  uint16_t Emulator::load(const intptr_t address, const Size size) {
+    const auto value = peripherals_.read(address, size);
+    advance(timing_.cycles_per_access);
+    dispatch();
+    return value;
+  }
+
+  void Emulator::store(const intptr_t address, const Size size,
+                       const uint16_t value) {
+    peripherals_.write(address, size, value);
+    advance(timing_.cycles_per_access);
+    dispatch();
+  }
+
+  void Emulator::set_interrupts_enabled(const bool enabled) {
+    interrupts_enabled_ = enabled;
+    dispatch();
+  }
+
+  void Emulator::sleep(const bool enable_interrupts) {
+    interrupts_enabled_ = interrupts_enabled_ or enable_interrupts;
+    sleeping_ = true;
+    dispatch();
+    while (sleeping_) {
+      advance(peripherals_.cycles_to_next_event());
+      dispatch();
+    }
+  }
+
+  void Emulator::advance(const uint64_t cycles) {
+    const auto until_end = end_ - now();
+    peripherals_.advance(std::min(cycles, until_end));
+    if (sleeping_) {
+      sleeping_cycles_ += std::min(cycles, until_end);
+    }
+    if (peripherals_.reset_requested()) {
+      throw Reset_{};
+    }
+    if (cycles >= until_end) {
+      throw Stop_{};
+    }
+  }
+
+  void Emulator::dispatch() {
+    while (interrupts_enabled_) {
+      const auto vector = peripherals_.accept_interrupt();
+      if (vector == 0) {
+        return;
+      }
+
+      // The status register is saved and cleared on entry, which disables
+      // interrupts and wakes up the CPU, and restored on return.
+      const auto was_sleeping = sleeping_;
+      interrupts_enabled_ = false;
+      sleeping_ = false;
+      wake_on_exit_ = false;
+      advance(timing_.interrupt_cycles);
+      firmware_vectors()[vector]();
+      interrupts_enabled_ = true;
+      sleeping_ = was_sleeping and not wake_on_exit_;
+    }
+  }
+
+  std::vector<Uart_character> receive_uart(const std::vector<Line_edge> &edges,
+                                           const double bit_cycles,
+                                           const int data_bits,
+                                           double &max_edge_error) {
+    const auto level_at = [&edges](const double cycle) {
+      const auto next = std::upper_bound(
+          edges.begin(), edges.end(), cycle,
+          [](const double time, const Line_edge &edge) {
+            return time < static_cast<double>(edge.cycle);
+          });
+      return next == edges.begin() or std::prev(next)->level;
+    };
+
+    max_edge_error = 0.0;
+    auto characters = std::vector<Uart_character>{};
+    auto i = std::size_t{0};
+    while (i < edges.size()) {
+      if (edges[i].level) {
+        ++i;
+        continue;
+      }
+
+      const auto start = static_cast<double>(edges[i].cycle);
+      auto value = 0;
+      for (auto bit = 0; bit < data_bits; ++bit) {
+        if (level_at(start + ((bit + 1.5) * bit_cycles))) {
+          value |= 1 << bit;
+        }
+      }
+      const auto stop = start + ((data_bits + 1.5) * bit_cycles);
+      characters.push_back({edges[i].cycle, static_cast<char>(value),
+                            level_at(start + (0.5 * bit_cycles))
+                                or not level_at(stop)});
+
+      for (++i; (i < edges.size())
+                and (static_cast<double>(edges[i].cycle) < stop);
+           ++i) {
+        const auto bits = (static_cast<double>(edges[i].cycle) - start)
+                          / bit_cycles;
+        max_edge_error = std::max(max_edge_error,
+                                  std::abs(bits - std::round(bits))
+                                      * bit_cycles);
+      }
+    }
+    return characters;
+  }
+
+  std::vector<Uart_line>
+  split_lines(const std::vector<Uart_character> &characters) {
+    auto lines = std::vector<Uart_line>{};
+    auto line = Uart_line{};
+    for (const auto &character : characters) {
+      if (line.text.empty()) {
+        line.start = character.start;
+      }
+      line.text += character.value;
+      if (line.text.ends_with("\r\n")) {
+        line.text.resize(line.text.size() - 2);
+        lines.push_back(std::move(line));
+        line = {};
+      }
+    }
+    return lines;
+  }
+
+} // namespace dou::host
+
+uint16_t emulated_load(const intptr_t address, const Size size) {
+  return dou::host::active_emulator().load(address, size);
+}
+
+void emulated_store(const intptr_t address, const Size size,
+                    const uint16_t value) {
+  dou::host::active_emulator().store(address, size, value);
+}
+
+namespace msp430 {
+
+  void go_to_sleep() { dou::host::active_emulator().sleep(false); }
+
+  void enable_interrupts_and_sleep() {
+    dou::host::active_emulator().sleep(true);
+  }
+
+  void stay_awake() { dou::host::active_emulator().stay_awake(); }
+
+  void enable_interrupts() {
+    dou::host::active_emulator().set_interrupts_enabled(true);
+  }
+
+  void disable_interrupts() {
+    dou::host::active_emulator().set_interrupts_enabled(false);
+  }
+
+} // namespace msp430
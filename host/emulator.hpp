@@ -0,0 +1,221 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef EMULATOR_HPP_
+#define EMULATOR_HPP_
+
+#include "bus.hpp"
+#include "dou.hpp"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dou::host {
+
+  /// Costs of the firmware in CPU cycles, which the emulation charges to the
+  /// virtual time.
+  struct Cpu_timing {
+      /// Cycles per register access, which stand for the code between two
+      /// accesses as well. The default matches a main loop of about 80
+      /// cycles, which reads both ports once per iteration.
+      uint32_t cycles_per_access{40};
+      /// Cycles for entering and returning from an interrupt.
+      uint32_t interrupt_cycles{11};
+  };
+
+  /// A change of the serial output, at the level behind the inverting line
+  /// driver, i.e., high is mark.
+  struct Line_edge {
+      uint64_t cycle;
+      bool level;
+  };
+
+  /// Appends the port samples of the next measurement window to `samples`.
+  ///
+  /// \return Whether there has been another window, otherwise the bus stays
+  /// idle.
+  using Bus_source = std::function<bool(std::vector<Port_sample> &samples)>;
+
+  /// The peripherals of the MSP430G2452 that the firmware uses: the ports,
+  /// Timer0_A3 in up and continuous mode and the watchdog timer, whereas the
+  /// NMI, TACCR1 and the USI are not emulated. The port inputs follow a
+  /// simulated display bus.
+  ///    The registers are part of a 64 KiB memory, which also holds the
+  /// program when it is executed by `Msp430_cpu`.
+  class Peripherals {
+    public:
+      /// \param bus_period_cycles The duration of each port sample that is
+      ///        provided by `bus`.
+      Peripherals(Bus_source bus, uint32_t bus_period_cycles);
+
+      /// Power-up clear, which resets the registers and keeps the rest of
+      /// the memory.
+      void reset();
+
+      /// \return Whether the watchdog timer demands a power-up clear.
+      [[nodiscard]] bool reset_requested() const { return reset_requested_; }
+
+      [[nodiscard]] uint16_t read(intptr_t address, Size size) const;
+      void write(intptr_t address, Size size, uint16_t value);
+
+      /// Copies `bytes` to the memory at `address`.
+      void load_image(intptr_t address, const std::vector<uint8_t> &bytes);
+
+      void advance(uint64_t cycles);
+
+      /// \return The number of cycles until the timer or the bus changes,
+      /// at least one.
+      [[nodiscard]] uint64_t cycles_to_next_event() const;
+
+      /// \return The vector of the enabled interrupt of highest priority
+      /// that is pending, or zero. The flag of a source that has a vector of
+      /// its own is reset.
+      int accept_interrupt();
+
+      [[nodiscard]] uint64_t now() const { return now_; }
+
+      /// \return The changes of the serial output since construction.
+      [[nodiscard]] const std::vector<Line_edge> &tx_edges() const {
+        return tx_edges_;
+      }
+
+      /// \return The times at which /MUP has returned to high.
+      [[nodiscard]] const std::vector<uint64_t> &window_ends() const {
+        return window_ends_;
+      }
+
+    private:
+      [[nodiscard]] uint16_t word(intptr_t address) const;
+      void set_word(intptr_t address, uint16_t value);
+
+      [[nodiscard]] uint64_t timer_ticks_to_event() const;
+      void tick_timer(uint64_t ticks);
+      void tick_watchdog(uint64_t cycles);
+      void next_bus_sample();
+      void update_tx_line();
+
+      Bus_source bus_;
+      uint32_t bus_period_cycles_;
+
+      std::array<uint8_t, 0x10000> memory_{};
+      uint64_t now_{0};
+      bool reset_requested_{false};
+
+      std::vector<Port_sample> samples_{};
+      Size next_sample_{0};
+      uint64_t next_sample_cycle_{0};
+      Port_sample bus_sample_;
+      bool bus_active_{true};
+      std::vector<uint64_t> window_ends_{};
+
+      uint64_t timer_prescaler_{0};
+      uint64_t watchdog_count_{0};
+
+      bool tx_level_{true};
+      std::vector<Line_edge> tx_edges_{};
+  };
+
+  /// Runs the firmware natively on the host, with its registers backed by
+  /// `Peripherals`, so that the actual `run()` and interrupt service routines
+  /// execute against a simulated display bus and in virtual time.
+  ///    Time advances by `Cpu_timing` with each register access and skips
+  /// ahead while the CPU sleeps. Interrupts are dispatched in between
+  /// register accesses.
+  ///    Only one emulator can be active at a time. Each run and each
+  /// watchdog reset start the firmware from its reset vector, which gives
+  /// its variables their initial values as on a power-up clear.
+  class Emulator {
+    public:
+      static constexpr auto cpu_frequency_Hz = 16'000'000L;
+
+      /// \param bus_period_cycles The duration of each port sample that is
+      ///        provided by `bus`.
+      Emulator(const Cpu_timing &timing, Bus_source bus,
+               uint32_t bus_period_cycles);
+      ~Emulator();
+
+      Emulator(const Emulator &) = delete;
+      Emulator &operator=(const Emulator &) = delete;
+
+      /// Resets the device and runs the firmware for `cycles` of virtual
+      /// time, which continues from the end of the previous run.
+      void run(uint64_t cycles);
+
+      [[nodiscard]] uint64_t now() const { return peripherals_.now(); }
+
+      [[nodiscard]] const Peripherals &peripherals() const {
+        return peripherals_;
+      }
+
+      [[nodiscard]] uint64_t sleeping_cycles() const {
+        return sleeping_cycles_;
+      }
+
+      [[nodiscard]] uint32_t watchdog_resets() const {
+        return watchdog_resets_;
+      }
+
+      // Called by the firmware through `load()`, `store()` and the
+      // intrinsics of msp430.hpp.
+
+      uint16_t load(intptr_t address, Size size);
+      void store(intptr_t address, Size size, uint16_t value);
+      void set_interrupts_enabled(bool enabled);
+      void sleep(bool enable_interrupts);
+      void stay_awake() { wake_on_exit_ = true; }
+
+    private:
+      void advance(uint64_t cycles);
+      void dispatch();
+
+      Cpu_timing timing_;
+      Peripherals peripherals_;
+      uint64_t end_{0};
+      bool interrupts_enabled_{false};
+      bool sleeping_{false};
+      bool wake_on_exit_{false};
+      uint64_t sleeping_cycles_{0};
+      uint32_t watchdog_resets_{0};
+  };
+
+  /// A character received from the serial output.
+  struct Uart_character {
+      /// Time of the falling edge of the start bit.
+      uint64_t start;
+      char value;
+      bool framing_error;
+  };
+
+  /// Receives the serial output `edges` like a UART that samples the middle
+  /// of each bit of `data_bits` plus start and stop bit.
+  ///
+  /// \param max_edge_error Set to the largest deviation of an edge within a
+  ///        frame from the ideal bit boundaries, in CPU cycles.
+  std::vector<Uart_character> receive_uart(const std::vector<Line_edge> &edges,
+                                           double bit_cycles, int data_bits,
+                                           double &max_edge_error);
+
+  /// A line of text received from the serial output.
+  struct Uart_line {
+      /// Time of the start bit of the first character.
+      uint64_t start;
+      /// The characters without the line ending.
+      std::string text;
+  };
+
+  /// \return The complete lines in `characters`, which end in "\r\n".
+  std::vector<Uart_line>
+  split_lines(const std::vector<Uart_character> &characters);
+
+  /// Runs the firmware from its reset vector. Defined by including the
+  /// firmware in host/emulated_firmware.cpp.
+  [[noreturn]] void run_firmware();
+
+  /// \return The interrupt vectors of the firmware.
+  const Array<void (*)(), 32> &firmware_vectors();
+
+} // namespace dou::host
+
+#endif // EMULATOR_HPP_
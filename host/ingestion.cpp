@@ -0,0 +1,212 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "ingestion.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace dou::host {
+
+  namespace {
+
+    constexpr auto max_events_ = 64;
+
+    /// Large enough for everything that arrives at 115200 baud within 0.3 s,
+    /// so that a port rarely needs more than one read per wake-up.
+    constexpr auto read_size_ = std::size_t{4096};
+
+    speed_t to_speed_(const long baud_rate) {
+      switch (baud_rate) {
+      case 19200:
+        return B19200;
+      case 115200:
+        return B115200;
+      default:
+        return B0;
+      }
+    }
+
+    int64_t now_ns_() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+    }
+
+  } // namespace
+
+  int open_serial_port(const char *const path) {
+    const auto fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      return -1;
+    }
+
+    auto attributes = termios{};
+    if (tcgetattr(fd, &attributes) != 0) {
+      const auto error = errno;
+      ::close(fd);
+      errno = error;
+      return -1;
+    }
+    cfmakeraw(&attributes);
+    attributes.c_cflag &= ~static_cast<tcflag_t>(CSIZE | CSTOPB | PARENB);
+    attributes.c_cflag |= (serial_data_bits == 7 ? CS7 : CS8) | CLOCAL | CREAD;
+    // Non-blocking reads return what has arrived, and fail with EAGAIN
+    // rather than returning 0 if nothing has, which is left to mean EOF.
+    attributes.c_cc[VMIN] = 1;
+    attributes.c_cc[VTIME] = 0;
+    cfsetispeed(&attributes, to_speed_(serial_baud_rate));
+    cfsetospeed(&attributes, to_speed_(serial_baud_rate));
+    if (tcsetattr(fd, TCSANOW, &attributes) != 0) {
+      const auto error = errno;
+      ::close(fd);
+      errno = error;
+      return -1;
+    }
+    tcflush(fd, TCIFLUSH);
+
+    // Without this, USB-serial adapters such as the FTDI ones hold back
+    // characters for up to 16 ms. Other ports do not support it.
+    auto serial = serial_struct{};
+    if (ioctl(fd, TIOCGSERIAL, &serial) == 0) {
+      serial.flags |= static_cast<int>(ASYNC_LOW_LATENCY);
+      (void)ioctl(fd, TIOCSSERIAL, &serial);
+    }
+    return fd;
+  }
+
+  Ingestion::Ingestion() : epoll_{epoll_create1(EPOLL_CLOEXEC)} {}
+
+  Ingestion::~Ingestion() {
+    for (const auto &port : ports_) {
+      close(*port);
+    }
+    if (epoll_ >= 0) {
+      ::close(epoll_);
+    }
+  }
+
+  int Ingestion::add(const int fd) {
+    auto event = epoll_event{};
+    event.events = EPOLLIN;
+    event.data.u64 = ports_.size();
+    if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) {
+      return -1;
+    }
+    ports_.push_back(std::make_unique<Port_>());
+    ports_.back()->fd = fd;
+    ++open_ports_;
+    return static_cast<int>(ports_.size() - 1);
+  }
+
+  int Ingestion::open(const char *const path) {
+    const auto fd = open_serial_port(path);
+    if (fd < 0) {
+      return -1;
+    }
+    const auto port = add(fd);
+    if (port < 0) {
+      const auto error = errno;
+      ::close(fd);
+      errno = error;
+    }
+    return port;
+  }
+
+  int Ingestion::poll(const int timeout_ms) {
+    auto events = std::array<epoll_event, max_events_>{};
+    const auto ready = epoll_wait(epoll_, events.data(), max_events_,
+                                  timeout_ms);
+    if (ready < 0) {
+      return errno == EINTR ? 0 : -1;
+    }
+
+    auto completed = 0;
+    for (auto i = 0; i < ready; ++i) {
+      auto &port = *ports_[events[static_cast<std::size_t>(i)].data.u64];
+      // A hung-up port may still have characters to read, which read()
+      // returns before it fails.
+      completed += read(port);
+    }
+    return completed;
+  }
+
+  int Ingestion::read(Port_ &port) {
+    if (port.fd < 0) {
+      return 0;
+    }
+    auto buffer = std::array<char, read_size_>{};
+    const auto length = ::read(port.fd, buffer.data(), buffer.size());
+    if (length <= 0) {
+      if ((length == 0) or ((errno != EAGAIN) and (errno != EINTR))) {
+        close(port);
+      }
+      return 0;
+    }
+
+    const auto received_ns = now_ns_();
+    return static_cast<int>(port.receiver.feed(
+        buffer.data(), static_cast<Size>(length),
+        [&port, received_ns](const Sample &sample) {
+          if (not port.queue.push({sample, received_ns})) {
+            port.dropped.fetch_add(1, std::memory_order_relaxed);
+          }
+        }));
+  }
+
+  void Ingestion::close(Port_ &port) {
+    if (port.fd < 0) {
+      return;
+    }
+    (void)epoll_ctl(epoll_, EPOLL_CTL_DEL, port.fd, nullptr);
+    ::close(port.fd);
+    port.fd = -1;
+    --open_ports_;
+  }
+
+  Pseudo_terminal::Pseudo_terminal()
+      : master_{posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC)} {
+    if (master_ < 0) {
+      return;
+    }
+    auto name = std::array<char, 64>{};
+    if ((grantpt(master_) != 0) or (unlockpt(master_) != 0)
+        or (ptsname_r(master_, name.data(), name.size()) != 0)) {
+      close();
+      return;
+    }
+    port_ = name.data();
+  }
+
+  Pseudo_terminal::~Pseudo_terminal() { close(); }
+
+  bool Pseudo_terminal::write(const char *data, std::size_t length) {
+    while (length != 0) {
+      const auto written = ::write(master_, data, length);
+      if ((written < 0) and (errno == EINTR)) {
+        continue;
+      }
+      if (written <= 0) {
+        return false;
+      }
+      data += written;
+      length -= static_cast<std::size_t>(written);
+    }
+    return true;
+  }
+
+  void Pseudo_terminal::close() {
+    if (master_ >= 0) {
+      ::close(master_);
+      master_ = -1;
+    }
+  }
+
+} // namespace dou::host
@@ -0,0 +1,193 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef INGESTION_HPP_
+#define INGESTION_HPP_
+
+#include "receiver.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dou::host {
+
+  /// Single-producer/single-consumer FIFO between two threads.
+  ///
+  /// Like `Ring_buffer`, the producer only ever writes `head_` and the
+  /// consumer only ever writes `tail_`, but the indices are atomics that
+  /// publish the slots with release and acquire ordering, and each lives on
+  /// its own cache line.
+  template <typename Tp_, std::size_t nm_> class Spsc_queue {
+    public:
+      static_assert((nm_ > 0) and ((nm_ & (nm_ - 1)) == 0),
+                    "capacity must be a power of two");
+
+      static constexpr std::size_t capacity() { return nm_; }
+
+      /// Called by the producer only.
+      bool push(const Tp_ &value) {
+        const auto head = head_.load(std::memory_order_relaxed);
+        if ((head - tail_.load(std::memory_order_acquire)) == nm_) {
+          return false;
+        }
+        items_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      /// Called by the consumer only.
+      bool pop(Tp_ &value) {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+          return false;
+        }
+        value = items_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      [[nodiscard]] bool empty() const {
+        return head_.load(std::memory_order_acquire)
+               == tail_.load(std::memory_order_acquire);
+      }
+
+    private:
+      static constexpr auto mask_ = nm_ - 1;
+
+      alignas(64) std::atomic<std::size_t> head_{0};
+      alignas(64) std::atomic<std::size_t> tail_{0};
+      alignas(64) std::array<Tp_, nm_> items_{};
+  };
+
+  /// A `Sample` with the time at which it has been read from the port.
+  struct Received_sample {
+      Sample sample;
+      /// Of `std::chrono::steady_clock`.
+      int64_t received_ns;
+  };
+
+  /// The readings of one DOU, for one consumer thread.
+  using Sample_queue = Spsc_queue<Received_sample, 1024>;
+
+  /// Opens the serial port at `path` for non-blocking reads of raw
+  /// characters in the frame format and at the baud rate of the firmware,
+  /// i.e., without any processing of the input, without echo, and with
+  /// read() returning whatever has arrived. Where the driver supports it,
+  /// the port is switched to low latency, so that a USB-serial adapter
+  /// passes on characters right away.
+  ///
+  /// \return The file descriptor, or -1 with `errno` set.
+  int open_serial_port(const char *path);
+
+  /// Reads the readings of several DOUs, one per serial port, on a single
+  /// thread waiting for all ports by epoll, and queues them per port.
+  ///
+  /// Each port is parsed incrementally by its own `Receiver`, so chunks
+  /// do not need to be aligned with lines. The queue of each port may be
+  /// drained by another thread. Samples that do not fit into a full queue
+  /// are dropped and counted.
+  class Ingestion {
+    public:
+      Ingestion();
+      ~Ingestion();
+      Ingestion(const Ingestion &) = delete;
+      Ingestion &operator=(const Ingestion &) = delete;
+
+      /// Whether the epoll instance has been created.
+      [[nodiscard]] bool is_valid() const { return epoll_ >= 0; }
+
+      /// Takes over `fd`, which is to be non-blocking.
+      ///
+      /// \return The index of the port, or -1 with `errno` set.
+      int add(int fd);
+
+      /// Opens the serial port at `path` by `open_serial_port()` and adds it.
+      ///
+      /// \return The index of the port, or -1 with `errno` set.
+      int open(const char *path);
+
+      /// Waits up to `timeout_ms` for any port to become readable, and reads
+      /// and parses what has arrived. A port that has been hung up or fails
+      /// is closed.
+      ///
+      /// \return The number of samples that have been completed, or -1 with
+      /// `errno` set.
+      int poll(int timeout_ms);
+
+      [[nodiscard]] std::size_t ports() const { return ports_.size(); }
+
+      /// \return The number of ports that have not been closed.
+      [[nodiscard]] std::size_t open_ports() const { return open_ports_; }
+
+      [[nodiscard]] bool is_open(const std::size_t port) const {
+        return ports_[port]->fd >= 0;
+      }
+
+      /// May be called from the consumer thread of `port`.
+      Sample_queue &queue(const std::size_t port) {
+        return ports_[port]->queue;
+      }
+
+      /// \return The number of samples of `port` that have been dropped as
+      /// its queue was full. May be called from any thread.
+      [[nodiscard]] uint64_t dropped(const std::size_t port) const {
+        return ports_[port]->dropped.load(std::memory_order_relaxed);
+      }
+
+      /// \return The `Receiver` of `port`, to be called from the thread
+      /// that polls only.
+      [[nodiscard]] const Receiver &receiver(const std::size_t port) const {
+        return ports_[port]->receiver;
+      }
+
+    private:
+      struct Port_ {
+          int fd;
+          Receiver receiver{};
+          Sample_queue queue{};
+          std::atomic<uint64_t> dropped{0};
+      };
+
+      int read(Port_ &port);
+      void close(Port_ &port);
+
+      int epoll_;
+      std::vector<std::unique_ptr<Port_>> ports_{};
+      std::size_t open_ports_{0};
+  };
+
+  /// A pseudo-terminal, whose slave side stands in for the serial port of a
+  /// DOU, and whose master side is fed with its output, e.g., by tests and
+  /// benchmarks.
+  class Pseudo_terminal {
+    public:
+      Pseudo_terminal();
+      ~Pseudo_terminal();
+      Pseudo_terminal(const Pseudo_terminal &) = delete;
+      Pseudo_terminal &operator=(const Pseudo_terminal &) = delete;
+
+      [[nodiscard]] bool is_open() const { return master_ >= 0; }
+
+      /// \return The path of the slave side.
+      [[nodiscard]] const char *port() const { return port_.c_str(); }
+
+      /// Writes all of `data`, waiting while the terminal is full.
+      ///
+      /// \return Whether it has been written.
+      bool write(const char *data, std::size_t length);
+
+      /// Closes the master side, which hangs up the slave side.
+      void close();
+
+    private:
+      int master_;
+      std::string port_{};
+  };
+
+} // namespace dou::host
+
+#endif // INGESTION_HPP_
@@ -0,0 +1,200 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "capture_log.hpp"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string_view>
+#include <vector>
+
+namespace dou::host {
+
+  namespace {
+
+    /// Appends the readings in the text files `paths` to the log at
+    /// `log_path`, taking the readings of the n-th file as those of device
+    /// n, and merging the devices in the order of time after the latest
+    /// record that is in the log already.
+    int convert_(const char *const log_path, const char *const *const paths,
+                 const int count) {
+      auto writer = Log_writer{};
+      if (not writer.open(log_path)) {
+        std::fprintf(stderr, "%s: %s\n", log_path, std::strerror(errno));
+        return EXIT_FAILURE;
+      }
+      const auto devices = static_cast<std::size_t>(count);
+      auto files = std::vector<std::FILE *>(devices, nullptr);
+      const auto close_files = [&files] {
+        for (auto *const file : files) {
+          if (file != nullptr) {
+            std::fclose(file);
+          }
+        }
+      };
+      for (auto device = std::size_t{0}; device < devices; ++device) {
+        files[device] = std::fopen(paths[device], "rb");
+        if (files[device] == nullptr) {
+          std::fprintf(stderr, "%s: %s\n", paths[device],
+                       std::strerror(errno));
+          close_files();
+          return EXIT_FAILURE;
+        }
+      }
+
+      // Each file is read on as long as the records of the others wait for
+      // it, which bounds the records kept to those of about one chunk each.
+      auto merger = Text_log_merger{writer, devices};
+      auto chunk = std::array<char, 65536>{};
+      auto ended = std::size_t{0};
+      auto failed = static_cast<const char *>(nullptr);
+      while ((ended < devices) and (failed == nullptr)) {
+        for (auto device = std::size_t{0};
+             (device < devices) and (failed == nullptr); ++device) {
+          if (not merger.is_waiting(device)) {
+            continue;
+          }
+          const auto length = std::fread(chunk.data(), 1, chunk.size(),
+                                         files[device]);
+          auto appended = true;
+          if (length > 0) {
+            appended = merger.feed(device, chunk.data(),
+                                   static_cast<Size>(length));
+          } else if (std::ferror(files[device]) == 0) {
+            appended = merger.end(device);
+            ++ended;
+          }
+          if ((std::ferror(files[device]) != 0) or not appended) {
+            failed = paths[device];
+          }
+        }
+      }
+      close_files();
+      if (failed != nullptr) {
+        std::fprintf(stderr, "%s: conversion failed\n", failed);
+        return EXIT_FAILURE;
+      }
+      for (auto device = std::size_t{0}; device < devices; ++device) {
+        std::fprintf(stderr, "%s: %llu readings, %llu lines dropped\n",
+                     paths[device],
+                     static_cast<unsigned long long>(
+                         merger.receiver(device).samples()),
+                     static_cast<unsigned long long>(
+                         merger.receiver(device).errors()));
+      }
+      if (not writer.close()) {
+        std::fprintf(stderr, "%s: %s\n", log_path, std::strerror(errno));
+        return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+    }
+
+    /// Prints the records from `from_ns` up to `to_ns` as
+    /// `time_ns,device,reading,overflow,value`, e.g.,
+    /// `1000,0,123.456MHz,0,123456000000`.
+    int dump_(const Log_reader &reader, const int64_t from_ns,
+              const int64_t to_ns) {
+      reader.for_each(from_ns, to_ns, [](const Log_record &record) {
+        const auto text = record.is_scaled()
+                              ? reading_text(record.scaled())
+                              : reading_text(record.reading());
+        std::printf("%lld,%u,%s,%d,%llu\n",
+                    static_cast<long long>(record.time_ns), record.device,
+                    text.c_str() + 1, record.scaled().overflow ? 1 : 0,
+                    static_cast<unsigned long long>(record.value));
+      });
+      return EXIT_SUCCESS;
+    }
+
+    /// Scans all records and prints the number of readings and the range of
+    /// time of each device.
+    int stats_(const Log_reader &reader) {
+      struct Device_ {
+          uint64_t readings{0};
+          uint64_t overflows{0};
+          int64_t first_ns{std::numeric_limits<int64_t>::max()};
+          int64_t last_ns{std::numeric_limits<int64_t>::min()};
+      };
+
+      const auto start = std::chrono::steady_clock::now();
+      auto devices = std::map<uint16_t, Device_>{};
+      auto *current = &devices[reader.size() != 0 ? reader[0].device : 0];
+      auto current_id = reader.size() != 0 ? reader[0].device : uint16_t{0};
+      for (const auto &record : reader) {
+        if (record.device != current_id) {
+          current = &devices[record.device];
+          current_id = record.device;
+        }
+        ++current->readings;
+        current->overflows += record.flags & 0x01U;
+        current->first_ns = std::min(current->first_ns, record.time_ns);
+        current->last_ns = std::max(current->last_ns, record.time_ns);
+      }
+      const auto elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+      for (const auto &[id, device] : devices) {
+        if (device.readings != 0) {
+          std::printf("device %u: %llu readings (%llu overflowed) from %lld "
+                      "to %lld ns\n",
+                      id, static_cast<unsigned long long>(device.readings),
+                      static_cast<unsigned long long>(device.overflows),
+                      static_cast<long long>(device.first_ns),
+                      static_cast<long long>(device.last_ns));
+        }
+      }
+      std::fprintf(stderr, "scanned %zu records in %.3f s\n", reader.size(),
+                   elapsed);
+      return EXIT_SUCCESS;
+    }
+
+    int usage_() {
+      std::fprintf(stderr,
+                   "usage: dou_log convert LOG TEXT...\n"
+                   "       dou_log dump LOG [FROM_NS [TO_NS]]\n"
+                   "       dou_log stats LOG\n"
+                   "  LOG     capture log, which convert appends to\n"
+                   "  TEXT    output of a DOU, each file for the next "
+                   "device\n");
+      return EXIT_FAILURE;
+    }
+
+  } // namespace
+
+} // namespace dou::host
+
+int main(const int argc, const char *const argv[]) {
+  using namespace dou::host;
+
+  if (argc < 3) {
+    return usage_();
+  }
+  const auto command = std::string_view{argv[1]};
+  if (command == "convert") {
+    return argc < 4 ? usage_() : convert_(argv[2], &argv[3], argc - 3);
+  }
+  if (((command != "dump") or (argc > 5))
+      and ((command != "stats") or (argc != 3))) {
+    return usage_();
+  }
+
+  auto reader = Log_reader{};
+  if (not reader.open(argv[2])) {
+    std::fprintf(stderr, "%s: %s\n", argv[2], std::strerror(errno));
+    return EXIT_FAILURE;
+  }
+  if (command == "stats") {
+    return stats_(reader);
+  }
+  return dump_(reader,
+               argc > 3 ? std::atoll(argv[3])
+                        : std::numeric_limits<int64_t>::min(),
+               argc > 4 ? std::atoll(argv[4])
+                        : std::numeric_limits<int64_t>::max());
+}
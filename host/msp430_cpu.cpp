@@ -0,0 +1,526 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "msp430_cpu.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace dou::host {
+
+  namespace {
+
+    constexpr auto cg1_ = 2;
+    constexpr auto cg2_ = 3;
+    constexpr auto scg0_ = uint16_t{0x0040};
+    constexpr auto vectors_address_ = uint16_t{0xffc0};
+    constexpr auto reset_vector_ = 31;
+    constexpr auto interrupt_cycles_ = 6U;
+    constexpr auto peripherals_end_ = uint16_t{0x0200};
+
+    // Cycles of the double-operand instructions, indexed by the mode of the
+    // source and by whether the destination is a register, the PC or in
+    // memory (SLAU144 table 3-16).
+    constexpr auto double_operand_cycles_ =
+        std::array<std::array<uint32_t, 3>, 5>{{{1, 2, 4},
+                                                {2, 2, 5},
+                                                {2, 3, 5},
+                                                {2, 3, 5},
+                                                {3, 3, 6}}};
+
+    // Cycles of RRA, RRC, SWPB and SXT, of PUSH and of CALL, indexed by the
+    // mode of the operand (SLAU144 table 3-15).
+    constexpr auto single_operand_cycles_ =
+        std::array<std::array<uint32_t, 3>, 5>{{{1, 3, 4},
+                                                {3, 4, 4},
+                                                {3, 5, 5},
+                                                {3, 4, 5},
+                                                {4, 5, 5}}};
+
+    enum class Double_ : unsigned {
+      Mov = 4,
+      Add,
+      Addc,
+      Subc,
+      Sub,
+      Cmp,
+      Dadd,
+      Bit,
+      Bic,
+      Bis,
+      Xor,
+      And
+    };
+
+    enum class Single_ : unsigned { Rrc, Swpb, Rra, Sxt, Push, Call, Reti };
+
+    uint16_t mask_(const bool byte) { return byte ? 0x00ff : 0xffff; }
+
+    uint16_t sign_(const bool byte) { return byte ? 0x0080 : 0x8000; }
+
+    /// \return The binary-coded decimal sum of `lhs`, `rhs` and `carry`,
+    /// and sets `carry` if it exceeds the digits.
+    uint16_t add_decimal_(const uint16_t lhs, const uint16_t rhs, bool &carry,
+                          const int digits) {
+      auto result = 0U;
+      auto digit_carry = carry ? 1U : 0U;
+      for (auto digit = 0; digit < digits; ++digit) {
+        const auto shift = static_cast<unsigned>(4 * digit);
+        auto sum = ((lhs >> shift) & 0xfU) + ((rhs >> shift) & 0xfU)
+                   + digit_carry;
+        digit_carry = sum > 9U ? 1U : 0U;
+        if (digit_carry != 0U) {
+          sum -= 10U;
+        }
+        result |= (sum & 0xfU) << shift;
+      }
+      carry = digit_carry != 0U;
+      return static_cast<uint16_t>(result);
+    }
+
+    uint16_t le16_(const std::vector<uint8_t> &data, const std::size_t at) {
+      return static_cast<uint16_t>(data[at] | (data[at + 1] << 8U));
+    }
+
+    uint32_t le32_(const std::vector<uint8_t> &data, const std::size_t at) {
+      return uint32_t{le16_(data, at)}
+             | (uint32_t{le16_(data, at + 2)} << 16U);
+    }
+
+  } // namespace
+
+  Msp430_cpu::Msp430_cpu(Peripherals &peripherals, Access_observer on_read)
+      : peripherals_{peripherals}, on_read_{std::move(on_read)} {}
+
+  void Msp430_cpu::reset() {
+    peripherals_.reset();
+    registers_.fill(0);
+    interrupt_depth_ = 0;
+    set_reg(pc, read(vectors_address_ + (2 * reset_vector_), false));
+  }
+
+  uint16_t Msp430_cpu::read(const uint16_t address, const bool byte) {
+    const auto aligned = byte ? address : static_cast<uint16_t>(address & ~1U);
+    const auto value = peripherals_.read(aligned, byte ? 1 : 2);
+    if ((aligned < peripherals_end_) and on_read_) {
+      on_read_(aligned, value);
+    }
+    return value;
+  }
+
+  void Msp430_cpu::write(const uint16_t address, const bool byte,
+                         const uint16_t value) {
+    const auto aligned = byte ? address : static_cast<uint16_t>(address & ~1U);
+    peripherals_.write(aligned, byte ? 1 : 2,
+                       static_cast<uint16_t>(value & mask_(byte)));
+  }
+
+  uint16_t Msp430_cpu::fetch() {
+    const auto word = read(reg(pc), false);
+    set_reg(pc, static_cast<uint16_t>(reg(pc) + 2U));
+    return word;
+  }
+
+  void Msp430_cpu::push(const uint16_t value) {
+    set_reg(sp, static_cast<uint16_t>(reg(sp) - 2U));
+    write(reg(sp), false, value);
+  }
+
+  uint16_t Msp430_cpu::pop() {
+    const auto value = read(reg(sp), false);
+    set_reg(sp, static_cast<uint16_t>(reg(sp) + 2U));
+    return value;
+  }
+
+  Msp430_cpu::Operand_ Msp430_cpu::source(const int reg, const unsigned as,
+                                          const bool byte) {
+    // constant generators, which count as register mode
+    if (reg == cg2_) {
+      constexpr auto constants = std::array<uint16_t, 4>{0, 1, 2, 0xffff};
+      return {Mode_::Register, -1, 0,
+              static_cast<uint16_t>(constants[as] & mask_(byte))};
+    }
+    if ((reg == cg1_) and (as >= 2U)) {
+      return {Mode_::Register, -1, 0, as == 2U ? uint16_t{4} : uint16_t{8}};
+    }
+
+    switch (as) {
+    case 0U:
+      return {Mode_::Register, reg, 0,
+              static_cast<uint16_t>(this->reg(reg) & mask_(byte))};
+    case 1U: {
+      // The base of symbolic mode is the address of the index, and absolute
+      // mode uses SR as a base of zero.
+      const auto base = reg == pc    ? this->reg(pc)
+                        : reg == cg1_ ? uint16_t{0}
+                                      : this->reg(reg);
+      const auto address = static_cast<uint16_t>(base + fetch());
+      return {Mode_::Indexed, -1, address, read(address, byte)};
+    }
+    case 2U: {
+      const auto address = this->reg(reg);
+      return {Mode_::Indirect, -1, address, read(address, byte)};
+    }
+    default:
+      if (reg == pc) {
+        const auto value = fetch();
+        return {Mode_::Immediate, -1, 0,
+                static_cast<uint16_t>(value & mask_(byte))};
+      }
+      const auto address = this->reg(reg);
+      set_reg(reg, static_cast<uint16_t>(
+                       address + ((byte and (reg != sp)) ? 1U : 2U)));
+      return {Mode_::Autoincrement, -1, address, read(address, byte)};
+    }
+  }
+
+  Msp430_cpu::Operand_ Msp430_cpu::destination(const int reg,
+                                               const unsigned ad,
+                                               const bool byte) {
+    if (ad == 0U) {
+      return {Mode_::Register, reg, 0,
+              static_cast<uint16_t>(this->reg(reg) & mask_(byte))};
+    }
+    const auto base = reg == pc    ? this->reg(pc)
+                      : reg == cg1_ ? uint16_t{0}
+                                    : this->reg(reg);
+    const auto address = static_cast<uint16_t>(base + fetch());
+    return {Mode_::Indexed, -1, address, read(address, byte)};
+  }
+
+  void Msp430_cpu::store(const Operand_ &operand, const bool byte,
+                         const uint16_t value) {
+    if (operand.mode != Mode_::Register) {
+      write(operand.address, byte, value);
+    } else if (operand.reg == pc) {
+      set_reg(pc, static_cast<uint16_t>(value & ~1U));
+    } else if (operand.reg != cg2_) {
+      // byte operations clear the upper byte of registers
+      set_reg(operand.reg, static_cast<uint16_t>(value & mask_(byte)));
+    }
+  }
+
+  void Msp430_cpu::set_flags(const uint16_t result, const bool byte,
+                             const bool carry_flag, const bool overflow_flag) {
+    auto status = static_cast<uint16_t>(reg(sr)
+                                        & ~(carry | zero | negative
+                                            | overflow));
+    if (carry_flag) {
+      status |= carry;
+    }
+    if ((result & mask_(byte)) == 0) {
+      status |= zero;
+    }
+    if ((result & sign_(byte)) != 0) {
+      status |= negative;
+    }
+    if (overflow_flag) {
+      status |= overflow;
+    }
+    set_reg(sr, status);
+  }
+
+  uint32_t Msp430_cpu::execute_double(const uint16_t instruction) {
+    const auto opcode = static_cast<Double_>(instruction >> 12U);
+    const auto source_reg = static_cast<int>((instruction >> 8U) & 0xfU);
+    const auto ad = (instruction >> 7U) & 1U;
+    const auto byte = ((instruction >> 6U) & 1U) != 0;
+    const auto as = (instruction >> 4U) & 3U;
+    const auto destination_reg = static_cast<int>(instruction & 0xfU);
+
+    const auto src = source(source_reg, as, byte);
+    const auto dst = destination(destination_reg, ad, byte);
+    const auto column = ad != 0U ? 2 : destination_reg == pc ? 1 : 0;
+    const auto cycles = double_operand_cycles_[static_cast<std::size_t>(
+        src.mode)][static_cast<std::size_t>(column)];
+
+    const auto mask = uint32_t{mask_(byte)};
+    const auto sign = uint32_t{sign_(byte)};
+    const auto s = uint32_t{src.value};
+    const auto d = uint32_t{dst.value};
+    const auto c = (reg(sr) & carry) != 0 ? 1U : 0U;
+
+    const auto add = [&](const uint32_t rhs, const uint32_t carry_in,
+                         const bool keep) {
+      const auto sum = d + rhs + carry_in;
+      const auto result = static_cast<uint16_t>(sum & mask);
+      set_flags(result, byte, sum > mask,
+                (((d ^ result) & (rhs ^ result) & sign) != 0));
+      if (keep) {
+        store(dst, byte, result);
+      }
+    };
+
+    switch (opcode) {
+    case Double_::Mov:
+      store(dst, byte, src.value);
+      break;
+    case Double_::Add:
+      add(s, 0U, true);
+      break;
+    case Double_::Addc:
+      add(s, c, true);
+      break;
+    case Double_::Subc:
+      add(~s & mask, c, true);
+      break;
+    case Double_::Sub:
+      add(~s & mask, 1U, true);
+      break;
+    case Double_::Cmp:
+      add(~s & mask, 1U, false);
+      break;
+    case Double_::Dadd: {
+      auto decimal_carry = c != 0U;
+      const auto result = add_decimal_(dst.value, src.value, decimal_carry,
+                                       byte ? 2 : 4);
+      set_flags(result, byte, decimal_carry, false);
+      store(dst, byte, result);
+      break;
+    }
+    case Double_::Bit: {
+      const auto result = static_cast<uint16_t>(s & d);
+      set_flags(result, byte, result != 0, false);
+      break;
+    }
+    case Double_::Bic:
+      store(dst, byte, static_cast<uint16_t>(~s & d));
+      break;
+    case Double_::Bis:
+      store(dst, byte, static_cast<uint16_t>(s | d));
+      break;
+    case Double_::Xor: {
+      const auto result = static_cast<uint16_t>(s ^ d);
+      set_flags(result, byte, (result & mask) != 0,
+                ((s & d & sign) != 0));
+      store(dst, byte, result);
+      break;
+    }
+    case Double_::And: {
+      const auto result = static_cast<uint16_t>(s & d);
+      set_flags(result, byte, (result & mask) != 0, false);
+      store(dst, byte, result);
+      break;
+    }
+    }
+    return cycles;
+  }
+
+  uint32_t Msp430_cpu::execute_single(const uint16_t instruction) {
+    const auto opcode = static_cast<Single_>((instruction >> 7U) & 7U);
+    const auto byte = ((instruction >> 6U) & 1U) != 0;
+    const auto as = (instruction >> 4U) & 3U;
+    const auto operand_reg = static_cast<int>(instruction & 0xfU);
+
+    if (opcode == Single_::Reti) {
+      set_reg(sr, pop());
+      set_reg(pc, pop());
+      --interrupt_depth_;
+      return 5;
+    }
+
+    const auto operand = source(operand_reg, as, byte);
+    const auto column = opcode == Single_::Push   ? 1
+                        : opcode == Single_::Call ? 2
+                                                  : 0;
+    const auto cycles = single_operand_cycles_[static_cast<std::size_t>(
+        operand.mode)][static_cast<std::size_t>(column)];
+
+    const auto mask = mask_(byte);
+    const auto sign = sign_(byte);
+    const auto value = operand.value;
+    const auto c = (reg(sr) & carry) != 0;
+
+    // Results are written back to where the operand has been read, also in
+    // autoincrement mode.
+    auto target = operand;
+    if ((operand.mode == Mode_::Indirect)
+        or (operand.mode == Mode_::Autoincrement)) {
+      target.mode = Mode_::Indexed;
+    }
+
+    switch (opcode) {
+    case Single_::Rrc: {
+      const auto result = static_cast<uint16_t>(((value & mask) >> 1U)
+                                                | (c ? sign : 0U));
+      set_flags(result, byte, (value & 1U) != 0, false);
+      store(target, byte, result);
+      break;
+    }
+    case Single_::Rra: {
+      const auto result = static_cast<uint16_t>(((value & mask) >> 1U)
+                                                | (value & sign));
+      set_flags(result, byte, (value & 1U) != 0, false);
+      store(target, byte, result);
+      break;
+    }
+    case Single_::Swpb:
+      store(target, false,
+            static_cast<uint16_t>((value >> 8U) | (value << 8U)));
+      break;
+    case Single_::Sxt: {
+      const auto result = static_cast<uint16_t>(
+          (value & 0x80U) != 0 ? (value | 0xff00U) : (value & 0x00ffU));
+      set_flags(result, false, result != 0, false);
+      store(target, false, result);
+      break;
+    }
+    case Single_::Push:
+      push(value);
+      break;
+    case Single_::Call:
+      push(reg(pc));
+      set_reg(pc, static_cast<uint16_t>(value & ~1U));
+      break;
+    case Single_::Reti:
+      break;
+    }
+    return cycles;
+  }
+
+  uint32_t Msp430_cpu::execute_jump(const uint16_t instruction) {
+    const auto condition = (instruction >> 10U) & 7U;
+    const auto status = reg(sr);
+    const auto n = (status & negative) != 0;
+    const auto v = (status & overflow) != 0;
+    const auto taken = std::array<bool, 8>{
+        (status & zero) == 0, (status & zero) != 0, (status & carry) == 0,
+        (status & carry) != 0, n, n == v, n != v, true}[condition];
+    if (taken) {
+      // signed 10-bit offset in words
+      const auto offset = static_cast<int16_t>(
+          static_cast<uint16_t>(instruction << 6U)) >> 6;
+      set_reg(pc, static_cast<uint16_t>(reg(pc) + (2 * offset)));
+    }
+    return 2;
+  }
+
+  uint32_t Msp430_cpu::accept_interrupt(const int vector) {
+    push(reg(pc));
+    push(reg(sr));
+    set_reg(sr, reg(sr) & scg0_);
+    set_reg(pc, read(static_cast<uint16_t>(vectors_address_ + (2 * vector)),
+                     false));
+    ++interrupt_depth_;
+    last_vector_ = vector;
+    return interrupt_cycles_;
+  }
+
+  uint32_t Msp430_cpu::step(const uint32_t max_sleep_cycles) {
+    if (peripherals_.reset_requested()) {
+      reset();
+    }
+
+    auto cycles = uint32_t{0};
+    const auto vector = (reg(sr) & gie) != 0 ? peripherals_.accept_interrupt()
+                                             : 0;
+    if (vector != 0) {
+      cycles = accept_interrupt(vector);
+    } else if (is_sleeping()) {
+      cycles = static_cast<uint32_t>(std::min<uint64_t>(
+          peripherals_.cycles_to_next_event(), max_sleep_cycles));
+    } else {
+      const auto instruction = fetch();
+      if (instruction >= 0x4000U) {
+        cycles = execute_double(instruction);
+      } else if (instruction >= 0x2000U) {
+        cycles = execute_jump(instruction);
+      } else if ((instruction >> 10U) == 4U) {
+        cycles = execute_single(instruction);
+      } else {
+        // not an instruction of the MSP430, which resets the MSP430X
+        reset();
+        return 0;
+      }
+    }
+    peripherals_.advance(cycles);
+    return cycles;
+  }
+
+  bool read_elf(std::FILE *const file, Elf_image &image) {
+    constexpr auto elf_header_size = std::size_t{52};
+    constexpr auto em_msp430 = 105U;
+    constexpr auto pt_load = 1U;
+    constexpr auto sht_symtab = 2U;
+    constexpr auto stt_func = 2U;
+
+    auto data = std::vector<uint8_t>{};
+    auto chunk = std::array<uint8_t, 4096>{};
+    auto count = std::size_t{0};
+    while ((count = std::fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+      data.insert(data.end(), chunk.begin(),
+                  chunk.begin() + static_cast<Size>(count));
+    }
+    if ((std::ferror(file) != 0) or (data.size() < elf_header_size)
+        or not std::equal(data.begin(), data.begin() + 4, "\x7f" "ELF")
+        or (data[4] != 1) or (data[5] != 1)
+        or (le16_(data, 18) != em_msp430)) {
+      return false;
+    }
+
+    const auto fits = [&data](const std::size_t offset,
+                              const std::size_t size) {
+      return (offset <= data.size()) and (size <= data.size() - offset);
+    };
+
+    const auto program_headers = std::size_t{le32_(data, 28)};
+    const auto program_header_size = std::size_t{le16_(data, 42)};
+    for (auto i = std::size_t{0}; i < le16_(data, 44); ++i) {
+      const auto header = program_headers + (i * program_header_size);
+      if (not fits(header, 32)) {
+        return false;
+      }
+      const auto offset = std::size_t{le32_(data, header + 4)};
+      const auto file_size = std::size_t{le32_(data, header + 16)};
+      if ((le32_(data, header) != pt_load) or (file_size == 0)) {
+        continue;
+      }
+      if (not fits(offset, file_size)) {
+        return false;
+      }
+      image.segments.push_back(
+          {static_cast<uint16_t>(le32_(data, header + 12)),
+           {data.begin() + static_cast<Size>(offset),
+            data.begin() + static_cast<Size>(offset + file_size)}});
+    }
+
+    const auto section_headers = std::size_t{le32_(data, 32)};
+    const auto section_header_size = std::size_t{le16_(data, 46)};
+    const auto sections = std::size_t{le16_(data, 48)};
+    const auto section = [&](const std::size_t index) {
+      return section_headers + (index * section_header_size);
+    };
+    for (auto i = std::size_t{0}; i < sections; ++i) {
+      if (not fits(section(i), 40)
+          or (le32_(data, section(i) + 4) != sht_symtab)) {
+        continue;
+      }
+      const auto strings = std::size_t{le32_(data, section(i) + 24)};
+      if ((strings >= sections) or not fits(section(strings), 40)) {
+        return false;
+      }
+      const auto names = std::size_t{le32_(data, section(strings) + 16)};
+      const auto names_size = std::size_t{le32_(data, section(strings) + 20)};
+      const auto offset = std::size_t{le32_(data, section(i) + 16)};
+      const auto size = std::size_t{le32_(data, section(i) + 20)};
+      if (not fits(offset, size) or not fits(names, names_size)) {
+        return false;
+      }
+      for (auto symbol = offset; symbol + 16 <= offset + size; symbol += 16) {
+        const auto name = std::size_t{le32_(data, symbol)};
+        if ((name == 0) or (name >= names_size)) {
+          continue;
+        }
+        const auto text = data.begin() + static_cast<Size>(names + name);
+        const auto text_end = std::find(
+            text, data.begin() + static_cast<Size>(names + names_size), 0);
+        image.symbols.push_back(
+            {std::string{text, text_end},
+             static_cast<uint16_t>(le32_(data, symbol + 4)),
+             static_cast<uint16_t>(le32_(data, symbol + 8)),
+             (data[symbol + 12] & 0xfU) == stt_func});
+      }
+    }
+    return true;
+  }
+
+} // namespace dou::host
@@ -0,0 +1,133 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef MSP430_CPU_HPP_
+#define MSP430_CPU_HPP_
+
+#include "emulator.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dou::host {
+
+  /// Called with the address and value of each access of the CPU to the
+  /// peripheral registers below 0x200.
+  using Access_observer = std::function<void(uint16_t address, uint16_t value)>;
+
+  /// Executes the machine code of the MSP430 CPU (not the MSP430X), taking
+  /// the number of cycles that the family user's guide (SLAU144) specifies
+  /// for each instruction and for accepting interrupts. The memory,
+  /// including the registers, and the interrupt sources are those of
+  /// `Peripherals`, which advance by the cycles of each instruction.
+  class Msp430_cpu {
+    public:
+      static constexpr auto pc = 0;
+      static constexpr auto sp = 1;
+      static constexpr auto sr = 2;
+
+      static constexpr auto carry = uint16_t{0x0001};
+      static constexpr auto zero = uint16_t{0x0002};
+      static constexpr auto negative = uint16_t{0x0004};
+      static constexpr auto gie = uint16_t{0x0008};
+      static constexpr auto cpuoff = uint16_t{0x0010};
+      static constexpr auto overflow = uint16_t{0x0100};
+
+      explicit Msp430_cpu(Peripherals &peripherals,
+                          Access_observer on_read = {});
+
+      /// Power-up clear: resets the peripherals and the registers, and
+      /// continues at the reset vector.
+      void reset();
+
+      /// Accepts a pending interrupt, executes one instruction or, while the
+      /// CPU is off, waits for the next event of the peripherals, which
+      /// takes at most `max_sleep_cycles`.
+      ///
+      /// \return The number of cycles that have passed.
+      uint32_t step(uint32_t max_sleep_cycles = 0x10000);
+
+      [[nodiscard]] uint16_t reg(const int n) const {
+        return registers_[static_cast<std::size_t>(n)];
+      }
+
+      void set_reg(const int n, const uint16_t value) {
+        registers_[static_cast<std::size_t>(n)] = value;
+      }
+
+      [[nodiscard]] bool is_sleeping() const {
+        return (reg(sr) & cpuoff) != 0;
+      }
+
+      /// \return The number of interrupts that are being serviced.
+      [[nodiscard]] int interrupt_depth() const { return interrupt_depth_; }
+
+      /// \return The vector of the interrupt accepted last.
+      [[nodiscard]] int last_vector() const { return last_vector_; }
+
+    private:
+      enum class Mode_ { Register, Indirect, Autoincrement, Immediate,
+                         Indexed };
+
+      struct Operand_ {
+          Mode_ mode;
+          /// The register in register mode, otherwise -1.
+          int reg;
+          uint16_t address;
+          uint16_t value;
+      };
+
+      [[nodiscard]] uint16_t read(uint16_t address, bool byte);
+      void write(uint16_t address, bool byte, uint16_t value);
+      uint16_t fetch();
+      void push(uint16_t value);
+      uint16_t pop();
+
+      Operand_ source(int reg, unsigned as, bool byte);
+      Operand_ destination(int reg, unsigned ad, bool byte);
+      void store(const Operand_ &operand, bool byte, uint16_t value);
+      void set_flags(uint16_t result, bool byte, bool carry_flag,
+                     bool overflow_flag);
+
+      uint32_t execute_double(uint16_t instruction);
+      uint32_t execute_single(uint16_t instruction);
+      uint32_t execute_jump(uint16_t instruction);
+      uint32_t accept_interrupt(int vector);
+
+      Peripherals &peripherals_;
+      Access_observer on_read_;
+      std::array<uint16_t, 16> registers_{};
+      int interrupt_depth_{0};
+      int last_vector_{0};
+  };
+
+  struct Elf_symbol {
+      std::string name;
+      uint16_t address;
+      uint16_t size;
+      bool is_function;
+  };
+
+  /// The loadable contents and the symbols of an executable for the MSP430.
+  struct Elf_image {
+      struct Segment {
+          /// The load address, which differs from the run-time address for
+          /// initialized data.
+          uint16_t address;
+          std::vector<uint8_t> bytes;
+      };
+
+      std::vector<Segment> segments;
+      std::vector<Elf_symbol> symbols;
+  };
+
+  /// \return Whether `file` is a little-endian ELF32 executable for the
+  /// MSP430, whose segments and symbols have been stored in `image`.
+  bool read_elf(std::FILE *file, Elf_image &image);
+
+} // namespace dou::host
+
+#endif // MSP430_CPU_HPP_
@@ -0,0 +1,188 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "receiver.hpp"
+
+#include <string_view>
+
+namespace dou::host {
+
+  namespace {
+
+    constexpr auto units_ = Array<Unit, 5>{
+        {Unit::ms, Unit::us, Unit::MHz, Unit::kHz, Unit::None}};
+
+    bool parse_unit(const std::string_view text, Unit &unit) {
+      for (const auto candidate : units_) {
+        if (text == unit_text(candidate)) {
+          unit = candidate;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /// \return The suffix of scaled readings in `unit`, without the line
+    /// ending.
+    std::string_view scaled_suffix(const Unit unit) {
+      const auto &suffix = scaled_suffixes[to_integral(unit)];
+      return {suffix.text.data(), static_cast<std::size_t>(suffix.length - 2)};
+    }
+
+    /// Takes the first unit of the quantity of the suffix `text`, as both
+    /// units of a quantity share their suffix.
+    bool parse_scaled_unit(const std::string_view text, Unit &unit) {
+      for (const auto candidate : units_) {
+        if (text == scaled_suffix(candidate)) {
+          unit = candidate;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /// \return `sample` with the value `scaled`, which has been received in
+    /// a scaled format.
+    Sample make_scaled_sample(const Scaled_reading &scaled,
+                              const Timestamp &timestamp) {
+      auto reading = Reading{};
+      reading.overflow = scaled.overflow;
+      return {reading, scaled, true, static_cast<int64_t>(scaled.value),
+              static_cast<int8_t>(scaled_exponent(scaled.unit)
+                                  - unit_exponent(scaled.unit)),
+              timestamp};
+    }
+
+    bool parse_timestamp(const std::string_view text, Timestamp &timestamp) {
+      if ((text.size() != timestamp_text_length) or (text[0] != ' ')
+          or ((text[1] != '@') and (text[1] != '+'))) {
+        return false;
+      }
+      auto ticks = uint32_t{0};
+      for (const auto character : text.substr(2)) {
+        auto nibble = 0;
+        if ((character >= '0') and (character <= '9')) {
+          nibble = character - '0';
+        } else if ((character >= 'a') and (character <= 'f')) {
+          nibble = character - 'a' + 10;
+        } else {
+          return false;
+        }
+        ticks = (ticks << 4U) | static_cast<uint32_t>(nibble);
+      }
+      timestamp = {ticks, text[1] == '+' ? Timestamp_mode::Delta
+                                         : Timestamp_mode::Absolute};
+      return true;
+    }
+
+  } // namespace
+
+  bool parse_line(const char *const line, const Size length, Sample &sample) {
+    if ((length < (1 + number_of_digits + 1)) or (line[length - 1] != '\r')
+        or ((line[0] != ' ') and (line[0] != '>'))) {
+      return false;
+    }
+
+    // Scaled readings are told apart by the number of digits only.
+    auto digits = Size{0};
+    while ((1 + digits < length) and (line[1 + digits] >= '0')
+           and (line[1 + digits] <= '9')) {
+      ++digits;
+    }
+    if (digits == scaled_digits) {
+      auto scaled = Scaled_reading{0, Unit::None, line[0] == '>'};
+      for (auto i = Size{1}; i <= digits; ++i) {
+        scaled.value = (scaled.value * 10)
+                       + static_cast<uint64_t>(line[i] - '0');
+      }
+      const auto rest = std::string_view{
+          line + 1 + digits, static_cast<std::size_t>(length - 2 - digits)};
+      auto timestamp = Timestamp{0, Timestamp_mode::None};
+      const auto separator = rest.find(' ');
+      if (((separator != std::string_view::npos)
+           and not parse_timestamp(rest.substr(separator), timestamp))
+          or not parse_scaled_unit(rest.substr(0, separator), scaled.unit)) {
+        return false;
+      }
+      sample = make_scaled_sample(scaled, timestamp);
+      return true;
+    }
+
+    auto reading = Reading{};
+    reading.overflow = line[0] == '>';
+
+    auto mantissa = int64_t{0};
+    auto index = Size{1};
+    for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+      if (line[index] == '.') {
+        if (reading.decimal_point_digit != 0) {
+          return false;
+        }
+        reading.decimal_point_digit = static_cast<i8>(strobe);
+        ++index;
+      }
+      const auto digit = line[index] - '0';
+      if ((digit < 0) or (digit > 9)) {
+        return false;
+      }
+      reading.set_digit(static_cast<i8>(strobe), static_cast<i8>(digit));
+      mantissa = (mantissa * 10) + digit;
+      ++index;
+    }
+
+    const auto rest = std::string_view{
+        line + index, static_cast<std::size_t>(length - 1 - index)};
+    auto timestamp = Timestamp{0, Timestamp_mode::None};
+    const auto separator = rest.find(' ');
+    if ((separator != std::string_view::npos)
+        and not parse_timestamp(rest.substr(separator), timestamp)) {
+      return false;
+    }
+
+    auto unit = Unit::None;
+    if (not parse_unit(rest.substr(0, separator), unit)
+        or ((unit == Unit::None) != (reading.decimal_point_digit == 0))) {
+      return false;
+    }
+    reading.nml = (to_integral(unit) & 1) != 0;
+    reading.rng_2 = (to_integral(unit) & 2) != 0;
+
+    sample = {reading,
+              {scaled_value(reading), unit, reading.overflow},
+              false,
+              mantissa,
+              static_cast<int8_t>(-reading.decimal_point_digit),
+              timestamp};
+    return true;
+  }
+
+  bool parse_frame(const Scaled_frame &frame, Sample &sample) {
+    auto scaled = Scaled_reading{};
+    if (not decode(frame, scaled)) {
+      return false;
+    }
+    sample = make_scaled_sample(scaled, {0, Timestamp_mode::None});
+    return true;
+  }
+
+  std::string reading_text(const Reading &reading) {
+    auto text = std::string{reading.overflow ? ">" : " "};
+    for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+      if (strobe == reading.decimal_point_digit) {
+        text += '.';
+      }
+      text += static_cast<char>('0' + reading.digit(static_cast<i8>(strobe)));
+    }
+    return text + unit_text(reading.unit());
+  }
+
+  std::string reading_text(const Scaled_reading &reading) {
+    auto digits = std::to_string(reading.value);
+    if (digits.size() < static_cast<std::size_t>(scaled_digits)) {
+      digits.insert(0, static_cast<std::size_t>(scaled_digits) - digits.size(),
+                    '0');
+    }
+    return (reading.overflow ? ">" : " ") + digits
+           + std::string{scaled_suffix(reading.unit)};
+  }
+
+} // namespace dou::host
@@ -0,0 +1,151 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef RECEIVER_HPP_
+#define RECEIVER_HPP_
+
+#include "dou.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace dou::host {
+
+  /// A reading as received from the DOU.
+  struct Sample {
+      /// As displayed. The scaled output formats do not convey the digits,
+      /// so that only `overflow` is set then, see `is_scaled`.
+      Reading reading;
+      /// The reading in the base unit of its quantity, see `scaled_value()`.
+      /// `Output_format::Scaled_text` only tells the quantity, which is then
+      /// taken in `Unit::ms` or `Unit::MHz`.
+      Scaled_reading scaled;
+      /// Whether the reading has been received in a scaled format.
+      bool is_scaled;
+      /// The value is `mantissa` * 10^`exponent` `scaled.unit`, as displayed
+      /// unless `is_scaled`.
+      int64_t mantissa;
+      int8_t exponent;
+      /// The mode is `Timestamp_mode::None`, if the reading has not been
+      /// timestamped.
+      Timestamp timestamp;
+  };
+
+  /// Parses one line of the textual output formats, e.g., `" 123.456MHz\r"`,
+  /// `" 123.456MHz @0123abcd\r"` or `" 00000123456000mHz\r"`, without the
+  /// line feed.
+  ///
+  /// \return Whether the line holds a valid reading, which is then stored in
+  /// `sample`.
+  bool parse_line(const char *line, Size length, Sample &sample);
+
+  /// \return Whether `frame` holds a valid reading, which is then stored in
+  /// `sample`.
+  bool parse_frame(const Scaled_frame &frame, Sample &sample);
+
+  /// \return The text that the firmware outputs for `reading`, without the
+  /// line ending.
+  std::string reading_text(const Reading &reading);
+
+  /// \return The text that the firmware outputs for `reading` in
+  /// `Output_format::Scaled_text`, without the line ending.
+  std::string reading_text(const Scaled_reading &reading);
+
+  /// Extracts readings from the byte stream received from the DOU.
+  ///
+  /// The stream may be fed in chunks of arbitrary size, which do not need to
+  /// be aligned with lines. Lines that cannot be parsed, including those that
+  /// are longer than any valid reading, are dropped and counted as errors.
+  /// Decoding resumes with the next line. Diagnostic lines, which start with
+  /// `'#'`, are skipped. A `scaled_frame_sync`, which is not ASCII, starts a
+  /// `Scaled_frame`, which is dropped and counted as an error as well if
+  /// another sync interrupts it or it is invalid. The receiver never
+  /// allocates.
+  class Receiver {
+    public:
+      /// Calls `on_sample` with every `Sample` that is completed by `data`.
+      ///
+      /// \return The number of samples that have been completed.
+      template <typename Callback_>
+      Size feed(const char *const data, const Size length,
+                Callback_ &&on_sample) {
+        auto completed = Size{0};
+        for (auto i = Size{0}; i < length; ++i) {
+          const auto character = data[i];
+          const auto byte = static_cast<uint8_t>(character);
+          if ((frame_length_ != 0)
+              and ((byte != scaled_frame_sync)
+                   or (frame_length_ == frame_.size() - 1))) {
+            // the CRC may take any value
+            frame_[frame_length_++] = byte;
+            if (frame_length_ == frame_.size()) {
+              frame_length_ = 0;
+              auto sample = Sample{};
+              if (parse_frame(frame_, sample)) {
+                on_sample(static_cast<const Sample &>(sample));
+                ++completed;
+              } else {
+                ++errors_;
+              }
+            }
+          } else if (byte == scaled_frame_sync) {
+            if ((frame_length_ != 0) or ((length_ != 0) and not discarding_)) {
+              ++errors_;
+            }
+            frame_[0] = byte;
+            frame_length_ = 1;
+            length_ = 0;
+            discarding_ = false;
+          } else if (character == '\n') {
+            auto sample = Sample{};
+            if (not discarding_ and parse_line(line_.data(), length_, sample)) {
+              on_sample(static_cast<const Sample &>(sample));
+              ++completed;
+            } else if (not discarding_) {
+              ++errors_;
+            }
+            length_ = 0;
+            discarding_ = false;
+          } else if (discarding_) {
+            // wait for the end of the line
+          } else if ((length_ == 0) and (character == '#')) {
+            discarding_ = true;
+          } else if (length_ == line_.size()) {
+            ++errors_;
+            discarding_ = true;
+          } else {
+            line_[length_++] = character;
+          }
+        }
+        samples_ += static_cast<uint64_t>(completed);
+        return completed;
+      }
+
+      /// \return The number of samples extracted so far.
+      [[nodiscard]] uint64_t samples() const { return samples_; }
+
+      /// \return The number of lines dropped so far.
+      [[nodiscard]] uint64_t errors() const { return errors_; }
+
+      /// The longest valid line, including the carriage return.
+      static constexpr auto max_line_length =
+          1 // overflow indicator
+          + std::max(number_of_digits + 1, // decimal point
+                     scaled_digits)
+          + max_unit_length - 1 + timestamp_text_length
+          + 1; // carriage return
+
+    private:
+      Array<char, max_line_length> line_{};
+      Size length_{0};
+      bool discarding_{false};
+      Scaled_frame frame_{};
+      /// The number of bytes of `frame_` received, or 0 outside of frames.
+      Size frame_length_{0};
+      uint64_t samples_{0};
+      uint64_t errors_{0};
+  };
+
+} // namespace dou::host
+
+#endif // RECEIVER_HPP_
@@ -0,0 +1,259 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "bus_simulator.hpp"
+#include "emulator.hpp"
+#include "receiver.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dou::host {
+
+  namespace {
+
+    struct Statistics_ {
+        long windows{0};
+        long correct{0};
+        long wrong{0};
+    };
+
+    Statistics_ simulate_(const Bus_timing &timing, const Sampling &sampling,
+                          const long readings) {
+      auto random = std::minstd_rand{1};
+      auto simulator = Bus_simulator{timing, sampling, 2};
+      auto replay = Bus_replay{};
+      auto samples = std::vector<Port_sample>{};
+      auto statistics = Statistics_{};
+
+      for (auto i = 0L; i < readings; ++i) {
+        const auto expected = random_reading(random);
+        samples.clear();
+        simulator.simulate(expected, samples);
+        ++statistics.windows;
+        auto reading = Reading{};
+        for (const auto &sample : samples) {
+          if (replay.feed(sample, reading)) {
+            ++(reading == expected ? statistics.correct : statistics.wrong);
+          }
+        }
+      }
+      return statistics;
+    }
+
+    /// Measures how reliably readings are caught depending on the sampling
+    /// period of the main loop.
+    int sweep_(const long readings, const Sampling &sampling) {
+      const auto timing = Bus_timing{};
+      std::printf("period_ns,windows,correct,wrong,missed\n");
+      for (const auto period_ns : {1'000U, 2'000U, 5'000U, 10'000U, 20'000U,
+                                   50'000U, 100'000U, 150'000U, 200'000U}) {
+        auto this_sampling = sampling;
+        this_sampling.period_ns = period_ns;
+        const auto statistics = simulate_(timing, this_sampling, readings);
+        std::printf("%u,%ld,%ld,%ld,%ld\n", period_ns, statistics.windows,
+                    statistics.correct, statistics.wrong,
+                    statistics.windows - statistics.correct
+                        - statistics.wrong);
+      }
+      return EXIT_SUCCESS;
+    }
+
+    int record_(const char *const path, const long readings,
+                const Sampling &sampling) {
+      auto random = std::minstd_rand{1};
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 2};
+      auto samples = std::vector<Port_sample>{};
+      for (auto i = 0L; i < readings; ++i) {
+        simulator.simulate(random_reading(random), samples);
+      }
+
+      auto *const file = std::fopen(path, "wb");
+      if ((file == nullptr)
+          or not write_trace(file, sampling.period_ns, samples)
+          or (std::fclose(file) != 0)) {
+        std::perror(path);
+        return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+    }
+
+    int replay_(const char *const path) {
+      auto *const file = std::fopen(path, "rb");
+      auto sample_period_ns = uint32_t{0};
+      auto samples = std::vector<Port_sample>{};
+      if ((file == nullptr)
+          or not read_trace(file, sample_period_ns, samples)) {
+        std::fprintf(stderr, "%s: cannot read trace\n", path);
+        return EXIT_FAILURE;
+      }
+      std::fclose(file);
+
+      auto replay = Bus_replay{};
+      auto reading = Reading{};
+      for (const auto &sample : samples) {
+        if (replay.feed(sample, reading)) {
+          std::printf("%s\n", reading_text(reading).c_str());
+        }
+      }
+      return EXIT_SUCCESS;
+    }
+
+    /// Runs the firmware on the emulated device against `readings` windows,
+    /// whose bus is simulated at the resolution of the sampling period, and
+    /// evaluates the serial output.
+    int emulate_(const long readings, const Sampling &sampling,
+                 const Cpu_timing &cpu_timing) {
+      const auto timing = Bus_timing{};
+      auto random = std::minstd_rand{1};
+      auto simulator = Bus_simulator{timing, sampling, 2};
+      auto expected = std::vector<std::string>{};
+      const auto bus_period_cycles = static_cast<uint32_t>(
+          (uint64_t{sampling.period_ns} * Emulator::cpu_frequency_Hz)
+          / 1'000'000'000);
+
+      auto emulator = Emulator{
+          cpu_timing,
+          [&](std::vector<Port_sample> &samples) {
+            if (static_cast<long>(expected.size()) >= readings) {
+              return false;
+            }
+            const auto reading = random_reading(random);
+            expected.push_back(reading_text(reading));
+            simulator.simulate(reading, samples);
+            return true;
+          },
+          std::max(bus_period_cycles, uint32_t{1})};
+
+      const auto window_ns = (uint64_t{timing.strobe_width_ns}
+                              + timing.blanking_ns)
+                                 * number_of_digits * timing.passes
+                             + timing.idle_ns;
+      const auto cycles = ((window_ns * static_cast<uint64_t>(readings))
+                           + 100'000'000)
+                          * Emulator::cpu_frequency_Hz / 1'000'000'000;
+      emulator.run(cycles);
+
+      const auto bit_cycles = static_cast<double>(Emulator::cpu_frequency_Hz)
+                              / serial_baud_rate;
+      auto max_edge_error = 0.0;
+      const auto characters =
+          receive_uart(emulator.peripherals().tx_edges(), bit_cycles,
+                       serial_data_bits, max_edge_error);
+      const auto framing_errors = std::count_if(
+          characters.begin(), characters.end(),
+          [](const Uart_character &character) {
+            return character.framing_error;
+          });
+
+      // Each reading is sent after the end of its window, but possibly only
+      // after later windows, while earlier readings are still transmitted.
+      const auto &window_ends = emulator.peripherals().window_ends();
+      auto correct = 0L;
+      auto wrong = 0L;
+      auto next_window = std::size_t{0};
+      for (const auto &line : split_lines(characters)) {
+        if (line.text.starts_with("#")) {
+          continue;
+        }
+        auto window = next_window;
+        while ((window < window_ends.size())
+               and (window_ends[window] < line.start)
+               and (line.text != expected[window])) {
+          ++window;
+        }
+        if ((window < window_ends.size())
+            and (window_ends[window] < line.start)) {
+          ++correct;
+          next_window = window + 1;
+        } else {
+          ++wrong;
+        }
+      }
+
+      const auto seconds = static_cast<double>(emulator.now())
+                           / Emulator::cpu_frequency_Hz;
+      std::printf("windows,correct,wrong,missed,framing_errors,"
+                  "max_edge_error_percent,readings_per_s,cpu_load_percent,"
+                  "watchdog_resets\n");
+      std::printf("%zu,%ld,%ld,%ld,%ld,%.1f,%.1f,%.1f,%u\n",
+                  window_ends.size(), correct, wrong,
+                  static_cast<long>(window_ends.size()) - correct - wrong,
+                  static_cast<long>(framing_errors),
+                  100.0 * max_edge_error / bit_cycles,
+                  static_cast<double>(correct) / seconds,
+                  100.0
+                      - (100.0 * static_cast<double>(emulator.sleeping_cycles())
+                         / static_cast<double>(emulator.now())),
+                  emulator.watchdog_resets());
+      return EXIT_SUCCESS;
+    }
+
+    int usage_() {
+      std::fprintf(stderr,
+                   "usage: dou_simulator [options] sweep\n"
+                   "       dou_simulator [options] record FILE\n"
+                   "       dou_simulator replay FILE\n"
+                   "       dou_simulator [options] emulate\n"
+                   "options:\n"
+                   "  -n READINGS     number of readings to simulate\n"
+                   "  -p PERIOD_NS    sampling period of the main loop, or\n"
+                   "                  resolution of the bus when emulating\n"
+                   "  -a CYCLES       CPU cycles per register access when\n"
+                   "                  emulating\n"
+                   "  -j JITTER_NS    maximum sampling jitter\n"
+                   "  -b RATE         bit error rate per sampled bit\n"
+                   "  -g RATE         probability of a glitch per blanking\n");
+      return EXIT_FAILURE;
+    }
+
+  } // namespace
+
+} // namespace dou::host
+
+int main(const int argc, const char *const argv[]) {
+  using namespace dou::host;
+
+  auto readings = 10'000L;
+  auto sampling = Sampling{};
+  auto cpu_timing = Cpu_timing{};
+
+  auto i = 1;
+  for (; (i + 1) < argc; i += 2) {
+    const auto option = std::string_view{argv[i]};
+    if (option == "-n") {
+      readings = std::atol(argv[i + 1]);
+    } else if (option == "-p") {
+      sampling.period_ns = static_cast<uint32_t>(std::atol(argv[i + 1]));
+    } else if (option == "-j") {
+      sampling.jitter_ns = static_cast<uint32_t>(std::atol(argv[i + 1]));
+    } else if (option == "-b") {
+      sampling.bit_error_rate = std::atof(argv[i + 1]);
+    } else if (option == "-g") {
+      sampling.glitch_rate = std::atof(argv[i + 1]);
+    } else if (option == "-a") {
+      cpu_timing.cycles_per_access =
+          static_cast<uint32_t>(std::atol(argv[i + 1]));
+    } else {
+      break;
+    }
+  }
+
+  const auto command = std::string_view{i < argc ? argv[i] : ""};
+  if ((command == "sweep") and ((i + 1) == argc)) {
+    return sweep_(readings, sampling);
+  }
+  if ((command == "record") and ((i + 2) == argc)) {
+    return record_(argv[i + 1], readings, sampling);
+  }
+  if ((command == "replay") and ((i + 2) == argc)) {
+    return replay_(argv[i + 1]);
+  }
+  if ((command == "emulate") and ((i + 1) == argc)) {
+    return emulate_(readings, sampling, cpu_timing);
+  }
+  return usage_();
+}
@@ -0,0 +1,1373 @@
+// Data Output Unit Host Library / Darius Kellermann <kellermann@protonmail.com>
+
+#include "bus_simulator.hpp"
+#include "capture_log.hpp"
+#include "emulator.hpp"
+#include "ingestion.hpp"
+#include "msp430_cpu.hpp"
+#include "receiver.hpp"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using str = std::string_view;
+
+namespace dou::host {
+
+  namespace {
+
+    std::vector<Sample> feed_(Receiver &receiver, const std::string_view data,
+                              const std::size_t chunk_size) {
+      auto samples = std::vector<Sample>{};
+      for (auto offset = std::size_t{0}; offset < data.size();
+           offset += chunk_size) {
+        const auto chunk = data.substr(offset, chunk_size);
+        receiver.feed(chunk.data(), static_cast<Size>(chunk.size()),
+                      [&](const Sample &sample) { samples.push_back(sample); });
+      }
+      return samples;
+    }
+
+    Reading make_random_reading_(std::minstd_rand &random) {
+      auto reading = Reading{{},
+                             static_cast<i8>(random() % 5),
+                             (random() % 8) == 0,
+                             (random() % 2) == 0,
+                             (random() % 2) == 0};
+      for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+        reading.set_digit(static_cast<i8>(strobe),
+                          static_cast<i8>(random() % 10));
+      }
+      return reading;
+    }
+
+    struct Replay_result_ {
+        int correct{0};
+        int wrong{0};
+    };
+
+    Replay_result_ replay_(Bus_simulator &simulator, Bus_replay &replay,
+                           const int readings) {
+      auto random = std::minstd_rand{7};
+      auto samples = std::vector<Port_sample>{};
+      auto result = Replay_result_{};
+      for (auto i = 0; i < readings; ++i) {
+        const auto expected = make_random_reading_(random);
+        samples.clear();
+        simulator.simulate(expected, samples);
+        auto reading = Reading{};
+        for (const auto &sample : samples) {
+          if (replay.feed(sample, reading)) {
+            ++(reading == expected ? result.correct : result.wrong);
+          }
+        }
+      }
+      return result;
+    }
+
+    Replay_result_
+    replay_(Bus_simulator &simulator, const int readings,
+            const Strobe_capture capture = Strobe_capture::Polling) {
+      auto replay = Bus_replay{capture};
+      return replay_(simulator, replay, readings);
+    }
+
+    /// The 1900A with active-low strobes.
+    struct Active_low_1900a_ : Fluke_1900a {
+        static constexpr auto strobes_active_high = false;
+    };
+
+    /// \return The number of readings that are taken correctly by edge from
+    /// the samples of `simulator`, with the strobes inverted.
+    int replay_active_low_(Bus_simulator &simulator, const int readings) {
+      auto replay = Basic_bus_replay<Active_low_1900a_>{Strobe_capture::Edge};
+      auto random = std::minstd_rand{7};
+      auto samples = std::vector<Port_sample>{};
+      auto correct = 0;
+      for (auto i = 0; i < readings; ++i) {
+        const auto expected = make_random_reading_(random);
+        samples.clear();
+        simulator.simulate(expected, samples);
+        auto reading = Basic_reading<Active_low_1900a_>{};
+        for (auto sample : samples) {
+          sample.port1 = sample.port1 ^ port1_strobes_mask_;
+          sample.port2 = sample.port2 ^ port2_strobes_mask_;
+          if (replay.feed(sample, reading)
+              and std::equal(reading.bcd.begin(), reading.bcd.end(),
+                             expected.bcd.begin())
+              and (reading.decimal_point_digit
+                   == expected.decimal_point_digit)
+              and (reading.overflow == expected.overflow)) {
+            ++correct;
+          }
+        }
+      }
+      return correct;
+    }
+
+    /// Stores `words` at `address` in little-endian order.
+    void load_words_(Peripherals &peripherals, const intptr_t address,
+                     const std::vector<uint16_t> &words) {
+      auto bytes = std::vector<uint8_t>{};
+      for (const auto word : words) {
+        bytes.push_back(static_cast<uint8_t>(word));
+        bytes.push_back(static_cast<uint8_t>(word >> 8U));
+      }
+      peripherals.load_image(address, bytes);
+    }
+
+    /// Loads `code` to the start of the flash, where the reset vector
+    /// points to.
+    void load_program_(Peripherals &peripherals,
+                       const std::vector<uint16_t> &code) {
+      load_words_(peripherals, 0xc000, code);
+      load_words_(peripherals, 0xfffe, {0xc000});
+    }
+
+    /// \return The total number of cycles of `steps` steps of `cpu`.
+    uint32_t step_(Msp430_cpu &cpu, const int steps) {
+      auto cycles = uint32_t{0};
+      for (auto i = 0; i < steps; ++i) {
+        cycles += cpu.step();
+      }
+      return cycles;
+    }
+
+    void append_le_(std::vector<uint8_t> &bytes, const uint32_t value,
+                    const int size) {
+      for (auto i = 0U; i < static_cast<unsigned>(size); ++i) {
+        bytes.push_back(static_cast<uint8_t>(value >> (8U * i)));
+      }
+    }
+
+    /// \return An ELF file with a segment of `code` at 0xc000 and the
+    /// function symbol `run` for it.
+    std::vector<uint8_t> make_elf_(const std::vector<uint8_t> &code) {
+      const auto strings = std::string_view{"\0run\0", 5};
+      const auto code_offset = 52U + 32U;
+      const auto symbols_offset = code_offset + code.size();
+      const auto strings_offset = symbols_offset + 32U;
+      const auto sections_offset = strings_offset + strings.size();
+
+      auto elf = std::vector<uint8_t>{0x7f, 'E', 'L', 'F', 1, 1, 1};
+      elf.resize(16);
+      append_le_(elf, 2, 2);   // e_type: executable
+      append_le_(elf, 105, 2); // e_machine: MSP430
+      append_le_(elf, 1, 4);
+      append_le_(elf, 0xc000, 4);
+      append_le_(elf, 52, 4);
+      append_le_(elf, static_cast<uint32_t>(sections_offset), 4);
+      append_le_(elf, 0, 4);
+      append_le_(elf, 52, 2);
+      append_le_(elf, 32, 2);
+      append_le_(elf, 1, 2);
+      append_le_(elf, 40, 2);
+      append_le_(elf, 3, 2);
+      append_le_(elf, 0, 2);
+
+      // PT_LOAD
+      for (const auto value : {1U, code_offset, 0xc000U, 0xc000U,
+                               static_cast<uint32_t>(code.size()),
+                               static_cast<uint32_t>(code.size()), 5U, 2U}) {
+        append_le_(elf, value, 4);
+      }
+      elf.insert(elf.end(), code.begin(), code.end());
+
+      // null symbol and global function `run`
+      elf.resize(elf.size() + 16);
+      append_le_(elf, 1, 4);
+      append_le_(elf, 0xc000, 4);
+      append_le_(elf, static_cast<uint32_t>(code.size()), 4);
+      append_le_(elf, 0x12, 1);
+      append_le_(elf, 0, 1);
+      append_le_(elf, 1, 2);
+      elf.insert(elf.end(), strings.begin(), strings.end());
+
+      // null section, SHT_SYMTAB linked to SHT_STRTAB
+      elf.resize(elf.size() + 40);
+      for (const auto value : {0U, 2U, 0U, 0U,
+                               static_cast<uint32_t>(symbols_offset), 32U, 2U,
+                               1U, 4U, 16U}) {
+        append_le_(elf, value, 4);
+      }
+      for (const auto value : {0U, 3U, 0U, 0U,
+                               static_cast<uint32_t>(strings_offset),
+                               static_cast<uint32_t>(strings.size()), 0U, 0U,
+                               1U, 0U}) {
+        append_le_(elf, value, 4);
+      }
+      return elf;
+    }
+
+    struct Emulation_result_ {
+        std::vector<std::string> expected{};
+        std::vector<std::string> received{};
+        std::size_t windows{0};
+        long framing_errors{0};
+        /// In bit periods.
+        double max_edge_error{0.0};
+        double cpu_load{0.0};
+    };
+
+    /// Runs the firmware on the emulated device for `readings` windows and
+    /// receives its serial output.
+    Emulation_result_ emulate_(const Bus_timing &timing, const int readings) {
+      auto sampling = Sampling{};
+      sampling.period_ns = 1'000;
+      auto simulator = Bus_simulator{timing, sampling, 3};
+      auto random = std::minstd_rand{11};
+      auto result = Emulation_result_{};
+
+      auto emulator = Emulator{
+          Cpu_timing{},
+          [&](std::vector<Port_sample> &samples) {
+            if (static_cast<int>(result.expected.size()) == readings) {
+              return false;
+            }
+            // leave the firmware time to set up the ports
+            if (result.expected.empty()) {
+              samples.assign(1'000, encode_signals(Input_state{}, false));
+            }
+            const auto reading = make_random_reading_(random);
+            result.expected.push_back(reading_text(reading));
+            simulator.simulate(reading, samples);
+            return true;
+          },
+          Emulator::cpu_frequency_Hz / 1'000'000};
+      emulator.run(uint64_t{Emulator::cpu_frequency_Hz / 50}
+                   * static_cast<uint64_t>(readings));
+
+      const auto bit_cycles = static_cast<double>(Emulator::cpu_frequency_Hz)
+                              / serial_baud_rate;
+      const auto characters =
+          receive_uart(emulator.peripherals().tx_edges(), bit_cycles,
+                       serial_data_bits, result.max_edge_error);
+      result.max_edge_error /= bit_cycles;
+      result.framing_errors = std::count_if(
+          characters.begin(), characters.end(),
+          [](const Uart_character &character) {
+            return character.framing_error;
+          });
+      for (const auto &line : split_lines(characters)) {
+        result.received.push_back(line.text);
+      }
+      result.windows = emulator.peripherals().window_ends().size();
+      result.cpu_load = 1.0
+                        - (static_cast<double>(emulator.sleeping_cycles())
+                           / static_cast<double>(emulator.now()));
+      return result;
+    }
+
+  } // namespace
+
+  SCENARIO("parsing readings", "[host]") {
+    auto sample = Sample{};
+
+    GIVEN("a reading in frequency mode") {
+      REQUIRE(parse_line(">12.3456kHz\r", 12, sample));
+
+      CHECK(sample.reading.counts() == 123456);
+      CHECK(sample.reading.decimal_point_digit == 4);
+      CHECK(sample.reading.overflow);
+      CHECK(sample.reading.unit() == Unit::kHz);
+      CHECK(sample.mantissa == 123456);
+      CHECK(sample.exponent == -4);
+    }
+
+    GIVEN("a reading in every unit") {
+      const auto line = GENERATE(std::pair{str{" 000001\r"}, Unit::None},
+                                 std::pair{str{" 1234.56ms\r"}, Unit::ms},
+                                 std::pair{str{" 1234.56us\r"}, Unit::us},
+                                 std::pair{str{" 1234.56MHz\r"}, Unit::MHz},
+                                 std::pair{str{" 1234.56kHz\r"}, Unit::kHz});
+
+      REQUIRE(parse_line(line.first.data(),
+                         static_cast<Size>(line.first.size()), sample));
+      CHECK(sample.reading.unit() == line.second);
+      CHECK_FALSE(sample.reading.overflow);
+    }
+
+    GIVEN("a timestamped reading") {
+      const auto line = GENERATE(str{" 123.456ms @0123abcd\r"},
+                                 str{" 123456 +0123abcd\r"});
+
+      REQUIRE(parse_line(line.data(), static_cast<Size>(line.size()), sample));
+      CHECK(sample.mantissa == 123456);
+      CHECK(sample.timestamp.ticks == 0x0123abcd);
+      CHECK(sample.timestamp.mode
+            == (line[7] == ' ' ? Timestamp_mode::Delta
+                               : Timestamp_mode::Absolute));
+    }
+
+    GIVEN("a reading without timestamp") {
+      REQUIRE(parse_line(" 123.456ms\r", 11, sample));
+      CHECK(sample.timestamp.mode == Timestamp_mode::None);
+    }
+
+    GIVEN("a malformed reading") {
+      const auto line = GENERATE(str{" 12345\r"}, str{" 1234567\r"},
+                                 str{"x123456\r"}, str{" 12a456\r"},
+                                 str{" 1.23.456ms\r"}, str{" 123456ms\r"},
+                                 str{" 123.456\r"}, str{" 123.456Hz\r"},
+                                 str{" 123.456MHz"}, str{" 123456\r\r"},
+                                 str{" 123.456ms @0123abc\r"},
+                                 str{" 123.456ms #0123abcd\r"},
+                                 str{" 123.456ms @0123abcg\r"},
+                                 str{" 123.456ms@0123abcd\r"});
+
+      CAPTURE(line);
+      CHECK_FALSE(parse_line(line.data(), static_cast<Size>(line.size()),
+                             sample));
+    }
+  }
+
+  SCENARIO("receiving a stream of readings", "[host]") {
+    auto uut = Receiver{};
+
+    const auto stream = std::string{" 123456\r\n"
+                                    ">12.3456MHz\r\n"
+                                    " 1234.56us +00186a00\r\n"};
+
+    GIVEN("the stream is received in chunks of any size") {
+      const auto chunk_size = GENERATE(range(std::size_t{1}, std::size_t{40}));
+
+      const auto samples = feed_(uut, stream, chunk_size);
+
+      THEN("all readings are extracted") {
+        REQUIRE(samples.size() == 3);
+        CHECK(samples[0].reading.counts() == 123456);
+        CHECK(samples[1].reading.unit() == Unit::MHz);
+        CHECK(samples[2].exponent == -2);
+        CHECK(samples[2].timestamp.ticks == 0x186a00);
+        CHECK(uut.samples() == 3);
+        CHECK(uut.errors() == 0);
+      }
+    }
+
+    GIVEN("the stream starts in the middle of a line") {
+      const auto samples = feed_(uut, "56MHz\r\n" + stream, 5);
+
+      THEN("the partial line is dropped") {
+        CHECK(samples.size() == 3);
+        CHECK(uut.errors() == 1);
+      }
+    }
+
+    GIVEN("line feeds are lost") {
+      auto corrupted = stream;
+      corrupted[8] = 'x';
+      corrupted[21] = '\0';
+
+      const auto samples = feed_(uut, corrupted + stream, 7);
+
+      THEN("the receiver resynchronizes at the next line feed") {
+        REQUIRE(samples.size() == 3);
+        CHECK(samples[0].reading.counts() == 123456);
+        CHECK(uut.errors() == 1);
+      }
+    }
+
+    GIVEN("diagnostic lines in between") {
+      const auto samples = feed_(uut, "#0 0012 01a4 0c35\r\n" + stream, 4);
+
+      THEN("they are skipped") {
+        CHECK(samples.size() == 3);
+        CHECK(uut.errors() == 0);
+      }
+    }
+
+    GIVEN("garbage without line feeds") {
+      const auto samples = feed_(uut, std::string(1000, '7') + "\n" + stream,
+                                 64);
+
+      THEN("it is dropped as a single line") {
+        CHECK(samples.size() == 3);
+        CHECK(uut.errors() == 1);
+      }
+    }
+  }
+
+  SCENARIO("receiving readings in the scaled formats", "[host]") {
+    auto random = std::minstd_rand{5};
+    auto uut = Receiver{};
+
+    GIVEN("lines of scaled text") {
+      auto readings = std::vector<Reading>{};
+      auto lines = std::vector<std::string>{};
+      auto stream = std::string{};
+      for (auto i = 0; i < 1000; ++i) {
+        readings.push_back(random_reading(random));
+        auto text = Array<char, max_scaled_text_size>{};
+        (void)format_scaled(text.data(), readings.back());
+        lines.emplace_back(text.data());
+        stream += lines.back();
+      }
+      const auto chunk_size = GENERATE(std::size_t{1}, std::size_t{64});
+
+      const auto samples = feed_(uut, stream, chunk_size);
+
+      THEN("each gives the value in the base unit of its quantity") {
+        REQUIRE(samples.size() == readings.size());
+        CHECK(uut.errors() == 0);
+        for (auto i = std::size_t{0}; i < readings.size(); ++i) {
+          const auto &sample = samples[i];
+          const auto unit = readings[i].unit();
+          CHECK(sample.is_scaled);
+          CHECK(sample.scaled.value == scaled_value(readings[i]));
+          CHECK(sample.scaled.overflow == readings[i].overflow);
+          CHECK(sample.reading.overflow == readings[i].overflow);
+          // the unit of the same quantity
+          CHECK(str{scaled_suffixes[to_integral(sample.scaled.unit)].text
+                        .data()}
+                == str{scaled_suffixes[to_integral(unit)].text.data()});
+          CHECK(sample.mantissa
+                == static_cast<int64_t>(scaled_value(readings[i])));
+          CHECK(sample.exponent + unit_exponent(sample.scaled.unit)
+                == scaled_exponent(unit));
+          CHECK(reading_text(sample.scaled) + "\r\n" == lines[i]);
+        }
+      }
+    }
+
+    GIVEN("a timestamped line of scaled text") {
+      auto sample = Sample{};
+      REQUIRE(parse_line(">00000123456000mHz @0123abcd\r", 29, sample));
+
+      CHECK(sample.is_scaled);
+      CHECK(sample.scaled.value == 123'456'000);
+      CHECK(sample.scaled.unit == Unit::MHz);
+      CHECK(sample.scaled.overflow);
+      CHECK(sample.mantissa == 123'456'000);
+      CHECK(sample.exponent == -9);
+      CHECK(sample.timestamp.ticks == 0x0123abcd);
+      CHECK(sample.timestamp.mode == Timestamp_mode::Absolute);
+      CHECK(reading_text(sample.scaled) == ">00000123456000mHz");
+    }
+
+    GIVEN("a malformed line of scaled text") {
+      const auto line = GENERATE(str{" 0000012345600mHz\r"},
+                                 str{" 000001234560000mHz\r"},
+                                 str{" 00000123456000Hz\r"},
+                                 str{" 00000123456000ms\r"},
+                                 str{" 00000123456000ps @0123abc\r"},
+                                 str{" 0000012345.6000mHz\r"});
+      auto sample = Sample{};
+
+      CAPTURE(line);
+      CHECK_FALSE(parse_line(line.data(), static_cast<Size>(line.size()),
+                             sample));
+    }
+
+    GIVEN("scaled frames") {
+      auto readings = std::vector<Reading>{};
+      auto stream = std::string{};
+      for (auto i = 0; i < 1000; ++i) {
+        readings.push_back(random_reading(random));
+        const auto frame = encode_scaled(readings.back());
+        stream.append(reinterpret_cast<const char *>(frame.data()),
+                      static_cast<std::size_t>(frame.size()));
+      }
+      const auto chunk_size = GENERATE(std::size_t{1}, std::size_t{64});
+
+      const auto samples = feed_(uut, stream, chunk_size);
+
+      THEN("each gives the value and the unit") {
+        REQUIRE(samples.size() == readings.size());
+        CHECK(uut.errors() == 0);
+        for (auto i = std::size_t{0}; i < readings.size(); ++i) {
+          CHECK(samples[i].is_scaled);
+          CHECK(samples[i].scaled.value == scaled_value(readings[i]));
+          CHECK(samples[i].scaled.unit == readings[i].unit());
+          CHECK(samples[i].scaled.overflow == readings[i].overflow);
+          CHECK(samples[i].exponent
+                == scaled_exponent(readings[i].unit())
+                       - unit_exponent(readings[i].unit()));
+        }
+      }
+    }
+
+    GIVEN("scaled frames between lines of text") {
+      const auto frame = encode_scaled(random_reading(random));
+      const auto frame_text = std::string{
+          reinterpret_cast<const char *>(frame.data()),
+          static_cast<std::size_t>(frame.size())};
+      auto corrupted = frame_text;
+      corrupted[4] = static_cast<char>(corrupted[4] ^ 0x01);
+
+      WHEN("they are intact") {
+        const auto samples = feed_(
+            uut, " 123456\r\n" + frame_text + ">12.3456MHz\r\n" + frame_text,
+            3);
+
+        THEN("all readings are extracted") {
+          REQUIRE(samples.size() == 4);
+          CHECK_FALSE(samples[0].is_scaled);
+          CHECK(samples[1].is_scaled);
+          CHECK(samples[2].reading.unit() == Unit::MHz);
+          CHECK(samples[3].is_scaled);
+          CHECK(uut.errors() == 0);
+        }
+      }
+
+      WHEN("one is corrupted and another cut short") {
+        const auto samples = feed_(uut,
+                                   corrupted + frame_text.substr(0, 5)
+                                       + frame_text + " 123456\r\n",
+                                   7);
+
+        THEN("the receiver resynchronizes at the next sync") {
+          REQUIRE(samples.size() == 2);
+          CHECK(samples[0].is_scaled);
+          CHECK(samples[1].reading.counts() == 123456);
+          CHECK(uut.errors() == 2);
+        }
+      }
+    }
+  }
+
+  SCENARIO("passing samples between threads", "[host]") {
+    auto uut = Spsc_queue<int, 8>{};
+    constexpr auto count = 100'000;
+
+    GIVEN("a producer that is faster than the queue is large") {
+      auto producer = std::thread{[&uut] {
+        for (auto i = 0; i < count; ++i) {
+          while (not uut.push(i)) {
+            std::this_thread::yield();
+          }
+        }
+      }};
+
+      THEN("the consumer receives every value in order") {
+        auto expected = 0;
+        auto value = 0;
+        while (expected < count) {
+          if (uut.pop(value)) {
+            REQUIRE(value == expected);
+            ++expected;
+          } else {
+            std::this_thread::yield();
+          }
+        }
+        producer.join();
+        CHECK(uut.empty());
+      }
+    }
+  }
+
+  SCENARIO("ingesting readings from several ports", "[host]") {
+    constexpr auto number_of_ports = 3;
+    auto terminals = std::vector<std::unique_ptr<Pseudo_terminal>>{};
+    auto uut = Ingestion{};
+    REQUIRE(uut.is_valid());
+    for (auto i = 0; i < number_of_ports; ++i) {
+      terminals.push_back(std::make_unique<Pseudo_terminal>());
+      REQUIRE(terminals.back()->is_open());
+      REQUIRE(uut.open(terminals.back()->port()) == i);
+    }
+
+    const auto poll = [&uut](const std::size_t expected) {
+      auto completed = std::size_t{0};
+      for (auto i = 0; (i < 100) and (completed < expected); ++i) {
+        const auto result = uut.poll(100);
+        REQUIRE(result >= 0);
+        completed += static_cast<std::size_t>(result);
+      }
+      return completed;
+    };
+
+    GIVEN("each port sends lines that are split across writes") {
+      for (auto i = 0; i < number_of_ports; ++i) {
+        const auto stream = " 12345" + std::to_string(i) + "\r\n>12.3"
+                            + "456MHz\r\n#H 0a 00 00 0a 00\r\n 12.3456us\r";
+        REQUIRE(terminals[static_cast<std::size_t>(i)]->write(
+            stream.data(), stream.size()));
+      }
+      for (auto &terminal : terminals) {
+        REQUIRE(terminal->write("\n", 1));
+      }
+
+      THEN("the readings of each port are queued in order") {
+        REQUIRE(poll(3 * number_of_ports) == 3 * number_of_ports);
+        for (auto i = 0; i < number_of_ports; ++i) {
+          const auto port = static_cast<std::size_t>(i);
+          auto received = Received_sample{};
+          REQUIRE(uut.queue(port).pop(received));
+          CHECK(received.sample.reading.counts() == 123450 + i);
+          CHECK(received.received_ns > 0);
+          REQUIRE(uut.queue(port).pop(received));
+          CHECK(received.sample.reading.overflow);
+          CHECK(received.sample.reading.unit() == Unit::MHz);
+          REQUIRE(uut.queue(port).pop(received));
+          CHECK(received.sample.reading.unit() == Unit::us);
+          CHECK(uut.queue(port).empty());
+          CHECK(uut.receiver(port).errors() == 0);
+          CHECK(uut.dropped(port) == 0);
+        }
+      }
+    }
+
+    GIVEN("a port is hung up") {
+      REQUIRE(terminals[1]->write(" 000001\r\n", 9));
+      REQUIRE(poll(1) == 1);
+      terminals[1]->close();
+
+      THEN("it is closed, while its readings remain queued") {
+        for (auto i = 0; (i < 100) and (uut.open_ports() == number_of_ports);
+             ++i) {
+          REQUIRE(uut.poll(100) >= 0);
+        }
+        CHECK(uut.open_ports() == number_of_ports - 1);
+        CHECK_FALSE(uut.is_open(1));
+        CHECK(uut.is_open(0));
+        auto received = Received_sample{};
+        REQUIRE(uut.queue(1).pop(received));
+        CHECK(received.sample.reading.counts() == 1);
+      }
+    }
+  }
+
+  /// A file that is removed at the end of the test.
+  class Temporary_file_ {
+    public:
+      Temporary_file_() {
+        const auto fd = mkstemp(path_.data());
+        REQUIRE(fd >= 0);
+        ::close(fd);
+      }
+
+      ~Temporary_file_() { std::remove(path_.data()); }
+
+      [[nodiscard]] const char *path() const { return path_.data(); }
+
+    private:
+      std::string path_{"/tmp/dou_test_XXXXXX"};
+  };
+
+  SCENARIO("writing and reading capture logs", "[host]") {
+    const auto file = Temporary_file_{};
+    auto random = std::minstd_rand{7};
+
+    // The devices are slightly out of order, as when several are read.
+    auto records = std::vector<Log_record>{};
+    for (auto i = 0; i < 10'000; ++i) {
+      const auto reading = random_reading(random);
+      const auto time_ns = (int64_t{i} * 10) + static_cast<int>(random() % 25);
+      records.push_back(make_record(reading, time_ns,
+                                    static_cast<uint16_t>(i % 3)));
+    }
+
+    auto writer = Log_writer{};
+    REQUIRE(writer.open(file.path()));
+    for (const auto &record : records) {
+      REQUIRE(writer.append(record));
+    }
+    REQUIRE(writer.close());
+
+    const auto equal = [](const Log_record &lhs, const Log_record &rhs) {
+      return (lhs.time_ns == rhs.time_ns) and (lhs.value == rhs.value)
+             and (lhs.device == rhs.device) and (lhs.reading() == rhs.reading())
+             and (lhs.unit == rhs.unit);
+    };
+
+    GIVEN("a log") {
+      auto uut = Log_reader{};
+      REQUIRE(uut.open(file.path()));
+
+      THEN("the records are read as written") {
+        CHECK_FALSE(uut.is_ordered());
+        REQUIRE(uut.size() == records.size());
+        CHECK(std::equal(uut.begin(), uut.end(), records.begin(), equal));
+        CHECK(uut[0].reading().unit() == static_cast<Unit>(uut[0].unit));
+        CHECK(uut[0].value == scaled_value(uut[0].reading()));
+      }
+
+      THEN("any range of time yields the records within it") {
+        for (auto i = 0; i < 100; ++i) {
+          const auto from_ns = static_cast<int64_t>(random() % 100'100) - 50;
+          const auto to_ns = from_ns + static_cast<int64_t>(random() % 5'000);
+          auto expected = std::vector<Log_record>{};
+          std::copy_if(records.begin(), records.end(),
+                       std::back_inserter(expected),
+                       [&](const Log_record &record) {
+                         return (record.time_ns >= from_ns)
+                                and (record.time_ns < to_ns);
+                       });
+          auto found = std::vector<Log_record>{};
+          const auto count = uut.for_each(
+              from_ns, to_ns,
+              [&](const Log_record &record) { found.push_back(record); });
+
+          CHECK(count == expected.size());
+          REQUIRE(found.size() == expected.size());
+          CHECK(std::equal(found.begin(), found.end(), expected.begin(),
+                           equal));
+          const auto [first, last] = uut.find(from_ns, to_ns);
+          CHECK((last - first)
+                <= (expected.size() + (2 * Log_reader::block_size)));
+        }
+      }
+    }
+
+    GIVEN("a log in the order of time") {
+      const auto ordered = Temporary_file_{};
+      auto sorted = records;
+      std::stable_sort(sorted.begin(), sorted.end(),
+                       [](const Log_record &lhs, const Log_record &rhs) {
+                         return lhs.time_ns < rhs.time_ns;
+                       });
+      REQUIRE(writer.open(ordered.path()));
+      for (const auto &record : sorted) {
+        REQUIRE(writer.append(record));
+      }
+      REQUIRE(writer.close());
+      auto uut = Log_reader{};
+      REQUIRE(uut.open(ordered.path()));
+
+      THEN("ranges of time are found without an index") {
+        CHECK(uut.is_ordered());
+        for (auto i = 0; i < 100; ++i) {
+          const auto from_ns = static_cast<int64_t>(random() % 100'100) - 50;
+          const auto to_ns = from_ns + static_cast<int64_t>(random() % 5'000);
+          const auto [first, last] = uut.find(from_ns, to_ns);
+          const auto expected = static_cast<std::size_t>(std::count_if(
+              sorted.begin(), sorted.end(), [&](const Log_record &record) {
+                return (record.time_ns >= from_ns)
+                       and (record.time_ns < to_ns);
+              }));
+          CHECK(last - first == expected);
+          CHECK(uut.for_each(from_ns, to_ns, [](const Log_record &) {})
+                == expected);
+        }
+      }
+
+      WHEN("an earlier record is appended") {
+        uut.close();
+        REQUIRE(writer.open(ordered.path()));
+        CHECK(writer.latest_ns() == sorted.back().time_ns);
+        REQUIRE(writer.append(sorted.front()));
+        REQUIRE(writer.close());
+
+        THEN("the log is no longer taken to be in order") {
+          REQUIRE(uut.open(ordered.path()));
+          CHECK_FALSE(uut.is_ordered());
+          CHECK(uut.size() == sorted.size() + 1);
+          CHECK(uut.for_each(sorted.front().time_ns,
+                             sorted.front().time_ns + 1,
+                             [](const Log_record &) {})
+                >= 2);
+        }
+      }
+    }
+
+    GIVEN("the log is appended to after a record has been cut short") {
+      {
+        auto *const stream = std::fopen(file.path(), "ab");
+        REQUIRE(std::fwrite("partial", 7, 1, stream) == 1);
+        std::fclose(stream);
+      }
+      auto truncated = Log_reader{};
+      REQUIRE(truncated.open(file.path()));
+      REQUIRE(truncated.size() == records.size());
+      truncated.close();
+
+      REQUIRE(writer.open(file.path()));
+      REQUIRE(writer.append(records.front()));
+      REQUIRE(writer.close());
+
+      THEN("the new records follow the complete ones") {
+        auto uut = Log_reader{};
+        REQUIRE(uut.open(file.path()));
+        REQUIRE(uut.size() == records.size() + 1);
+        CHECK(equal(uut[records.size()], records.front()));
+      }
+    }
+
+    GIVEN("a file that is not a log") {
+      const auto other = Temporary_file_{};
+      auto *const stream = std::fopen(other.path(), "wb");
+      REQUIRE(std::fwrite("DOUTRC1\0\0\0\0\0\0\0\0\0", 16, 1, stream) == 1);
+      std::fclose(stream);
+
+      THEN("it is neither read nor appended to") {
+        auto uut = Log_reader{};
+        CHECK_FALSE(uut.open(other.path()));
+        CHECK_FALSE(writer.open(other.path()));
+      }
+    }
+  }
+
+  SCENARIO("converting textual output to a capture log", "[host]") {
+    GIVEN("readings with absolute timestamps that wrap around") {
+      auto uut = Text_log_converter{5};
+      const auto text = str{" 123.456MHz @fffffff0\r\n"
+                            ">12.3456us @00000010\r\n"
+                            " 000042 @00000020\r\n"};
+      uut.feed(text.data(), static_cast<Size>(text.size()));
+
+      THEN("the times keep increasing from the first reading on") {
+        const auto &records = uut.records();
+        REQUIRE(records.size() == 3);
+        CHECK(records[0].time_ns == 0);
+        CHECK(records[1].time_ns == 0x20LL * 125 / 2);
+        CHECK(records[2].time_ns == 0x30LL * 125 / 2);
+        CHECK(records[0].device == 5);
+        CHECK(records[0].value == 123'456'000'000ULL);
+        CHECK(records[1].reading().overflow);
+        CHECK(records[2].reading().counts() == 42);
+      }
+    }
+
+    GIVEN("readings with delta timestamps") {
+      auto uut = Text_log_converter{0};
+      const auto text = str{" 000001 +00000010\r\n 000002 +00000010\r\n"
+                            " 000003 +00000010\r\n"};
+      uut.feed(text.data(), static_cast<Size>(text.size()));
+
+      THEN("the deltas are summed up") {
+        const auto &records = uut.records();
+        REQUIRE(records.size() == 3);
+        CHECK(records[0].time_ns == 0);
+        CHECK(records[1].time_ns == 1000);
+        CHECK(records[2].time_ns == 2000);
+      }
+    }
+
+    GIVEN("readings in scaled text") {
+      auto uut = Text_log_converter{2};
+      const auto text = str{" 00000123456000mHz\r\n>00000000123456\r\n"};
+      uut.feed(text.data(), static_cast<Size>(text.size()));
+
+      THEN("their values are recorded without digits") {
+        const auto &records = uut.records();
+        REQUIRE(records.size() == 2);
+        CHECK(records[0].is_scaled());
+        CHECK(records[0].value == 123'456'000);
+        CHECK(records[0].scaled().unit == Unit::MHz);
+        CHECK_FALSE(records[0].scaled().overflow);
+        CHECK(records[1].value == 123'456);
+        CHECK(records[1].scaled().unit == Unit::None);
+        CHECK(records[1].scaled().overflow);
+        CHECK(reading_text(records[1].scaled()) == ">00000000123456");
+      }
+    }
+
+    GIVEN("the outputs of several DOUs, which have been captured at once") {
+      constexpr auto devices = std::size_t{4};
+      constexpr auto readings = 5'000;
+      auto random = std::minstd_rand{11};
+      auto texts = std::vector<std::string>(devices);
+      for (auto device = std::size_t{0}; device < devices; ++device) {
+        // each timer has started at another time and runs at another rate
+        auto ticks = static_cast<uint32_t>(random());
+        for (auto i = 0; i < readings; ++i) {
+          auto line = Array<char, 24>{};
+          std::snprintf(line.data(), line.size(), " %06d @%08x\r\n", i,
+                        static_cast<unsigned>(ticks));
+          texts[device] += line.data();
+          ticks += static_cast<uint32_t>(16'000 + (device * 997)
+                                         + (random() % 500));
+        }
+      }
+
+      const auto file = Temporary_file_{};
+      const auto convert = [&file, &texts] {
+        auto writer = Log_writer{};
+        REQUIRE(writer.open(file.path()));
+        auto uut = Text_log_merger{writer, devices};
+        auto fed = std::vector<std::size_t>(devices, 0);
+        auto ended = std::size_t{0};
+        while (ended < devices) {
+          for (auto device = std::size_t{0}; device < devices; ++device) {
+            if (uut.is_waiting(device)) {
+              const auto length = std::min(
+                  std::size_t{1'000}, texts[device].size() - fed[device]);
+              if (length == 0) {
+                REQUIRE(uut.end(device));
+                ++ended;
+              } else {
+                REQUIRE(uut.feed(device, texts[device].data() + fed[device],
+                                 static_cast<Size>(length)));
+                fed[device] += length;
+              }
+            }
+          }
+        }
+        REQUIRE(writer.close());
+      };
+      convert();
+
+      auto reader = Log_reader{};
+      REQUIRE(reader.open(file.path()));
+      REQUIRE(reader.size() == devices * readings);
+
+      THEN("the devices are merged in the order of time") {
+        CHECK(reader.is_ordered());
+        CHECK(std::is_sorted(reader.begin(), reader.end(),
+                             [](const Log_record &lhs, const Log_record &rhs) {
+                               return lhs.time_ns < rhs.time_ns;
+                             }));
+        for (auto device = std::size_t{0}; device < devices; ++device) {
+          CHECK(std::count_if(reader.begin(), reader.end(),
+                              [device](const Log_record &record) {
+                                return record.device == device;
+                              })
+                == readings);
+        }
+      }
+
+      THEN("a range of time is narrowed down to the records within") {
+        for (auto i = 0; i < 100; ++i) {
+          // about 10 readings of each device
+          const auto from_ns
+              = static_cast<int64_t>(random() % 5'000) * 1'000'000;
+          const auto to_ns = from_ns + 10'000'000;
+          const auto expected = static_cast<std::size_t>(std::count_if(
+              reader.begin(), reader.end(), [&](const Log_record &record) {
+                return (record.time_ns >= from_ns)
+                       and (record.time_ns < to_ns);
+              }));
+          const auto [first, last] = reader.find(from_ns, to_ns);
+          CHECK(last - first == expected);
+          CHECK(reader.for_each(from_ns, to_ns, [](const Log_record &) {})
+                == expected);
+        }
+      }
+
+      WHEN("they are converted into the same log once more") {
+        const auto latest_ns = reader[reader.size() - 1].time_ns;
+        reader.close();
+        convert();
+        REQUIRE(reader.open(file.path()));
+        REQUIRE(reader.size() == 2 * devices * readings);
+
+        THEN("they follow the records in the log") {
+          CHECK(reader.is_ordered());
+          CHECK(reader[devices * readings].time_ns == latest_ns + 1);
+          const auto [first, last] = reader.find(0, latest_ns + 1);
+          CHECK(first == 0);
+          CHECK(last == devices * readings);
+        }
+      }
+    }
+  }
+
+  SCENARIO("encoding the bus state at the ports", "[host]") {
+    const auto digit_strobe = static_cast<i8>(GENERATE(range(0, 7)));
+    const auto out = static_cast<i8>(GENERATE(range(0, 16)));
+    const auto flags = GENERATE(range(0, 16));
+
+    const auto state = Input_state{digit_strobe,     out,
+                                   (flags & 1) != 0, (flags & 2) != 0,
+                                   (flags & 4) != 0, (flags & 8) != 0};
+    const auto update_memory = (flags & 1) == 0;
+
+    const auto sample = encode_signals(state, update_memory);
+    const auto decoded = decode_signals(sample.port1, sample.port2);
+
+    CHECK(decoded.digit_strobe == state.digit_strobe);
+    CHECK(decoded.out == state.out);
+    CHECK(decoded.decimal_strobe == state.decimal_strobe);
+    CHECK(decoded.overflow == state.overflow);
+    CHECK(decoded.nml == state.nml);
+    CHECK(decoded.rng_2 == state.rng_2);
+    CHECK(((sample.port2 & nmup_mask_) == u8{0}) == update_memory);
+    CHECK((sample.port1 & tx_mask_) == u8{0});
+  }
+
+  SCENARIO("decoding simulated display bus traffic", "[host]") {
+    constexpr auto readings = 2000;
+
+    GIVEN("every strobe is sampled several times") {
+      auto sampling = Sampling{};
+      sampling.period_ns = 5'000;
+      sampling.jitter_ns = 5'000;
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 1};
+
+      THEN("every reading is caught") {
+        const auto result = replay_(simulator, readings);
+        CHECK(result.correct == readings);
+        CHECK(result.wrong == 0);
+      }
+    }
+
+    GIVEN("strobes are captured by edge") {
+      auto sampling = Sampling{};
+      sampling.period_ns = 1'000;
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 1};
+
+      THEN("every reading is caught") {
+        const auto result = replay_(simulator, readings, Strobe_capture::Edge);
+        CHECK(result.correct == readings);
+        CHECK(result.wrong == 0);
+      }
+    }
+
+    GIVEN("active-low strobes are captured by edge") {
+      auto sampling = Sampling{};
+      sampling.period_ns = 1'000;
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 1};
+
+      THEN("every reading is caught") {
+        CHECK(replay_active_low_(simulator, readings) == readings);
+      }
+    }
+
+    GIVEN("glitches during several passes per window") {
+      auto timing = Bus_timing{};
+      timing.passes = 4;
+      auto sampling = Sampling{};
+      sampling.glitch_rate = 0.2;
+      auto simulator = Bus_simulator{timing, sampling, 1};
+
+      THEN("glitched passes are outvoted") {
+        const auto result = replay_(simulator, readings);
+        CHECK(result.wrong < readings / 100);
+      }
+    }
+
+    GIVEN("the main loop takes as long as its budget") {
+      REQUIRE(Bus_timing{}.strobe_width_ns == min_strobe_width_ns);
+      REQUIRE(Bus_timing{}.blanking_ns == min_blanking_ns);
+      auto sampling = Sampling{};
+      sampling.period_ns = static_cast<uint32_t>(
+          max_poll_period_cycles * 1'000'000'000LL / smclk_frequency_Hz);
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 1};
+
+      THEN("every reading is caught") {
+        const auto result = replay_(simulator, readings);
+        CHECK(result.correct == readings);
+        CHECK(result.wrong == 0);
+      }
+    }
+
+    GIVEN("strobes are sampled less than twice") {
+      auto sampling = Sampling{};
+      sampling.period_ns = Bus_timing{}.strobe_width_ns * 3 / 4;
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 1};
+
+      THEN("readings are lost") {
+        CHECK(replay_(simulator, readings).correct < readings / 2);
+      }
+    }
+  }
+
+  SCENARIO("running the firmware on the emulated device", "[host]") {
+    constexpr auto readings = 10;
+
+    GIVEN("the serial output keeps up with the windows") {
+      auto timing = Bus_timing{};
+      timing.idle_ns = 10'000'000;
+      const auto result = emulate_(timing, readings);
+
+      THEN("every reading is transmitted in order") {
+        CHECK(result.windows == readings);
+        CHECK(result.received == result.expected);
+      }
+
+      THEN("the characters are framed at the baud rate") {
+        CHECK(result.framing_errors == 0);
+        CHECK(result.max_edge_error < 0.1);
+      }
+
+      THEN("the CPU sleeps while /MUP is high") {
+        CHECK(result.cpu_load < 0.5);
+      }
+    }
+
+    GIVEN("windows follow faster than their readings are transmitted") {
+      const auto result = emulate_(Bus_timing{}, readings);
+
+      THEN("readings are skipped, but none are corrupted") {
+        CHECK(result.windows == readings);
+        CHECK(result.received.size() < result.expected.size());
+        CHECK(result.received.size() >= readings / 2);
+        auto window = result.expected.begin();
+        for (const auto &line : result.received) {
+          window = std::find(window, result.expected.end(), line);
+          CHECK(window != result.expected.end());
+        }
+      }
+    }
+
+    GIVEN("a run that ends while a reading is being transmitted") {
+      auto simulator = Bus_simulator{Bus_timing{}, Sampling{}, 3};
+      const auto bus = [&simulator](std::vector<Port_sample> &samples) {
+        samples.assign(1'000, encode_signals(Input_state{}, false));
+        simulator.simulate(Reading{}, samples);
+        return true;
+      };
+      auto cycles = uint64_t{0};
+      {
+        auto emulator = Emulator{Cpu_timing{}, bus,
+                                 Emulator::cpu_frequency_Hz / 1'000'000};
+        emulator.run(Emulator::cpu_frequency_Hz / 50);
+        REQUIRE(emulator.peripherals().tx_edges().size() > 20);
+        cycles = emulator.peripherals().tx_edges()[20].cycle;
+      }
+      {
+        auto emulator = Emulator{Cpu_timing{}, bus,
+                                 Emulator::cpu_frequency_Hz / 1'000'000};
+        emulator.run(cycles);
+      }
+
+      WHEN("the firmware is run again") {
+        auto timing = Bus_timing{};
+        timing.idle_ns = 10'000'000;
+        const auto result = emulate_(timing, readings);
+
+        THEN("it starts from the initial values of its variables") {
+          CHECK(result.received == result.expected);
+        }
+      }
+    }
+  }
+
+  SCENARIO("telling sampling problems from a silent bus", "[host]") {
+    constexpr auto readings = 20;
+
+    GIVEN("the bus is sampled sufficiently often") {
+      auto simulator = Bus_simulator{Bus_timing{}, Sampling{}, 1};
+      auto replay = Bus_replay{};
+      replay_(simulator, replay, readings);
+
+      THEN("every window yields a reading") {
+        const auto &health = replay.health();
+        CHECK(health.windows() == readings);
+        CHECK(health.readings() == readings);
+        CHECK(health.incomplete_windows() == 0);
+        CHECK(health.empty_windows() == 0);
+        CHECK(health.out_of_sequence() == 0);
+      }
+    }
+
+    GIVEN("the bus is sampled too rarely") {
+      auto sampling = Sampling{};
+      sampling.period_ns = Bus_timing{}.strobe_width_ns * 3 / 2;
+      auto simulator = Bus_simulator{Bus_timing{}, sampling, 1};
+      auto replay = Bus_replay{};
+      replay_(simulator, replay, readings);
+
+      THEN("strobes are seen out of sequence") {
+        const auto &health = replay.health();
+        CHECK(health.incomplete_windows() > 0);
+        CHECK(health.out_of_sequence() > 0);
+        CHECK(health.empty_windows() == 0);
+      }
+    }
+
+    GIVEN("the digits are not strobed") {
+      auto timing = Bus_timing{};
+      timing.strobe_width_ns = 0;
+      auto simulator = Bus_simulator{timing, Sampling{}, 1};
+      auto replay = Bus_replay{};
+      replay_(simulator, replay, readings);
+
+      THEN("the windows are empty") {
+        const auto &health = replay.health();
+        CHECK(health.empty_windows() == readings);
+        CHECK(health.readings() == 0);
+        CHECK(health.out_of_sequence() == 0);
+      }
+    }
+  }
+
+  SCENARIO("recording and replaying traces", "[host]") {
+    auto random = std::minstd_rand{3};
+    auto simulator = Bus_simulator{Bus_timing{}, Sampling{}, 1};
+    auto samples = std::vector<Port_sample>{};
+    for (auto i = 0; i < 3; ++i) {
+      simulator.simulate(make_random_reading_(random), samples);
+    }
+
+    auto *const file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    REQUIRE(write_trace(file, 5'000, samples));
+    std::rewind(file);
+
+    auto sample_period_ns = uint32_t{0};
+    auto replayed = std::vector<Port_sample>{};
+    REQUIRE(read_trace(file, sample_period_ns, replayed));
+    std::fclose(file);
+
+    CHECK(sample_period_ns == 5'000);
+    REQUIRE(replayed.size() == samples.size());
+    for (auto i = std::size_t{0}; i < samples.size(); ++i) {
+      CHECK(replayed[i].port1 == samples[i].port1);
+      CHECK(replayed[i].port2 == samples[i].port2);
+    }
+  }
+
+  SCENARIO("executing MSP430 machine code", "[host]") {
+    auto peripherals = Peripherals{[](std::vector<Port_sample> &) {
+                                     return false;
+                                   },
+                                   16};
+    auto cpu = Msp430_cpu{peripherals};
+
+    GIVEN("a program that moves, adds and compares") {
+      load_program_(peripherals, {
+                                     0x4031, 0x0280,         // mov #0x280, SP
+                                     0x4034, 0x0005,         // mov #5, R4
+                                     0x5314,                 // add #1, R4
+                                     0x4482, 0x0200,         // mov R4, &0x200
+                                     0x90f2, 0x0006, 0x0200, // cmp.b #6, &0x200
+                                 });
+      cpu.reset();
+
+      WHEN("it is executed") {
+        const auto cycles = step_(cpu, 5);
+
+        THEN("registers, memory and flags hold the results") {
+          CHECK(cpu.reg(Msp430_cpu::sp) == 0x0280);
+          CHECK(cpu.reg(4) == 6);
+          CHECK(peripherals.read(0x0200, 2) == 6);
+          CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::zero) != 0);
+          CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::carry) != 0);
+          CHECK(cpu.reg(Msp430_cpu::pc) == 0xc014);
+        }
+
+        THEN("each instruction takes the cycles of its addressing modes") {
+          CHECK(cycles == 2 + 2 + 1 + 4 + 5);
+        }
+      }
+    }
+
+    GIVEN("a program of arithmetic on single operands") {
+      load_program_(peripherals, {
+                                     0x4305,         // mov #0, R5
+                                     0x8315,         // sub #1, R5
+                                     0x1105,         // rra R5
+                                     0x4076, 0x0080, // mov.b #0x80, R6
+                                     0x1186,         // sxt R6
+                                     0x4037, 0x0999, // mov #0x999, R7
+                                     0xc312,         // clrc
+                                     0xa317,         // dadd #1, R7
+                                 });
+      cpu.reset();
+
+      THEN("subtracting borrows") {
+        step_(cpu, 2);
+        CHECK(cpu.reg(5) == 0xffff);
+        CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::negative) != 0);
+        CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::carry) == 0);
+        AND_THEN("shifting keeps the sign and moves out the carry") {
+          CHECK(step_(cpu, 1) == 1);
+          CHECK(cpu.reg(5) == 0xffff);
+          CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::carry) != 0);
+        }
+      }
+
+      THEN("bytes are sign-extended") {
+        step_(cpu, 5);
+        CHECK(cpu.reg(6) == 0xff80);
+        CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::negative) != 0);
+      }
+
+      THEN("decimal addition carries between digits") {
+        step_(cpu, 8);
+        CHECK(cpu.reg(7) == 0x1000);
+        CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::carry) == 0);
+      }
+    }
+
+    GIVEN("a program that calls a subroutine") {
+      load_program_(peripherals, {
+                                     0x4031, 0x0280, // mov #0x280, SP
+                                     0x12b0, 0xc100, // call #0xc100
+                                     0x3fff,         // jmp $
+                                 });
+      load_words_(peripherals, 0xc100, {0x4130}); // ret
+      cpu.reset();
+
+      THEN("it returns behind the call") {
+        CHECK(step_(cpu, 2) == 2 + 5);
+        CHECK(cpu.reg(Msp430_cpu::pc) == 0xc100);
+        CHECK(cpu.reg(Msp430_cpu::sp) == 0x027e);
+        CHECK(step_(cpu, 1) == 3);
+        CHECK(cpu.reg(Msp430_cpu::pc) == 0xc008);
+        CHECK(cpu.reg(Msp430_cpu::sp) == 0x0280);
+        AND_THEN("jumps to itself") {
+          CHECK(step_(cpu, 1) == 2);
+          CHECK(cpu.reg(Msp430_cpu::pc) == 0xc008);
+        }
+      }
+    }
+
+    GIVEN("a program that sleeps until a timer interrupt") {
+      load_program_(peripherals, {
+                                     0x4031, 0x0280, // mov #0x280, SP
+                                     0xd032, 0x0018, // bis #GIE|CPUOFF, SR
+                                     0x4315,         // mov #1, R5
+                                     0x3fff,         // jmp $
+                                 });
+      load_words_(peripherals, 0xc100,
+                  {
+                      0xc0b1, 0x0010, 0x0000, // bic #CPUOFF, 0(SP)
+                      0x1300,                 // reti
+                  });
+      load_words_(peripherals, 0xfff2, {0xc100});
+      cpu.reset();
+      peripherals.write(0x0172, 2, 1'000); // TACCR0
+      peripherals.write(0x0162, 2, 0x0010); // CCIE
+      peripherals.write(0x0160, 2, 0x0210); // SMCLK, up mode
+
+      WHEN("it is executed") {
+        step_(cpu, 2);
+        REQUIRE(cpu.is_sleeping());
+        auto steps = 0;
+        auto max_depth = 0;
+        while ((cpu.reg(5) != 1) and (++steps < 100)) {
+          cpu.step();
+          max_depth = std::max(max_depth, cpu.interrupt_depth());
+        }
+
+        THEN("the interrupt wakes it up") {
+          CHECK(cpu.reg(5) == 1);
+          CHECK(max_depth == 1);
+          CHECK(cpu.interrupt_depth() == 0);
+          CHECK(cpu.last_vector() == 25);
+          CHECK(peripherals.now() > 1'000);
+          CHECK(not cpu.is_sleeping());
+          CHECK((cpu.reg(Msp430_cpu::sr) & Msp430_cpu::gie) != 0);
+          CHECK(cpu.reg(Msp430_cpu::sp) == 0x0280);
+        }
+      }
+    }
+  }
+
+  SCENARIO("reading an MSP430 executable", "[host]") {
+    const auto code = std::vector<uint8_t>{0x30, 0x41}; // ret
+    const auto elf = make_elf_(code);
+
+    auto *const file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    REQUIRE(std::fwrite(elf.data(), 1, elf.size(), file) == elf.size());
+    std::rewind(file);
+
+    auto image = Elf_image{};
+    REQUIRE(read_elf(file, image));
+    std::fclose(file);
+
+    REQUIRE(image.segments.size() == 1);
+    CHECK(image.segments[0].address == 0xc000);
+    CHECK(image.segments[0].bytes == code);
+    REQUIRE(image.symbols.size() == 1);
+    CHECK(image.symbols[0].name == "run");
+    CHECK(image.symbols[0].address == 0xc000);
+    CHECK(image.symbols[0].size == 2);
+    CHECK(image.symbols[0].is_function);
+  }
+
+} // namespace dou::host
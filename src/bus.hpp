@@ -0,0 +1,150 @@
+// Data Output Unit Firmware / Darius Kellermann <kellermann@protonmail.com>
+
+#ifndef BUS_HPP_
+#define BUS_HPP_
+
+#include "dou.hpp"
+#include "nostd.hpp"
+
+namespace dou {
+
+  // The USI can only drive P1.6 (SDO).
+  constexpr auto swap_tx_as_3_ = serial_backend == Serial_backend::Usi;
+
+  // Pin assignment of the display bus and the serial output.
+
+  // port 1
+  constexpr auto out_b_mask_ = u8{0x01}; // BCD 2
+  constexpr auto as_1_mask_ = u8{0x02};  // LSD
+  constexpr auto tx_mask_ = swap_tx_as_3_ ? u8{0x40} : u8{0x04};
+  constexpr auto rng_2_mask_ = u8{0x08};
+  constexpr auto nml_mask_ = u8{0x10};
+  constexpr auto ovfl_mask_ = u8{0x20};
+  constexpr auto as_3_mask_ = swap_tx_as_3_ ? u8{0x04} : u8{0x40}; // 4SD
+  constexpr auto as_2_mask_ = u8{0x80}; // 5SD
+
+  // port 2
+  constexpr auto nmup_mask_ = u8{0x01};
+  constexpr auto out_c_mask_ = u8{0x02}; // BCD 4
+  constexpr auto out_d_mask_ = u8{0x04}; // BCD 8
+  constexpr auto as_6_mask_ = u8{0x08};  // MSD
+  constexpr auto as_5_mask_ = u8{0x10};  // 2SD
+  constexpr auto as_4_mask_ = u8{0x20};  // 3SD
+  constexpr auto out_a_mask_ = u8{0x40}; // BCD 1
+  constexpr auto ds_mask_ = u8{0x80};
+
+  constexpr auto port1_strobes_mask_ = as_1_mask_ | as_2_mask_ | as_3_mask_;
+  constexpr auto port2_strobes_mask_ = as_4_mask_ | as_5_mask_ | as_6_mask_;
+
+  static_assert(Instrument::digits == 6,
+                "the board has inputs for six digit strobes, AS_1..AS_6");
+
+  /// Levels of the ports of `Instrument_` while no digit strobe is
+  /// asserted, and all other signals are low.
+  template <typename Instrument_>
+  constexpr auto port1_idle_of_ = Instrument_::strobes_active_high
+                                      ? u8{0}
+                                      : port1_strobes_mask_;
+  template <typename Instrument_>
+  constexpr auto port2_idle_of_ = Instrument_::strobes_active_high
+                                      ? u8{0}
+                                      : port2_strobes_mask_;
+
+  constexpr auto port1_idle_ = port1_idle_of_<Instrument>;
+  constexpr auto port2_idle_ = port2_idle_of_<Instrument>;
+
+  /// \return Whether the digit strobe at `mask` of `port` is asserted.
+  template <typename Instrument_>
+  constexpr bool is_strobed_(const u8 port, const u8 mask) {
+    return ((port & mask) != u8{0}) == Instrument_::strobes_active_high;
+  }
+
+  /// Levels of P1IN and P2IN, as sampled by the firmware.
+  struct Port_sample {
+      u8 port1;
+      u8 port2;
+  };
+
+  /// \return The bus state corresponding to the levels sampled at the ports,
+  /// evaluating signal by signal. This is the reference for the tables that
+  /// are used by `decode_signals()`.
+  template <typename Instrument_ = Instrument>
+  constexpr Input_state decode_signals_by_bits(const u8 port1, const u8 port2) {
+    const auto strobed = is_strobed_<Instrument_>;
+    return {
+        static_cast<i8>(
+            strobed(port1, as_1_mask_)
+                ? 1
+                : (strobed(port1, as_2_mask_)
+                       ? 2
+                       : (strobed(port1, as_3_mask_)
+                              ? 3
+                              : (strobed(port2, as_4_mask_)
+                                     ? 4
+                                     : (strobed(port2, as_5_mask_)
+                                            ? 5
+                                            : (strobed(port2, as_6_mask_)
+                                                   ? 6
+                                                   : 0)))))),
+        static_cast<i8>((((port2 & out_a_mask_) != u8{0}) ? u8{1} : u8{0})
+                        | (((port1 & out_b_mask_) != u8{0}) ? u8{2} : u8{0})
+                        | (((port2 & out_c_mask_) != u8{0}) ? u8{4} : u8{0})
+                        | (((port2 & out_d_mask_) != u8{0}) ? u8{8} : u8{0})),
+        (port2 & ds_mask_) != u8{0},
+        (port1 & ovfl_mask_) != u8{0},
+        (port1 & nml_mask_) != u8{0},
+        (port1 & rng_2_mask_) != u8{0}};
+  }
+
+  /// Contributions of the level of one port to the digit strobe and the BCD
+  /// digit, indexed by the level of the port.
+  struct Port_decoding_table {
+      Array<int8_t, 256> digit_strobe;
+      Array<int8_t, 256> out;
+  };
+
+  template <bool port1_>
+  constexpr Port_decoding_table make_port_decoding_table() {
+    auto table = Port_decoding_table{};
+    for (auto level = 0; level < 256; ++level) {
+      const auto port = static_cast<u8>(level);
+      const auto state = port1_ ? decode_signals_by_bits(port, port2_idle_)
+                                : decode_signals_by_bits(port1_idle_, port);
+      table.digit_strobe[level] = static_cast<int8_t>(state.digit_strobe);
+      table.out[level] = static_cast<int8_t>(state.out);
+    }
+    return table;
+  }
+
+  // These end up in flash (1 KiB in total).
+  inline constexpr auto port1_decoding_ = make_port_decoding_table<true>();
+  inline constexpr auto port2_decoding_ = make_port_decoding_table<false>();
+
+  /// \return The bus state corresponding to the levels sampled at the ports.
+  ///
+  /// Unless `port_decoding` selects `decode_signals_by_bits()`, digit strobe
+  /// and BCD digit are looked up per port, which replaces up to six tests
+  /// and branches for the strobe and four for the digit by two table reads
+  /// each. AS_1..AS_3 on port 1 take precedence over AS_4..AS_6 on port 2,
+  /// as in `decode_signals_by_bits()`.
+  inline Input_state decode_signals(const u8 port1, const u8 port2) {
+    if constexpr (port_decoding == Port_decoding::Bits) {
+      return decode_signals_by_bits(port1, port2);
+    } else {
+      const auto strobe = port1_decoding_.digit_strobe[to_integral(port1)];
+      return {static_cast<i8>(
+                  strobe != 0
+                      ? strobe
+                      : port2_decoding_.digit_strobe[to_integral(port2)]),
+              static_cast<i8>(port1_decoding_.out[to_integral(port1)]
+                              | port2_decoding_.out[to_integral(port2)]),
+              (port2 & ds_mask_) != u8{0},
+              (port1 & ovfl_mask_) != u8{0},
+              (port1 & nml_mask_) != u8{0},
+              (port1 & rng_2_mask_) != u8{0}};
+    }
+  }
+
+} // namespace dou
+
+#endif // BUS_HPP_
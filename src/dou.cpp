@@ -4,15 +4,12 @@
 
 namespace dou {
 
-  namespace {
-
-    constexpr auto unit_texts_ = Array<Array<char, max_unit_length>, 5>{
-        {{"ms"}, {"us"}, {"MHz"}, {"kHz"}, {""}}};
-
+  int print(char *const buffer, const Size buffer_length, const Unit unit) {
+    return print(buffer, buffer_length, unit_texts[to_integral(unit)]);
   }
 
-  int print(char *const buffer, const Size buffer_length, const Unit unit) {
-    return print(buffer, buffer_length, unit_texts_[to_integral(unit)]);
+  const char *unit_text(const Unit unit) {
+    return unit_texts[to_integral(unit)].data();
   }
 
 } // namespace dou
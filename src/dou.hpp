@@ -18,172 +18,1631 @@ namespace dou {
       bool rng_2;
   };
 
+  /// How the bits are put on the line.
+  enum class Serial_backend {
+    /// Every bit is written to the port from the timer interrupt.
+    Timer,
+    /// Whole frames are shifted out by the USI, clocked by the timer output.
+    /// Interrupts once per character. The USI drives P1.6 (SDO), so TX and
+    /// AS_3 must be swapped on the board.
+    Usi
+  };
+
+  constexpr auto serial_backend = Serial_backend::Timer;
+
+  /// How the digit strobes are captured while /MUP is low.
+  enum class Strobe_capture {
+    /// The main loop samples the ports as fast as it can.
+    Polling,
+    /// The rising edges of AS_1..AS_6 raise port interrupts, which sample the
+    /// ports. The main loop sleeps in between.
+    Edge
+  };
+
+  constexpr auto strobe_capture = Strobe_capture::Polling;
+
+  /// How the levels sampled at the ports are decoded, see
+  /// `decode_signals()`.
+  enum class Port_decoding {
+    /// Digit strobe and BCD digit are looked up in tables, which take 1 KiB
+    /// of flash.
+    Table,
+    /// Signal by signal, as `decode_signals_by_bits()`.
+    Bits
+  };
+
+  constexpr auto port_decoding = Port_decoding::Table;
+
+  /// How readings are represented on the line.
+  enum class Output_format {
+    /// A line of 7-bit ASCII such as `" 123.456MHz\r\n"`.
+    Text,
+    /// A `Binary_frame` of 8-bit bytes.
+    Binary,
+    /// A line of 7-bit ASCII with the value as an integer in the base unit
+    /// of its quantity, such as `" 00000123456000mHz\r\n"`, see
+    /// `format_scaled()`.
+    Scaled_text,
+    /// A `Scaled_frame` of 8-bit bytes.
+    Scaled_binary
+  };
+
+  constexpr auto output_format = Output_format::Text;
+
+  /// The powers of ten of the base units of frequencies in Hz and of periods
+  /// in s, in which scaled readings are given. These are multiples of 3 from
+  /// -15 to 6, so millihertz and picoseconds by default.
+  constexpr auto scaled_frequency_exponent = -3;
+  constexpr auto scaled_period_exponent = -12;
+
+  /// Whether and how readings are timestamped, see `Timestamp`.
+  enum class Timestamp_mode {
+    None,
+    /// The ticks at the end of the measurement window.
+    Absolute,
+    /// The ticks since the end of the window of the previous reading that
+    /// has been reported.
+    Delta
+  };
+
+  constexpr auto timestamp_mode = Timestamp_mode::None;
+
+  /// Rate at which the ticks of a `Timestamp` are counted.
+  constexpr auto timestamp_frequency_Hz = 16'000'000L;
+
+  /// Whether to measure the duration of the hot paths, see `Profiler`.
+  constexpr auto profiling = false;
+
+  /// Whether the host may send commands, see `Command_parser`. They are
+  /// received on RST/NMI, the only pin that the display bus leaves, and both
+  /// directions use 8N1, so that the output format can be switched at run
+  /// time.
+  constexpr auto command_input = false;
+
+  /// Number of readings that are summarized by the `Aggregator`, which is
+  /// then reported instead of the readings, or 0.
+  constexpr auto aggregate_readings = uint8_t{0};
+
+  /// Longest time in seconds that a summary of the `Aggregator` spans, or 0.
+  /// This requires the timer to run continuously.
+  constexpr auto aggregate_period_s = uint8_t{0};
+
+  constexpr auto aggregating = (aggregate_readings != 0)
+                               or (aggregate_period_s != 0);
+
+  /// `aggregate_period_s` in ticks of `timestamp_frequency_Hz`, computed in
+  /// 32 bits, which the `long` of the MSP430 would overflow for 135 s.
+  constexpr auto aggregate_period_ticks =
+      static_cast<uint32_t>(aggregate_period_s)
+      * static_cast<uint32_t>(timestamp_frequency_Hz);
+
+  static_assert(static_cast<long long>(aggregate_period_s)
+                        * timestamp_frequency_Hz
+                    < (1LL << 32),
+                "summaries must span less than the 268 s after which the "
+                "timestamps wrap around");
+
+  /// Timestamps, profiling, receiving and aggregating by time need the timer
+  /// to run continuously, which the USI backend cannot do.
+  constexpr auto free_running_timer = profiling
+                                      or (timestamp_mode
+                                          != Timestamp_mode::None)
+                                      or command_input
+                                      or (aggregate_period_s != 0);
+
+  /// Frequency of the DCO, which clocks the CPU and the timer.
+  constexpr auto smclk_frequency_Hz = 16'000'000;
+
+  /// Shortest duration of the digit strobes AS_6..AS_1 of the instrument.
+  constexpr auto min_strobe_width_ns = 200'000L;
+
+  /// Shortest duration between two digit strobes of the instrument. The
+  /// decoder needs a sample of the blanking after the LSD to finish a pass.
+  constexpr auto min_blanking_ns = 20'000L;
+
+  /// Longest time that an iteration of the main loop may take while /MUP is
+  /// low, including the interrupts that preempt it, so that each digit
+  /// strobe is sampled at least twice, and the blanking after the LSD at
+  /// least once. The latter is the tighter bound for the 1900A. Checked on
+  /// the instruction-set simulator by `dou_cycles --check`.
+  /// The durations are divided down first, as the products in ns would
+  /// overflow the 32-bit `long` of the MSP430.
+  constexpr auto max_poll_period_cycles = std::min(
+      smclk_frequency_Hz / 1'000 * (min_strobe_width_ns / 1'000) / 1'000 / 2,
+      smclk_frequency_Hz / 1'000 * (min_blanking_ns / 1'000) / 1'000);
+
+  static_assert((min_strobe_width_ns % 1'000 == 0)
+                    and (min_blanking_ns % 1'000 == 0),
+                "the durations are taken in whole microseconds");
+  static_assert((max_poll_period_cycles > 0)
+                    and (max_poll_period_cycles <= 0xffff),
+                "the budget must fit the 16-bit cycle counts of the timer");
+
   // The baud rate must be sufficient to transmit the whole measurement within
   // the /MUP period of approximately 100 ms.
-  constexpr auto serial_baud_rate = 19200; // bps
-  constexpr auto serial_data_bits = 7;
+  constexpr auto serial_baud_rate = serial_backend == Serial_backend::Usi
+                                        ? 115200L
+                                        : 19200L; // bps
+  constexpr auto serial_data_bits =
+      (output_format == Output_format::Binary)
+              or (output_format == Output_format::Scaled_binary)
+              or command_input
+          ? 8
+          : 7;
 
+  /// Start bit, data bits and stop bit.
+  constexpr auto serial_frame_bits = serial_data_bits + 2;
+
+  /// Number of characters that can be queued for transmission. This holds two
+  /// complete readings, so that a reading can be queued while the previous
+  /// one is still being shifted out. Timestamps make readings longer, and
+  /// when profiling, a `Profiler::Line` needs to fit in addition, as does an
+  /// `Aggregator::Line` when aggregating. Scaled readings take up to 20
+  /// characters.
+  constexpr auto serial_queue_size =
+      free_running_timer or aggregating
+              or (output_format == Output_format::Scaled_text)
+              or (output_format == Output_format::Scaled_binary)
+          ? 64
+          : 32;
+
+  /// Shifts characters out bit by bit.
+  ///
+  /// The main loop queues characters using `write()`, while the timer
+  /// interrupt fetches the bits to put on the line from `get_next_bit()`. The
+  /// two sides communicate through a `Ring_buffer` only, so that decoding of
+  /// the next reading can proceed while the previous one is being sent.
   class Serial_transmitter {
     public:
+      /// \return The frame for `value`, LSB first. All bits following the
+      /// start bit, data bits and stop bit are at mark level, so that a shift
+      /// register leaves the line idle after the frame.
+      static constexpr u16 make_frame(const char value) {
+        return (u16{static_cast<uint8_t>(value)} << 1U)
+               | (u16{0xffff} << (serial_data_bits + 1));
+      }
+
       void init_transmission(const char value) {
-        transmit_data_ = (static_cast<u16>(value) << 1U)
-                         | (u16{1} << (serial_data_bits + 1));
-        bits_to_transmit_ = serial_data_bits + 2;
+        transmit_data_ = make_frame(value);
+        bits_to_transmit_ = serial_frame_bits;
       }
 
       [[nodiscard]] bool transmit_complete() const {
         return bits_to_transmit_ <= 0;
       }
 
+      /// Queues all of `data` or, if there is not enough room, nothing.
+      ///
+      /// \return Whether the characters have been queued.
+      bool write(const char *const data, const Size length) {
+        if (length > queue_.available()) {
+          return false;
+        }
+        for (auto i = Size{0}; i < length; ++i) {
+          queue_.push(data[i]);
+        }
+        return true;
+      }
+
+      /// Whether there are no more bits to transmit.
+      [[nodiscard]] bool is_idle() const {
+        return transmit_complete() and queue_.empty();
+      }
+
+      /// Called once per bit period, typically from an interrupt. Fetches the
+      /// next character from the queue after the stop bit has been sent.
+      ///
+      /// \return `false`, if the line is idle.
       [[nodiscard]] bool get_next_bit(u8 &bit_to_transmit) {
-        if (not transmit_complete()) {
-          bit_to_transmit = transmit_data_ & u8{1};
+        if (transmit_complete()) {
+          auto character = char{};
+          if (not queue_.pop(character)) {
+            return false;
+          }
+          init_transmission(character);
+        }
 
-          transmit_data_ = transmit_data_ >> 1U;
-          bits_to_transmit_ = static_cast<int_fast8_t>(bits_to_transmit_ - 1);
+        bit_to_transmit = transmit_data_ & u8{1};
 
-          return true;
+        transmit_data_ = transmit_data_ >> 1U;
+        bits_to_transmit_ = static_cast<int_fast8_t>(bits_to_transmit_ - 1);
+
+        return true;
+      }
+
+      /// Called once per frame by a shift register backend, instead of
+      /// `get_next_bit()`.
+      ///
+      /// \return `false`, if the line is idle.
+      [[nodiscard]] bool get_next_frame(u16 &frame) {
+        auto character = char{};
+        if (not queue_.pop(character)) {
+          return false;
         }
-        return false;
+        frame = make_frame(character);
+        return true;
       }
 
     private:
+      Ring_buffer<char, serial_queue_size> queue_{};
       u16 transmit_data_{};
       int_fast8_t bits_to_transmit_{0};
   };
 
+  /// Receives characters in frames of `serial_frame_bits` from the times of
+  /// the edges on the line, as the level of the input cannot be read.
+  ///
+  /// The interrupt on each edge calls `edge()` with the count of the
+  /// free-running timer. Once a frame has started, the timer interrupt
+  /// calls `end_frame()` at `frame_end()`, in the middle of the stop bit.
+  /// The main loop fetches the received characters with `read()`.
+  ///    The level is only known by counting edges, so a missed edge would
+  /// invert it. Therefore, the line is taken to be idle again at the end of
+  /// each frame, and the interrupt waits for the falling edge of the next
+  /// start bit. After a missed edge or a break, this loses at most the
+  /// characters up to the next pause.
+  class Serial_receiver {
+    public:
+      explicit constexpr Serial_receiver(const uint16_t bit_ticks)
+          : bit_ticks_{bit_ticks} {}
+
+      /// \return Whether the edge at `ticks` has started a frame, whose end
+      /// is then to be scheduled.
+      bool edge(const uint16_t ticks) {
+        if (in_frame_) {
+          // the bits up to the edge have the previous level
+          while ((bits_ < samples_per_frame_)
+                 and (static_cast<int16_t>(ticks - next_sample_) > 0)) {
+            sample();
+          }
+        }
+        mark_ = not mark_;
+        if (in_frame_ or mark_) {
+          return false;
+        }
+        in_frame_ = true;
+        bits_ = 0;
+        next_sample_ = static_cast<uint16_t>(ticks + bit_ticks_
+                                             + (bit_ticks_ / 2));
+        frame_end_ = static_cast<uint16_t>(
+            next_sample_ + (samples_per_frame_ - 1) * bit_ticks_);
+        return true;
+      }
+
+      [[nodiscard]] uint16_t frame_end() const { return frame_end_; }
+
+      /// Whether the line is idle or sends a one, i.e., the edge to expect
+      /// next is the falling edge of a start bit or of a zero.
+      [[nodiscard]] bool is_mark() const { return mark_; }
+
+      /// Samples the rest of the frame, including the stop bit, and takes
+      /// the line to be idle from then on.
+      ///
+      /// \return Whether a character has been received, which is dropped
+      /// if the stop bit is missing or if the queue is full.
+      bool end_frame() {
+        while (bits_ < samples_per_frame_) {
+          sample();
+        }
+        in_frame_ = false;
+        mark_ = true;
+        if ((data_ & stop_bit_) == 0) {
+          return false;
+        }
+        return queue_.push(static_cast<char>(data_ & (stop_bit_ - 1)));
+      }
+
+      /// Called by the main loop.
+      bool read(char &character) { return queue_.pop(character); }
+
+      [[nodiscard]] bool empty() const { return queue_.empty(); }
+
+    private:
+      /// Data bits and stop bit, LSB first.
+      static constexpr auto samples_per_frame_ = serial_frame_bits - 1;
+      static constexpr auto stop_bit_ = uint16_t{1U << serial_data_bits};
+
+      void sample() {
+        data_ = static_cast<uint16_t>((data_ >> 1U) | (mark_ ? stop_bit_ : 0));
+        next_sample_ = static_cast<uint16_t>(next_sample_ + bit_ticks_);
+        ++bits_;
+      }
+
+      Ring_buffer<char, 8> queue_{};
+      uint16_t bit_ticks_;
+      uint16_t next_sample_{0};
+      uint16_t frame_end_{0};
+      uint16_t data_{0};
+      uint8_t bits_{0};
+      bool mark_{true};
+      bool in_frame_{false};
+  };
+
   enum class Unit { ms, us, MHz, kHz, None };
 
+  /// Including the terminating zero.
+  constexpr auto max_unit_length = 4;
+
+  /// The text of each `Unit`, indexed by it.
+  using Unit_texts = Array<Array<char, max_unit_length>, 5>;
+
+  /// Describes the display bus of the Fluke 1900A, which the board is made
+  /// for. Other instruments, such as those of the 1910A series, are
+  /// described by types with the same members, which `Basic_bus_decoder`
+  /// and `Basic_reading` are instantiated with.
+  struct Fluke_1900a {
+      /// Number of digit strobes, AS_1 (LSD) to AS_6 (MSD).
+      static constexpr auto digits = 6;
+
+      /// Whether the digit strobes are high while asserted.
+      static constexpr auto strobes_active_high = true;
+
+      /// \return The unit given by the range signals. Without a decimal
+      /// point, the counter is totalizing events.
+      static constexpr Unit unit(const bool nml, const bool rng_2,
+                                 const bool has_decimal_point) {
+        if (not has_decimal_point) {
+          return Unit::None;
+        }
+        const auto bcd = (rng_2 ? u8{2} : u8{0}) | (nml ? u8{1} : u8{0});
+        return static_cast<Unit>(bcd);
+      }
+
+      static constexpr auto unit_texts = Unit_texts{
+          {{"ms"}, {"us"}, {"MHz"}, {"kHz"}, {""}}};
+  };
+
+  /// The instrument that the DOU is connected to.
+  using Instrument = Fluke_1900a;
+
   constexpr Unit get_unit(const bool nml, const bool rng_2,
                           const bool has_decimal_point) {
-    if (not has_decimal_point) {
-      return Unit::None;
-    }
-    const auto bcd = (rng_2 ? u8{2} : u8{0}) | (nml ? u8{1} : u8{0});
-    return static_cast<Unit>(bcd);
+    return Instrument::unit(nml, rng_2, has_decimal_point);
   }
 
   int print(char *buffer, Size buffer_length, Unit unit);
 
-  constexpr auto max_unit_length = 4;
+  /// \return The text that is appended to readings in `unit`.
+  const char *unit_text(Unit unit);
+
+  inline constexpr const auto &unit_texts = Instrument::unit_texts;
+
+  /// The end of a textual reading, i.e., the unit and the line ending.
+  struct Reading_suffix {
+      /// Zero-terminated.
+      Array<char, max_unit_length + 2> text;
+      /// Excluding the terminating zero.
+      Size length;
+  };
+
+  /// \return The suffixes of readings in each `Unit`, indexed by it.
+  constexpr Array<Reading_suffix, 5>
+  make_reading_suffixes(const Unit_texts &texts) {
+    auto suffixes = Array<Reading_suffix, 5>{};
+    for (auto unit = 0; unit < suffixes.size(); ++unit) {
+      auto &suffix = suffixes[unit];
+      auto length = Size{0};
+      for (const auto character : texts[unit]) {
+        if (character == '\0') {
+          break;
+        }
+        suffix.text[length++] = character;
+      }
+      suffix.text[length++] = '\r';
+      suffix.text[length++] = '\n';
+      suffix.length = length;
+    }
+    return suffixes;
+  }
+
+  template <typename Instrument_>
+  inline constexpr auto reading_suffixes_of =
+      make_reading_suffixes(Instrument_::unit_texts);
+
+  inline constexpr const auto &reading_suffixes =
+      reading_suffixes_of<Instrument>;
 
-  constexpr auto number_of_digits = 6;
+  constexpr auto number_of_digits = Instrument::digits;
 
-  enum class Data_state {
+  /// \return The length of a textual reading: the overflow indicator, the
+  /// digits, the decimal point, if any, and the suffix.
+  template <typename Instrument_ = Instrument>
+  constexpr Size text_length(const i8 decimal_point_digit, const Unit unit) {
+    return 1 + Instrument_::digits + (decimal_point_digit != 0 ? 1 : 0)
+           + reading_suffixes_of<Instrument_>[to_integral(unit)].length;
+  }
+
+  /// The state of `Basic_bus_decoder`: waiting for the MSD, capturing the
+  /// digit of a strobe (see `digit_state()`), or taking the overflow and
+  /// range signals after the LSD. The digits of six-digit instruments are
+  /// named, those of wider ones only have `digit_state()`.
+  enum class Data_state : int8_t {
+    Init = -1,
     OverflowUnit = 0,
     Digit1,
     Digit2,
     Digit3,
     Digit4,
     Digit5,
-    Digit6,
-    Init
+    Digit6
   };
 
+  /// \return The state of capturing the digit of `digit_strobe`, from 1 for
+  /// the LSD up to the number of digits for the MSD.
+  constexpr Data_state digit_state(const int digit_strobe) {
+    return static_cast<Data_state>(digit_strobe);
+  }
+
   constexpr inline Data_state operator-(const Data_state lhs, const int rhs) {
     return static_cast<Data_state>(to_integral(lhs) - rhs);
   }
 
-  /// Decodes the display bus of the Fluke 1900A.
+  /// The contents of the display of `Instrument_`, as captured from the bus.
+  template <typename Instrument_> struct Basic_reading {
+      static_assert((Instrument_::digits > 0) and (Instrument_::digits <= 9),
+                    "the digits must fit the 32 bits of `counts()`");
+
+      /// Packed BCD, with the most significant digit in the upper nibble of
+      /// the first byte, preceded by a zero for an odd number of digits.
+      Array<uint8_t, (Instrument_::digits + 1) / 2> bcd;
+      /// The digit (as in `digit_state()`) that is preceded by the decimal
+      /// point, or 0 if there is none.
+      i8 decimal_point_digit;
+      bool overflow;
+      bool nml;
+      bool rng_2;
+
+      [[nodiscard]] constexpr i8 digit(const i8 digit_strobe) const {
+        const auto position = (2 * bcd.size()) - digit_strobe;
+        const auto byte = bcd[position / 2];
+        return static_cast<i8>((position % 2) == 0 ? (byte >> 4U)
+                                                   : (byte & 0x0fU));
+      }
+
+      constexpr void set_digit(const i8 digit_strobe, const i8 value) {
+        const auto position = (2 * bcd.size()) - digit_strobe;
+        auto &byte = bcd[position / 2];
+        if ((position % 2) == 0) {
+          byte = static_cast<uint8_t>((byte & 0x0fU)
+                                      | (static_cast<unsigned>(value) << 4U));
+        } else {
+          byte = static_cast<uint8_t>((byte & 0xf0U)
+                                      | (static_cast<unsigned>(value) & 0x0fU));
+        }
+      }
+
+      [[nodiscard]] constexpr Unit unit() const {
+        return Instrument_::unit(nml, rng_2, decimal_point_digit != 0);
+      }
+
+      /// \return The digits as an integer, disregarding the decimal point.
+      [[nodiscard]] constexpr int32_t counts() const {
+        auto value = int32_t{0};
+        for (const auto byte : bcd) {
+          value = (value * 100) + ((byte >> 4) * 10) + (byte & 0x0f);
+        }
+        return value;
+      }
+
+      constexpr bool operator==(const Basic_reading &rhs) const {
+        return std::equal(bcd.begin(), bcd.end(), rhs.bcd.begin())
+               and (decimal_point_digit == rhs.decimal_point_digit)
+               and (overflow == rhs.overflow) and (nml == rhs.nml)
+               and (rng_2 == rhs.rng_2);
+      }
+  };
+
+  using Reading = Basic_reading<Instrument>;
+
+  /// Compact alternative to the textual representation of a reading:
   ///
-  /// Initially, the FSM waits for the `AS_6` strobe, indicating the most
-  /// significant digit (MSD). This ensures that decoding starts with the first
-  /// complete block of digits (MSD..LSD) while /MUP is low.
-  ///    For each strobe, the corresponding digit is captured and appended to
-  /// the reading. If the decimal strobe is asserted during a digit strobe, the
-  /// decimal point is prepended to the digit.
+  /// | byte | contents                                                   |
+  /// |------|------------------------------------------------------------|
+  /// | 0    | `binary_frame_sync`                                        |
+  /// | 1..3 | `Reading::bcd`                                             |
+  /// | 4    | decimal point digit (bits 0..2), overflow (3), NML (4) and |
+  /// |      | RNG_2 (5)                                                  |
+  /// | 5    | CRC-8 (polynomial 0x07) of bytes 1..4                      |
+  ///
+  /// The sync byte cannot occur in bytes 1..4, so a receiver can
+  /// resynchronize by searching for it and checking the CRC.
+  using Binary_frame = Array<uint8_t, 6>;
+
+  static_assert(Reading{}.bcd.size() == 3,
+                "a `Binary_frame` holds the BCD of exactly six digits");
+
+  constexpr auto binary_frame_sync = uint8_t{0xa5};
+
+  /// \return The decimal point digit (bits 0..2), overflow (3), NML (4) and
+  /// RNG_2 (5) of `reading`.
+  constexpr uint8_t encode_flags(const Reading &reading) {
+    return static_cast<uint8_t>(reading.decimal_point_digit
+                                | (reading.overflow ? 0x08 : 0)
+                                | (reading.nml ? 0x10 : 0)
+                                | (reading.rng_2 ? 0x20 : 0));
+  }
+
+  constexpr Binary_frame encode(const Reading &reading) {
+    auto frame = Binary_frame{{binary_frame_sync, reading.bcd[0],
+                               reading.bcd[1], reading.bcd[2],
+                               encode_flags(reading), 0}};
+    frame.back() = crc8(&frame[1], frame.size() - 2);
+    return frame;
+  }
+
+  /// \return Whether `frame` holds a valid reading, which is then stored in
+  /// `reading`.
+  constexpr bool decode(const Binary_frame &frame, Reading &reading) {
+    if ((frame[0] != binary_frame_sync)
+        or (crc8(&frame[1], frame.size() - 2) != frame.back())) {
+      return false;
+    }
+    for (auto i = 1; i <= 3; ++i) {
+      if (((frame[i] >> 4U) > 9U) or ((frame[i] & 0x0fU) > 9U)) {
+        return false;
+      }
+    }
+    const auto flags = frame[4];
+    if (((flags & 0x07U) > number_of_digits) or ((flags & 0xc0U) != 0U)) {
+      return false;
+    }
+    reading = {{{frame[1], frame[2], frame[3]}},
+               static_cast<i8>(flags & 0x07U),
+               (flags & 0x08U) != 0U,
+               (flags & 0x10U) != 0U,
+               (flags & 0x20U) != 0U};
+    return true;
+  }
+
+  /// \return The majority of `a`, `b` and `c`, separately for each nibble.
+  /// Where all three differ, the nibble of `a` is taken and `has_majority` is
+  /// cleared.
+  constexpr uint8_t majority(const uint8_t a, const uint8_t b, const uint8_t c,
+                             bool &has_majority) {
+    auto result = 0U;
+    for (auto shift = 0U; shift < 8U; shift += 4U) {
+      const auto mask = 0x0fU << shift;
+      const auto a_nibble = a & mask;
+      const auto b_nibble = b & mask;
+      if ((a_nibble == b_nibble) or (a_nibble == (c & mask))) {
+        result |= a_nibble;
+      } else if (b_nibble == (c & mask)) {
+        result |= b_nibble;
+      } else {
+        result |= a_nibble;
+        has_majority = false;
+      }
+    }
+    return static_cast<uint8_t>(result);
+  }
+
+  /// The time of a reading in ticks of `timestamp_frequency_Hz`, which wrap
+  /// around after about 268 s.
+  struct Timestamp {
+      uint32_t ticks;
+      Timestamp_mode mode;
+  };
+
+  /// Length of the text of a `Timestamp` as appended to a reading, e.g.,
+  /// `" @0123abcd"` for absolute and `" +00186a00"` for delta ticks.
+  constexpr auto timestamp_text_length = 10;
+
+  constexpr void format_timestamp(char *const text,
+                                  const Timestamp &timestamp) {
+    text[0] = ' ';
+    text[1] = timestamp.mode == Timestamp_mode::Delta ? '+' : '@';
+    format_hex(&text[2], static_cast<uint16_t>(timestamp.ticks >> 16U), 4);
+    format_hex(&text[6], static_cast<uint16_t>(timestamp.ticks), 4);
+  }
+
+  /// A `Binary_frame` that is extended by a `Timestamp`:
+  ///
+  /// | byte  | contents                                               |
+  /// |-------|--------------------------------------------------------|
+  /// | 0     | `timestamped_frame_sync`                               |
+  /// | 1..4  | as in `Binary_frame`, with bit 6 of byte 4 set for     |
+  /// |       | delta ticks                                            |
+  /// | 5..9  | ticks, 7 bits per byte (4 in byte 5), most significant |
+  /// |       | first                                                  |
+  /// | 10    | CRC-8 (polynomial 0x07) of bytes 1..9                  |
+  ///
+  /// Neither sync byte can occur in bytes 1..9.
+  using Timestamped_frame = Array<uint8_t, 11>;
+
+  constexpr auto timestamped_frame_sync = uint8_t{0xa6};
+
+  constexpr Timestamped_frame encode(const Reading &reading,
+                                     const Timestamp &timestamp) {
+    const auto plain = encode(reading);
+    auto frame = Timestamped_frame{
+        {timestamped_frame_sync, plain[1], plain[2], plain[3],
+         static_cast<uint8_t>(
+             plain[4] | (timestamp.mode == Timestamp_mode::Delta ? 0x40 : 0))}};
+    for (auto i = 0; i < 5; ++i) {
+      frame[5 + i] = static_cast<uint8_t>(
+          (timestamp.ticks >> (7 * (4 - i))) & 0x7fU);
+    }
+    frame.back() = crc8(&frame[1], frame.size() - 2);
+    return frame;
+  }
+
+  /// \return Whether `frame` holds a valid reading, which is then stored in
+  /// `reading` and `timestamp`.
+  constexpr bool decode(const Timestamped_frame &frame, Reading &reading,
+                        Timestamp &timestamp) {
+    if ((frame[0] != timestamped_frame_sync)
+        or (crc8(&frame[1], frame.size() - 2) != frame.back())) {
+      return false;
+    }
+    auto plain = Binary_frame{{binary_frame_sync, frame[1], frame[2],
+                               frame[3],
+                               static_cast<uint8_t>(frame[4] & ~0x40U), 0}};
+    plain.back() = crc8(&plain[1], plain.size() - 2);
+    if (not decode(plain, reading)) {
+      return false;
+    }
+    if (frame[5] > 0x0fU) {
+      return false;
+    }
+    auto ticks = uint32_t{0};
+    for (auto i = 0; i < 5; ++i) {
+      if ((frame[5 + i] & 0x80U) != 0U) {
+        return false;
+      }
+      ticks = (ticks << 7U) | frame[5 + i];
+    }
+    timestamp = {ticks, (frame[4] & 0x40U) != 0U ? Timestamp_mode::Delta
+                                                  : Timestamp_mode::Absolute};
+    return true;
+  }
+
+  /// \return The power of ten of `unit` in Hz, s or counts.
+  constexpr int unit_exponent(const Unit unit) {
+    switch (unit) {
+    case Unit::ms:
+      return -3;
+    case Unit::us:
+      return -6;
+    case Unit::MHz:
+      return 6;
+    case Unit::kHz:
+      return 3;
+    case Unit::None:
+      break;
+    }
+    return 0;
+  }
+
+  /// \return The power of ten of the base unit of scaled readings in `unit`.
+  constexpr int scaled_exponent(const Unit unit) {
+    switch (unit) {
+    case Unit::ms:
+    case Unit::us:
+      return scaled_period_exponent;
+    case Unit::MHz:
+    case Unit::kHz:
+      return scaled_frequency_exponent;
+    case Unit::None:
+      break;
+    }
+    return 0;
+  }
+
+  /// \return The power of ten by which the digits of a reading are scaled,
+  /// which is negative, if digits are dropped.
+  constexpr int scaled_shift(const Reading &reading) {
+    const auto unit = reading.unit();
+    return unit_exponent(unit) - reading.decimal_point_digit
+           - scaled_exponent(unit);
+  }
+
+  /// \return The number of digits of the value of scaled readings, which
+  /// have at least one decimal in any unit other than `Unit::None`.
+  constexpr int make_scaled_digits() {
+    auto digits = number_of_digits;
+    for (const auto unit : {Unit::ms, Unit::us, Unit::MHz, Unit::kHz}) {
+      digits = std::max(digits, number_of_digits + unit_exponent(unit) - 1
+                                    - scaled_exponent(unit));
+    }
+    return digits;
+  }
+
+  constexpr auto scaled_digits = make_scaled_digits();
+
+  static_assert(scaled_digits <= 14,
+                "scaled readings would not fit into a Scaled_frame");
+
+  /// \return The SI prefix of `exponent`, or '\0'.
+  constexpr char si_prefix(const int exponent) {
+    switch (exponent) {
+    case -15:
+      return 'f';
+    case -12:
+      return 'p';
+    case -9:
+      return 'n';
+    case -6:
+      return 'u';
+    case -3:
+      return 'm';
+    case 3:
+      return 'k';
+    case 6:
+      return 'M';
+    default:
+      return '\0';
+    }
+  }
+
+  static_assert(((scaled_frequency_exponent == 0)
+                 or (si_prefix(scaled_frequency_exponent) != '\0'))
+                    and ((scaled_period_exponent == 0)
+                         or (si_prefix(scaled_period_exponent) != '\0')),
+                "the base units need to be multiples of 3 from -15 to 6");
+
+  /// \return The suffixes of scaled readings in each `Unit`, indexed by it.
+  constexpr Array<Reading_suffix, 5> make_scaled_suffixes() {
+    auto suffixes = Array<Reading_suffix, 5>{};
+    for (auto unit = 0; unit < suffixes.size(); ++unit) {
+      auto &suffix = suffixes[unit];
+      auto length = Size{0};
+      const auto exponent = scaled_exponent(static_cast<Unit>(unit));
+      if (si_prefix(exponent) != '\0') {
+        suffix.text[length++] = si_prefix(exponent);
+      }
+      if (unit_exponent(static_cast<Unit>(unit)) < 0) {
+        suffix.text[length++] = 's';
+      } else if (unit_exponent(static_cast<Unit>(unit)) > 0) {
+        suffix.text[length++] = 'H';
+        suffix.text[length++] = 'z';
+      }
+      suffix.text[length++] = '\r';
+      suffix.text[length++] = '\n';
+      suffix.length = length;
+    }
+    return suffixes;
+  }
+
+  inline constexpr auto scaled_suffixes = make_scaled_suffixes();
+
+  /// Writes the digits of `reading` times 10^`shift`, which is the value in
+  /// the base unit of its quantity for `scaled_shift()`, as `scaled_digits`
+  /// decimal digits with leading zeros, rounded to nearest. `shift` must not
+  /// exceed `scaled_digits - number_of_digits`.
+  ///
+  /// The digits are shifted and rounded as BCD, so that neither
+  /// multiplication nor division is needed.
+  constexpr void format_scaled_digits(char *const text, const Reading &reading,
+                                      const int shift) {
+    for (auto i = 0; i < scaled_digits; ++i) {
+      text[i] = '0';
+    }
+    // the digit of AS_1 goes right before `end`
+    const auto end = scaled_digits - shift;
+    auto carry = (shift < 0) and (-shift <= number_of_digits)
+                 and (reading.digit(static_cast<i8>(-shift)) >= 5);
+    for (auto strobe = i8{1}; strobe <= number_of_digits; ++strobe) {
+      const auto position = end - strobe;
+      if (position >= scaled_digits) {
+        continue;
+      }
+      const auto digit = reading.digit(strobe) + (carry ? 1 : 0);
+      carry = digit == 10;
+      text[position] = static_cast<char>('0' + (carry ? 0 : digit));
+    }
+    if (carry) {
+      text[end - number_of_digits - 1] = '1';
+    }
+  }
+
+  /// The length of the longest scaled reading as text, i.e., the overflow
+  /// indicator, the digits, the suffix and a terminating zero.
+  constexpr auto max_scaled_text_size = 1 + scaled_digits + max_unit_length
+                                        + 2;
+
+  /// Writes `reading` as text in `Output_format::Scaled_text`, including the
+  /// line ending and a terminating zero.
+  ///
+  /// \return The length of the text, excluding the terminating zero.
+  constexpr Size format_scaled(char *const text, const Reading &reading) {
+    text[0] = reading.overflow ? '>' : ' ';
+    format_scaled_digits(&text[1], reading, scaled_shift(reading));
+    const auto &suffix = scaled_suffixes[to_integral(reading.unit())];
+    std::copy_n(suffix.text.data(), suffix.length + 1,
+                &text[1 + scaled_digits]);
+    return 1 + scaled_digits + suffix.length;
+  }
+
+  /// \return The value of `reading` in the base unit of its quantity,
+  /// rounded to nearest.
+  constexpr uint64_t scaled_value(const Reading &reading) {
+    auto digits = Array<char, scaled_digits>{};
+    format_scaled_digits(digits.data(), reading, scaled_shift(reading));
+    auto value = uint64_t{0};
+    for (const auto digit : digits) {
+      // times ten, without a multiplier
+      value = (value << 3U) + (value << 1U)
+              + static_cast<uint64_t>(digit - '0');
+    }
+    return value;
+  }
+
+  /// A reading as an integer in the base unit of its quantity:
+  ///
+  /// | byte | contents                                                 |
+  /// |------|----------------------------------------------------------|
+  /// | 0    | `scaled_frame_sync`                                      |
+  /// | 1    | `Unit` (bits 0..2) and overflow (3)                      |
+  /// | 2..8 | the value in units of 10^`scaled_frequency_exponent` Hz, |
+  /// |      | 10^`scaled_period_exponent` s or counts, 7 bits per      |
+  /// |      | byte, most significant first                             |
+  /// | 9    | CRC-8 (polynomial 0x07) of bytes 1..8                    |
+  ///
+  /// As with the other frames, the sync byte cannot occur in bytes 1..8.
+  using Scaled_frame = Array<uint8_t, 10>;
+
+  constexpr auto scaled_frame_sync = uint8_t{0xa7};
+
+  /// The contents of a `Scaled_frame`.
+  struct Scaled_reading {
+      uint64_t value;
+      Unit unit;
+      bool overflow;
+  };
+
+  constexpr Scaled_frame encode_scaled(const Reading &reading) {
+    const auto value = scaled_value(reading);
+    auto frame = Scaled_frame{
+        {scaled_frame_sync,
+         static_cast<uint8_t>(to_integral(reading.unit())
+                              | (reading.overflow ? 0x08 : 0))}};
+    for (auto i = 0; i < 7; ++i) {
+      frame[2 + i] = static_cast<uint8_t>((value >> (7 * (6 - i))) & 0x7fU);
+    }
+    frame.back() = crc8(&frame[1], frame.size() - 2);
+    return frame;
+  }
+
+  /// \return Whether `frame` holds a valid reading, which is then stored in
+  /// `reading`.
+  constexpr bool decode(const Scaled_frame &frame, Scaled_reading &reading) {
+    if ((frame[0] != scaled_frame_sync)
+        or (crc8(&frame[1], frame.size() - 2) != frame.back())
+        or ((frame[1] & 0x07U) > to_integral(Unit::None))
+        or ((frame[1] & 0xf0U) != 0U)) {
+      return false;
+    }
+    auto value = uint64_t{0};
+    for (auto i = 0; i < 7; ++i) {
+      if ((frame[2 + i] & 0x80U) != 0U) {
+        return false;
+      }
+      value = (value << 7U) | frame[2 + i];
+    }
+    reading = {value, static_cast<Unit>(frame[1] & 0x07U),
+               (frame[1] & 0x08U) != 0U};
+    return true;
+  }
+
+  /// The outcome of one measurement window, as taken by
+  /// `Basic_bus_decoder`.
+  template <typename Instrument_> struct Basic_capture {
+      static constexpr auto max_text_size = Instrument_::digits
+                                            + 1 // overflow indicator
+                                            + 1 // decimal point
+                                            + max_unit_length
+                                            + 2 // line ending
+                                            + 1 // terminating zero
+          ;
+
+      /// The digits and flags, which are only valid if `complete`.
+      Basic_reading<Instrument_> reading{};
+      /// `reading` as zero-terminated text, ending in the line ending.
+      Array<char, max_text_size> text{""};
+      /// The length of `text`.
+      uint8_t length{0};
+      bool complete{false};
+      bool confident{false};
+  };
+
+  using Capture = Basic_capture<Instrument>;
+
+  /// Decodes the display bus of `Instrument_`, see `Fluke_1900a`.
+  ///
+  /// Initially, the FSM waits for the strobe of the most significant digit
+  /// (MSD). This ensures that decoding starts with the first complete block
+  /// of digits (MSD..LSD) while /MUP is low.
+  ///    For each strobe, the corresponding digit is captured. If the decimal
+  /// strobe is asserted during a digit strobe, the decimal point is prepended
+  /// to the digit.
   ///    Once the least significant digit has been captured, the overflow status
   /// and range signals are evaluated and the reading is marked as complete.
   /// Only complete readings are returned. This prevents erroneous readings,
   /// which can occur due to glitches that appear on the bus when actuating
   /// front panel switches.
-  ///    The decoder allows multiple passes (MSD..LSD) and always updates the
-  /// reading with the digits from the latest pass.
-  class Bus_decoder {
+  ///    The decoder allows multiple passes (MSD..LSD). Each complete pass
+  /// updates the reading, with the digits and decimal point voted by the
+  /// latest three passes. Thus, a single pass that has been corrupted by a
+  /// glitch is outvoted, while with up to two passes, the latest one is
+  /// taken. A pass that is cut short by the end of /MUP does not affect the
+  /// reading.
+  ///    The state is the number of the strobe whose digit is being captured,
+  /// so that the same few comparisons serve any number of digits.
+  template <typename Instrument_> class Basic_bus_decoder {
     public:
+      using Reading = Basic_reading<Instrument_>;
+      using Capture = Basic_capture<Instrument_>;
+
       Data_state state() const { return state_; }
-      bool is_complete() const { return complete_; }
-      bool has_decimal_point() const { return decimal_point_digit_ != 0; }
+      bool is_complete() const { return capture().complete; }
+      bool has_decimal_point() const {
+        return capture().reading.decimal_point_digit != 0;
+      }
+
+      /// \return The digits and flags of the reading, which are only valid
+      /// if the reading `is_complete()`.
+      const Reading &captured() const { return capture().reading; }
+
+      /// \return Whether every digit and the decimal point have been backed
+      /// by a majority of the passes, i.e., the passes have not disagreed
+      /// without a majority.
+      bool is_confident() const { return capture().confident; }
 
-      const char *reading() {
-        if (complete_) {
-          return reading_.data();
+      /// \return The number of digit strobes during a pass that were neither
+      /// the current nor the next one, saturating at 0xff.
+      uint8_t out_of_sequence() const { return out_of_sequence_; }
+
+      /// \return The reading as zero-terminated text, which is empty unless
+      /// the reading `is_complete()`.
+      const char *reading() const {
+        if (capture().complete) {
+          return capture().text.data();
         }
         return "";
       }
 
-      void transit(const Input_state &inp) {
-        switch (state_) {
-        case Data_state::Init:
-          if (inp.digit_strobe == to_integral(Data_state::Digit6)) {
-            decimal_point_digit_ = 0;
-            state_ = Data_state::Digit6;
-          }
-          break;
+      /// \return The length of `reading()`.
+      Size reading_length() const {
+        return capture().complete ? capture().length : 0;
+      }
+
+      /// \return The outcome of the current measurement window, which is
+      /// final once the window has ended, and valid until `start_window()`.
+      ///    The reading is sent from here before decoding resumes, so it is
+      /// not copied.
+      const Capture &window() const { return capture_; }
 
-        case Data_state::Digit6:
-        case Data_state::Digit5:
-        case Data_state::Digit4:
-        case Data_state::Digit3:
-        case Data_state::Digit2:
-        case Data_state::Digit1:
+      /// Starts decoding the next measurement window.
+      void start_window() {
+        capture_.complete = false;
+        capture_.confident = false;
+        state_ = Data_state::Init;
+        out_of_sequence_ = 0;
+        previous_passes_ = 0;
+      }
+
+      /// Processes the only sample of a digit strobe, which has been taken
+      /// at its rising edge. This is equivalent to the sample being seen
+      /// twice by `transit()`, followed by the blanking after the LSD.
+      void latch(const Input_state &inp) {
+        transit(inp);
+        transit(inp);
+        if (inp.digit_strobe == to_integral(digit_state(1))) {
+          auto blanking = inp;
+          blanking.digit_strobe = 0;
+          transit(blanking);
+          transit(blanking);
+        }
+      }
+
+      void transit(const Input_state &inp) {
+        if (state_ > Data_state::OverflowUnit) {
           if (inp.digit_strobe == to_integral(state_)) {
             if (inp.decimal_strobe) {
-              decimal_point_digit_ = inp.digit_strobe;
+              pass_.decimal_point_digit = inp.digit_strobe;
             }
-            set_digit(inp.digit_strobe, inp.out);
+            pass_.set_digit(inp.digit_strobe, inp.out);
           } else if (inp.digit_strobe == to_integral(state_ - 1)) {
             state_ = state_ - 1;
+          } else if ((inp.digit_strobe != 0) and (out_of_sequence_ != 0xff)) {
+            ++out_of_sequence_;
           }
-          break;
-
-        case Data_state::OverflowUnit:
-          set_overflow(inp.overflow);
-          set_unit(get_unit(inp.nml, inp.rng_2, has_decimal_point()));
-          complete_ = true;
+        } else if (state_ == Data_state::Init) {
+          if (inp.digit_strobe == msd_) {
+            // The MSD may be sampled only once, so its digit is taken here.
+            pass_.decimal_point_digit = inp.decimal_strobe ? msd_ : 0;
+            pass_.set_digit(msd_, inp.out);
+            state_ = digit_state(msd_);
+          }
+        } else {
+          pass_.overflow = inp.overflow;
+          pass_.nml = inp.nml;
+          pass_.rng_2 = inp.rng_2;
+          capture().reading = pass_;
+          vote();
+          render();
+          capture().complete = true;
           state_ = Data_state::Init;
-          break;
         }
       }
 
     private:
-      int get_index(const i8 digit_strobe) const {
-        return number_of_digits + 1 + (has_decimal_point() ? 1 : 0)
-               - digit_strobe;
+      static constexpr auto msd_ = Instrument_::digits;
+
+      /// Number of bytes of packed BCD.
+      static constexpr auto bcd_size_ = Reading{}.bcd.size();
+
+      Capture &capture() { return capture_; }
+      const Capture &capture() const { return capture_; }
+
+      /// The digits and decimal point of one pass, nibble-packed.
+      using Votes = Array<uint8_t, bcd_size_ + 1>;
+
+      /// Replaces the digits and decimal point of the captured reading by
+      /// the majority of the latest three passes, and keeps the current pass
+      /// for the following votes.
+      void vote() {
+        auto current = Votes{};
+        std::copy_n(pass_.bcd.begin(), bcd_size_, current.begin());
+        current.back() = static_cast<uint8_t>(pass_.decimal_point_digit);
+        auto &captured = capture();
+        captured.confident = true;
+        if (previous_passes_ == 1) {
+          captured.confident = std::equal(current.begin(), current.end(),
+                                  history_[0].begin());
+        } else if (previous_passes_ == 2) {
+          auto voted = Votes{};
+          for (auto i = 0; i < voted.size(); ++i) {
+            voted[i] = majority(current[i], history_[0][i], history_[1][i],
+                                captured.confident);
+          }
+          std::copy_n(voted.begin(), bcd_size_, captured.reading.bcd.begin());
+          captured.reading.decimal_point_digit = static_cast<i8>(voted.back());
+        }
+
+        history_[1] = history_[0];
+        history_[0] = current;
+        if (previous_passes_ < 2) {
+          ++previous_passes_;
+        }
       }
 
-      void set_overflow(const bool overflow) {
-        if (overflow) {
-          reading_[0] = '>';
+      /// Renders the captured reading as text, ending in the precomputed
+      /// suffix of its unit.
+      void render() {
+        auto &captured = capture();
+        auto *text = captured.text.data();
+        *text++ = captured.reading.overflow ? '>' : ' ';
+        for (auto strobe = i8{msd_}; strobe > 0; --strobe) {
+          if (strobe == captured.reading.decimal_point_digit) {
+            *text++ = '.';
+          }
+          *text++ = static_cast<char>('0' + captured.reading.digit(strobe));
+        }
+        const auto unit = captured.reading.unit();
+        const auto &suffix = reading_suffixes_of<Instrument_>[to_integral(
+            unit)];
+        std::copy_n(suffix.text.data(), suffix.length + 1, text);
+        captured.length = static_cast<uint8_t>(text_length<Instrument_>(
+            captured.reading.decimal_point_digit, unit));
+      }
+
+      Data_state state_{Data_state::Init};
+      Reading pass_{};
+      Capture capture_{};
+      uint8_t out_of_sequence_{0};
+      Array<Votes, 2> history_{};
+      uint8_t previous_passes_{0};
+  };
+
+  using Bus_decoder = Basic_bus_decoder<Instrument>;
+
+  /// Number of measurement windows after which the `Bus_health` is reported,
+  /// or 0 to not report it.
+  constexpr auto health_report_interval = uint8_t{0};
+
+  /// Counts how the measurement windows have been decoded since the last
+  /// report, which tells sampling problems from problems of the instrument.
+  ///
+  /// A window starts with the falling and ends with the rising edge of /MUP.
+  /// Each window either yields a reading, or is incomplete because passes
+  /// have started but none has been completed, or is empty because no pass
+  /// has started at all. Missing strobes, e.g., due to a low sampling rate,
+  /// show as incomplete windows with strobes out of sequence, while a silent
+  /// bus shows as empty windows. A pass that is cut short by the end of the
+  /// window is aborted, which is expected to happen about once per window.
+  ///    All counters saturate at 0xff.
+  class Bus_health {
+    public:
+      /// The counters as text, e.g., `"#H 0a 00 00 0a 03\r\n"`, in the order
+      /// readings, incomplete windows, empty windows, aborted passes and
+      /// strobes out of sequence, in hexadecimal. Such lines cannot be
+      /// confused with readings, and contain no `binary_frame_sync` either.
+      using Line = Array<char, 19>;
+
+      /// Called at the end of each window with the decoder that has processed
+      /// it.
+      template <typename Instrument_>
+      void update(const Basic_bus_decoder<Instrument_> &decoder) {
+        if (decoder.is_complete()) {
+          increment(readings_);
+        } else if (decoder.state() == Data_state::Init) {
+          increment(empty_windows_);
         } else {
-          reading_[0] = ' ';
+          increment(incomplete_windows_);
+        }
+        if (decoder.state() != Data_state::Init) {
+          increment(aborted_passes_);
         }
+        const auto out_of_sequence = out_of_sequence_
+                                     + decoder.out_of_sequence();
+        out_of_sequence_ = static_cast<uint8_t>(
+            out_of_sequence < 0xff ? out_of_sequence : 0xff);
+        increment(windows_);
       }
 
-      void set_digit(const i8 digit_strobe, const i8 out) {
-        if (digit_strobe == decimal_point_digit_) {
-          reading_[number_of_digits + 1 - digit_strobe] = '.';
+      /// \return The number of windows since the last `reset()`.
+      [[nodiscard]] uint8_t windows() const { return windows_; }
+      [[nodiscard]] uint8_t readings() const { return readings_; }
+      [[nodiscard]] uint8_t incomplete_windows() const {
+        return incomplete_windows_;
+      }
+      [[nodiscard]] uint8_t empty_windows() const { return empty_windows_; }
+      [[nodiscard]] uint8_t aborted_passes() const { return aborted_passes_; }
+      [[nodiscard]] uint8_t out_of_sequence() const { return out_of_sequence_; }
+
+      [[nodiscard]] Line format() const {
+        auto line = Line{{'#', 'H', ' ', '0', '0', ' ', '0', '0', ' ', '0',
+                          '0', ' ', '0', '0', ' ', '0', '0', '\r', '\n'}};
+        format_hex(&line[3], readings_, 2);
+        format_hex(&line[6], incomplete_windows_, 2);
+        format_hex(&line[9], empty_windows_, 2);
+        format_hex(&line[12], aborted_passes_, 2);
+        format_hex(&line[15], out_of_sequence_, 2);
+        return line;
+      }
+
+      void reset() { *this = {}; }
+
+    private:
+      static void increment(uint8_t &counter) {
+        if (counter != 0xff) {
+          ++counter;
         }
-        reading_[get_index(digit_strobe)] = static_cast<char>('0' + out);
       }
 
-      void set_unit(const Unit unit) {
-        const auto index = get_index(0);
-        print(&(reading_[index]), reading_.size() - index, unit, "\r\n");
+      uint8_t windows_{0};
+      uint8_t readings_{0};
+      uint8_t incomplete_windows_{0};
+      uint8_t empty_windows_{0};
+      uint8_t aborted_passes_{0};
+      uint8_t out_of_sequence_{0};
+  };
+
+  /// Whether to only report readings that differ significantly from the last
+  /// reported one, see `Change_filter`.
+  constexpr auto report_on_change = false;
+
+  /// Changes by up to this many counts of the least significant digit are
+  /// not reported.
+  constexpr auto report_deadband = int32_t{0};
+
+  /// Number of consecutive readings that may be suppressed, before one is
+  /// reported anyway to show that the unit is alive.
+  constexpr auto report_keep_alive = uint8_t{10};
+
+  /// Whether to report readings whose passes disagree without a majority,
+  /// see `Bus_decoder::is_confident()`.
+  constexpr auto report_unconfident = true;
+
+  /// Decides whether a reading is to be reported, based on the last reading
+  /// that has been reported.
+  ///
+  /// A reading is reported, if its digits differ from the last one by more
+  /// than the deadband, if unit, decimal point or overflow have changed, or
+  /// if the previous `keep_alive` readings have been suppressed.
+  class Change_filter {
+    public:
+      constexpr Change_filter(const int32_t deadband, const uint8_t keep_alive)
+          : deadband_{deadband}, keep_alive_{keep_alive} {}
+
+      void set_deadband(const int32_t deadband) { deadband_ = deadband; }
+
+      /// \return Whether `reading` shall be reported. If so, it becomes the
+      /// reference for the following readings.
+      bool update(const Reading &reading) {
+        if (has_reference_ and (suppressed_ < keep_alive_)
+            and not differs(reading)) {
+          ++suppressed_;
+          return false;
+        }
+        reference_ = reading;
+        has_reference_ = true;
+        suppressed_ = 0;
+        return true;
       }
 
-      static constexpr auto max_reading_size = number_of_digits
-                                               + 1 // overflow indicator
-                                               + 1 // decimal point
-                                               + max_unit_length
-                                               + 2 // line ending
-                                               + 1 // terminating zero
-          ;
+    private:
+      [[nodiscard]] bool differs(const Reading &reading) const {
+        if ((reading.decimal_point_digit != reference_.decimal_point_digit)
+            or (reading.overflow != reference_.overflow)
+            or (reading.unit() != reference_.unit())) {
+          return true;
+        }
+        const auto delta = reading.counts() - reference_.counts();
+        return (delta > deadband_) or (delta < -deadband_);
+      }
+
+      Reading reference_{};
+      int32_t deadband_;
+      uint8_t keep_alive_;
+      uint8_t suppressed_{0};
+      bool has_reference_{false};
+  };
+
+  /// Summarizes consecutive readings by count, mean, minimum, maximum and
+  /// sample standard deviation of their digits as an integer, as long as
+  /// unit, decimal point and overflow stay the same.
+  ///
+  /// Mean and variance are updated by Welford's method in fixed point with
+  /// 8 fractional bits, so that each reading takes one division and one
+  /// multiplication, and no floating point is needed. Rounding each update
+  /// leaves the mean off by at most (n + 1) / 1024 counts after n readings,
+  /// which is less than a count for any summary.
+  class Aggregator {
+    public:
+      /// The summary as text, e.g.,
+      /// `"#A 0a 0001e240 1e23c 1e244 000180 1b\r\n"`, in hexadecimal: the
+      /// count, the mean with 8 fractional bits, minimum, maximum, the
+      /// standard deviation with 8 fractional bits, saturated at 0xffffff,
+      /// and the flags of the readings as in `Binary_frame`. Such lines
+      /// cannot be confused with readings.
+      using Line = Array<char, 38>;
+
+      /// \param readings The number of readings per summary, or 0.
+      /// \param period_ticks The longest time that a summary spans, or 0.
+      constexpr Aggregator(const uint8_t readings, const uint32_t period_ticks)
+          : readings_{readings}, period_ticks_{period_ticks} {}
+
+      /// \return Whether `reading` differs from the readings of the current
+      /// summary in unit, decimal point or overflow, so that the summary
+      /// needs to be reported before `reading` is added.
+      [[nodiscard]] bool interrupts(const Reading &reading) const {
+        return (count_ != 0) and (encode_flags(reading) != flags_);
+      }
+
+      /// Adds `reading` taken at `ticks`. A reading that `interrupts()` the
+      /// current summary discards it and starts a new one.
+      ///
+      /// \return Whether the summary is due to be reported, which is also
+      /// the case once 255 readings have been added.
+      bool add(const Reading &reading, const uint32_t ticks) {
+        const auto flags = encode_flags(reading);
+        if ((count_ == 0) or (flags != flags_)) {
+          reset();
+          flags_ = flags;
+          start_ticks_ = ticks;
+        }
+
+        if (count_ != max_count_) {
+          const auto counts = reading.counts();
+          const auto value = counts * scale_;
+          ++count_;
+          const auto delta = value - mean_;
+          mean_ += divide(delta, count_);
+          const auto product = int64_t{delta} * (value - mean_);
+          m2_ += product > 0 ? static_cast<uint64_t>(product) : 0U;
+          if ((count_ == 1) or (counts < min_)) {
+            min_ = counts;
+          }
+          if ((count_ == 1) or (counts > max_)) {
+            max_ = counts;
+          }
+        }
+
+        return (count_ == max_count_)
+               or ((readings_ != 0) and (count_ >= readings_))
+               or ((period_ticks_ != 0)
+                   and ((ticks - start_ticks_) >= period_ticks_));
+      }
+
+      [[nodiscard]] uint8_t count() const { return count_; }
+
+      /// With 8 fractional bits.
+      [[nodiscard]] int32_t mean() const { return mean_; }
+
+      [[nodiscard]] int32_t min() const { return min_; }
+      [[nodiscard]] int32_t max() const { return max_; }
+
+      /// \return The sample standard deviation with 8 fractional bits, or 0
+      /// for a single reading.
+      [[nodiscard]] uint32_t standard_deviation() const {
+        return count_ < 2 ? 0U
+                          : square_root(m2_ / static_cast<uint8_t>(count_ - 1));
+      }
+
+      [[nodiscard]] Line format() const {
+        auto line = Line{};
+        std::copy_n("#A 00 00000000 00000 00000 000000 00\r\n", line.size(),
+                    line.data());
+        const auto mean = static_cast<uint32_t>(mean_);
+        const auto deviation = std::min(standard_deviation(), 0xffffffU);
+        format_hex(&line[3], count_, 2);
+        format_hex(&line[6], static_cast<uint16_t>(mean >> 16U), 4);
+        format_hex(&line[10], static_cast<uint16_t>(mean), 4);
+        format_hex(&line[15], static_cast<uint16_t>(min_ >> 16), 1);
+        format_hex(&line[16], static_cast<uint16_t>(min_), 4);
+        format_hex(&line[21], static_cast<uint16_t>(max_ >> 16), 1);
+        format_hex(&line[22], static_cast<uint16_t>(max_), 4);
+        format_hex(&line[27], static_cast<uint16_t>(deviation >> 16U), 2);
+        format_hex(&line[29], static_cast<uint16_t>(deviation), 4);
+        format_hex(&line[34], flags_, 2);
+        return line;
+      }
+
+      void reset() {
+        count_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+      }
+
+    private:
+      static constexpr auto scale_ = int32_t{256};
+      static constexpr auto max_count_ = uint8_t{0xff};
+
+      /// \return `dividend / divisor`, rounded to nearest.
+      static int32_t divide(const int32_t dividend, const uint8_t divisor) {
+        const auto half = int32_t{divisor / 2};
+        return (dividend >= 0 ? dividend + half : dividend - half) / divisor;
+      }
+
+      /// \return The square root of `value`, rounded down, bit by bit.
+      static uint32_t square_root(uint64_t value) {
+        auto root = uint64_t{0};
+        auto bit = uint64_t{1} << 62U;
+        while (bit > value) {
+          bit >>= 2U;
+        }
+        while (bit != 0) {
+          if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1U) + bit;
+          } else {
+            root >>= 1U;
+          }
+          bit >>= 2U;
+        }
+        return static_cast<uint32_t>(root);
+      }
+
+      uint8_t readings_;
+      uint32_t period_ticks_;
+      uint32_t start_ticks_{0};
+      int32_t mean_{0};
+      /// The sum of the squared deviations from the mean, with 16 fractional
+      /// bits.
+      uint64_t m2_{0};
+      int32_t min_{0};
+      int32_t max_{0};
+      uint8_t count_{0};
+      uint8_t flags_{0};
+  };
+
+  /// The code regions whose duration is measured by the `Profiler`.
+  enum class Region : uint8_t {
+    /// Time between two consecutive samples of the bus by the main loop
+    /// while polling. This must stay well below the strobe width.
+    Poll_period,
+    /// `Bus_decoder::transit()` or `Bus_decoder::latch()`.
+    Decode,
+    /// Formatting and queueing a reading.
+    Send,
+    /// One call of the transmit interrupt.
+    Transmit
+  };
+
+  constexpr auto number_of_regions = 4;
+
+  /// Keeps the minimum, maximum and number of the durations measured for each
+  /// `Region`, in ticks of a free-running 16-bit counter.
+  ///
+  /// Durations include the overhead of reading the counter and must be
+  /// shorter than one period of the counter, i.e., about 4 ms at 16 MHz.
+  class Profiler {
+    public:
+      struct Statistics {
+          uint16_t min;
+          uint16_t max;
+          /// Saturates at 0xffff.
+          uint16_t count;
+      };
+
+      /// The statistics of one region as text, e.g., `"#1 0012 01a4 0c35\r\n"`
+      /// for region 1, with minimum, maximum and count in hexadecimal. Such
+      /// lines cannot be confused with readings, and contain no
+      /// `binary_frame_sync` either.
+      using Line = Array<char, 19>;
+
+      void record(const Region region, const uint16_t start,
+                  const uint16_t end) {
+        const auto duration = static_cast<uint16_t>(end - start);
+        auto &statistics = table_[to_integral(region)];
+        if ((statistics.count == 0) or (duration < statistics.min)) {
+          statistics.min = duration;
+        }
+        if (duration > statistics.max) {
+          statistics.max = duration;
+        }
+        if (statistics.count != 0xffff) {
+          ++statistics.count;
+        }
+      }
+
+      /// Records the time since the previous lap as `region`, unless the
+      /// laps have been stopped in between. This measures the period of a
+      /// loop.
+      void lap(const Region region, const uint16_t now) {
+        if (lapping_) {
+          record(region, lap_start_, now);
+        }
+        lap_start_ = now;
+        lapping_ = true;
+      }
+
+      void stop_laps() { lapping_ = false; }
+
+      [[nodiscard]] const Statistics &statistics(const Region region) const {
+        return table_[to_integral(region)];
+      }
+
+      [[nodiscard]] Line format(const Region region) const {
+        const auto &statistics = table_[to_integral(region)];
+        auto line = Line{{'#', static_cast<char>('0' + to_integral(region)),
+                          ' ', '0', '0', '0', '0', ' ', '0', '0', '0', '0',
+                          ' ', '0', '0', '0', '0', '\r', '\n'}};
+        format_hex(&line[3], statistics.min, 4);
+        format_hex(&line[8], statistics.max, 4);
+        format_hex(&line[13], statistics.count, 4);
+        return line;
+      }
+
+    private:
+      Array<Statistics, number_of_regions> table_{};
+      uint16_t lap_start_{0};
+      bool lapping_{false};
+  };
+
+  /// Records the duration of its own lifetime as `region` in `profiler`,
+  /// reading the free-running counter from `Clock_::count()`. Does nothing,
+  /// unless `profiling` is enabled.
+  template <typename Clock_> class Profile_scope {
+    public:
+      Profile_scope(Profiler &profiler, const Region region)
+          : profiler_{profiler}, region_{region} {
+        if constexpr (profiling) {
+          start_ = to_integral(Clock_::count());
+        }
+      }
+
+      ~Profile_scope() {
+        if constexpr (profiling) {
+          profiler_.record(region_, start_, to_integral(Clock_::count()));
+        }
+      }
+
+      Profile_scope(const Profile_scope &) = delete;
+      Profile_scope &operator=(const Profile_scope &) = delete;
+
+    private:
+      Profiler &profiler_;
+      Region region_;
+      uint16_t start_{0};
+  };
+
+  /// \return Whether `format` can be selected, as scaled binary frames have
+  /// no room for timestamps.
+  constexpr bool is_available(const Output_format format) {
+    return (format == Output_format::Text) or (format == Output_format::Binary)
+           or (format == Output_format::Scaled_text)
+           or ((format == Output_format::Scaled_binary)
+               and (timestamp_mode == Timestamp_mode::None));
+  }
+
+  static_assert(is_available(output_format),
+                "scaled binary frames cannot be timestamped");
+
+  enum class Command_type : uint8_t {
+    /// Report the next complete reading, also while not streaming.
+    Read,
+    /// Report readings continuously, if the argument is 1, or only on
+    /// request, if it is 0.
+    Stream,
+    /// Select the `Output_format` given as argument.
+    Format,
+    /// Report changes by more than the argument in counts only, or, without
+    /// argument, every reading.
+    Deadband,
+    /// Report the `Bus_health` right away.
+    Statistics,
+    Invalid
+  };
+
+  struct Command {
+      Command_type type;
+      /// -1, if the command has no argument.
+      int32_t argument;
+  };
+
+  /// Parses the commands sent by the host, one character at a time as they
+  /// are received, keeping only the letter and the argument so far.
+  ///
+  /// A command is a letter, optionally followed by a decimal argument, and
+  /// ends with CR or LF:
+  ///
+  /// - `R`: read a single reading
+  /// - `S1` and `S0`: start and stop streaming
+  /// - `F0` to `F3`: text, binary, scaled text and scaled binary output, see
+  ///   `Output_format`; `F3` is invalid with timestamps
+  /// - `D25` and `D`: report on change by more than 25 counts, or always
+  /// - `H`: report the bus health
+  ///
+  /// Empty lines are ignored.
+  class Command_parser {
+    public:
+      static constexpr auto max_argument_digits = number_of_digits;
+
+      /// \return Whether `character` has completed a command, which is then
+      /// stored in `command`.
+      bool feed(const char character, Command &command) {
+        if ((character == '\r') or (character == '\n')) {
+          const auto complete = letter_ != '\0';
+          if (complete) {
+            command = parse();
+          }
+          *this = {};
+          return complete;
+        }
+        if (letter_ == '\0') {
+          letter_ = character;
+        } else if ((character >= '0') and (character <= '9')
+                   and (digits_ < max_argument_digits)) {
+          argument_ = (argument_ * 10) + (character - '0');
+          ++digits_;
+        } else {
+          digits_ = invalid_;
+        }
+        return false;
+      }
+
+    private:
+      static constexpr auto invalid_ = uint8_t{0xff};
+
+      [[nodiscard]] Command parse() const {
+        const auto has_argument = digits_ != 0;
+        const auto is_flag = (digits_ == 1) and (argument_ <= 1);
+        auto type = Command_type::Invalid;
+        if (digits_ == invalid_) {
+          type = Command_type::Invalid;
+        } else if ((letter_ == 'R') and not has_argument) {
+          type = Command_type::Read;
+        } else if ((letter_ == 'S') and is_flag) {
+          type = Command_type::Stream;
+        } else if ((letter_ == 'F') and (digits_ == 1)
+                   and is_available(static_cast<Output_format>(argument_))) {
+          type = Command_type::Format;
+        } else if (letter_ == 'D') {
+          type = Command_type::Deadband;
+        } else if ((letter_ == 'H') and not has_argument) {
+          type = Command_type::Statistics;
+        }
+        return {type, (has_argument and (type != Command_type::Invalid))
+                          ? argument_
+                          : -1};
+      }
 
-      Data_state state_{Data_state::Digit6};
-      Array<char, max_reading_size> reading_{""};
-      i8 decimal_point_digit_{0};
-      bool complete_{false};
+      int32_t argument_{0};
+      char letter_{'\0'};
+      uint8_t digits_{0};
   };
 
 } // namespace dou
@@ -2,71 +2,375 @@
 
 #include "msp430.hpp"
 
+#include "bus.hpp"
 #include "dou.hpp"
 #include "nostd.hpp"
 
-#include <string_view>
-
 namespace dou {
 
-  constexpr auto smclk_frequency_Hz = 16'000'000;
+  constexpr auto mclk_frequency_Hz = smclk_frequency_Hz;
 
   constexpr auto &tx_port_ = msp430::P1OUT;
 
-  // port 1
-  constexpr auto out_b_mask_ = u8{0x01}; // BCD 2
-  constexpr auto as_1_mask_ = u8{0x02};  // LSD
-  constexpr auto tx_mask_ = u8{0x04};
-  constexpr auto rng_2_mask_ = u8{0x08};
-  constexpr auto nml_mask_ = u8{0x10};
-  constexpr auto ovfl_mask_ = u8{0x20};
-  constexpr auto as_3_mask_ = u8{0x40}; // 4SD
-  constexpr auto as_2_mask_ = u8{0x80}; // 5SD
-
-  // port 2
-  constexpr auto nmup_mask_ = u8{0x01};
-  constexpr auto out_c_mask_ = u8{0x02}; // BCD 4
-  constexpr auto out_d_mask_ = u8{0x04}; // BCD 8
-  constexpr auto as_6_mask_ = u8{0x08};  // MSD
-  constexpr auto as_5_mask_ = u8{0x10};  // 2SD
-  constexpr auto as_4_mask_ = u8{0x20};  // 3SD
-  constexpr auto out_a_mask_ = u8{0x40}; // BCD 1
-  constexpr auto ds_mask_ = u8{0x80};
-
-  Input_state decode_signals(const u8 port1, const u8 port2) {
-    return {
-        static_cast<i8>(
-            ((port1 & as_1_mask_) != u8{0})
-                ? 1
-                : (((port1 & as_2_mask_) != u8{0})
-                       ? 2
-                       : (((port1 & as_3_mask_) != u8{0})
-                              ? 3
-                              : (((port2 & as_4_mask_) != u8{0})
-                                     ? 4
-                                     : (((port2 & as_5_mask_) != u8{0})
-                                            ? 5
-                                            : (((port2 & as_6_mask_) != u8{0})
-                                                   ? 6
-                                                   : 0)))))),
-        static_cast<i8>((((port2 & out_a_mask_) != u8{0}) ? u8{1} : u8{0})
-                        | (((port1 & out_b_mask_) != u8{0}) ? u8{2} : u8{0})
-                        | (((port2 & out_c_mask_) != u8{0}) ? u8{4} : u8{0})
-                        | (((port2 & out_d_mask_) != u8{0}) ? u8{8} : u8{0})),
-        (port2 & ds_mask_) != u8{0},
-        (port1 & ovfl_mask_) != u8{0},
-        (port1 & nml_mask_) != u8{0},
-        (port1 & rng_2_mask_) != u8{0}};
-  }
+  constexpr auto use_usi_ = serial_backend == Serial_backend::Usi;
+
+  // The USI shifts once per period of the TACCR0 output, which toggles at
+  // every match, i.e., twice per bit.
+  constexpr auto serial_timing_ = msp430::Timer_A_period{
+      msp430::Timer_A_clock_source::SMCLK, smclk_frequency_Hz, 1,
+      serial_baud_rate * (use_usi_ ? 2 : 1)};
+
+  // The receiver samples the stop bit of a frame of `serial_frame_bits`
+  // correctly, as long as the accumulated error stays below half a bit.
+  // Allow for the same error on the receiving side.
+  constexpr auto max_serial_baud_error_percent_ = 2;
+
+  // Estimated worst-case duration of `on_timer()` or `on_usi()`, including
+  // interrupt entry and return.
+  constexpr auto serial_isr_cycles_ = 80;
+
+  constexpr auto serial_cycles_per_interrupt_ =
+      serial_timing_.cpu_cycles_per_period(mclk_frequency_Hz)
+      * (use_usi_ ? 2 * serial_frame_bits : 1);
+
+  static_assert(serial_timing_.is_valid(),
+                "baud rate cannot be generated from the timer clock");
+  static_assert((serial_timing_.error_ppm()
+                 <= max_serial_baud_error_percent_ * 10'000)
+                    and (serial_timing_.error_ppm()
+                         >= -max_serial_baud_error_percent_ * 10'000),
+                "baud rate error too large");
+  static_assert(serial_cycles_per_interrupt_ >= 2 * serial_isr_cycles_,
+                "the transmit interrupt would take more than half the CPU");
+
+  constexpr auto serial_timer_top_ = serial_timing_.top();
+
+  static_assert(not free_running_timer or not use_usi_,
+                "timestamps, profiling, command input and aggregating by "
+                "time need the timer to run continuously, which then cannot "
+                "clock the USI");
+  static_assert(not free_running_timer
+                    or (timestamp_frequency_Hz
+                        == smclk_frequency_Hz / serial_timing_.clock_divider),
+                "timestamps would not be counted at the documented rate");
+
+  // When the timer runs continuously, each bit period is scheduled by
+  // advancing the compare register.
+  constexpr auto serial_bit_ticks_ = static_cast<uint16_t>(
+      serial_timing_.ticks());
+
+  // Unlike TX, RX must arrive at RST/NMI without inversion: the line idles
+  // high, which also keeps the MCU out of reset until the pin is made the
+  // NMI input, and a start bit falls at the pin. An inverted line would idle
+  // low and hold the MCU in reset.
+  constexpr auto rx_start_edge_ = msp430::Nmi_edge::Falling;
+  constexpr auto rx_mark_edge_ = msp430::Nmi_edge::Rising;
 
   namespace {
-    auto serial = Serial_transmitter{};
-    auto decoder = Bus_decoder{};
+    /// All variables of the firmware, which the startup code initializes on
+    /// every power-up clear. Variables must be added here, so that the
+    /// emulated `on_reset()` initializes them as well.
+    struct Variables_ {
+        Serial_transmitter serial{};
+        Serial_receiver receiver{serial_bit_ticks_};
+        Command_parser parser{};
+        // The settings that commands may change at run time.
+        Output_format format{output_format};
+        bool streaming{true};
+        bool read_requested{false};
+        bool changes_only{report_on_change};
+        Bus_decoder decoder{};
+        Change_filter change_filter{report_deadband, report_keep_alive};
+        Aggregator aggregator{aggregate_readings, aggregate_period_ticks};
+        Ring_buffer<Port_sample, 8> strobe_queue{};
+        Bus_health bus_health{};
+        Profiler profiler{};
+        Region next_profiled_region{};
+        volatile uint16_t timer_overflows{0};
+        uint32_t last_reported{0};
+    };
+
+    auto variables_ = Variables_{};
+
+    auto &serial = variables_.serial;
+    auto &receiver = variables_.receiver;
+    auto &parser = variables_.parser;
+    auto &format = variables_.format;
+    auto &streaming = variables_.streaming;
+    auto &read_requested = variables_.read_requested;
+    auto &changes_only = variables_.changes_only;
+    auto &decoder = variables_.decoder;
+    auto &change_filter = variables_.change_filter;
+    auto &aggregator = variables_.aggregator;
+    auto &strobe_queue = variables_.strobe_queue;
+    auto &bus_health = variables_.bus_health;
+    auto &profiler = variables_.profiler;
+    auto &next_profiled_region = variables_.next_profiled_region;
+    auto &timer_overflows = variables_.timer_overflows;
+    auto &last_reported = variables_.last_reported;
   } // namespace
 
+  using Profile_scope_ = Profile_scope<msp430::Timer0_A3>;
+
+  /// \return The ticks of the free-running timer, extended to 32 bits by
+  /// counting its overflows.
+  uint32_t read_ticks() {
+    msp430::disable_interrupts();
+    auto overflows = timer_overflows;
+    const auto count = to_integral(msp430::Timer0_A3::count());
+    // The counter may have wrapped around after interrupts were disabled.
+    if (msp430::Timer0_A3::has_overflowed() and (count < 0x8000U)) {
+      ++overflows;
+    }
+    msp430::enable_interrupts();
+    return (uint32_t{overflows} << 16U) | count;
+  }
+
+  /// Makes sure that the queued characters are being transmitted.
+  void start_transmission() {
+    if constexpr (free_running_timer) {
+      // Scheduling the first bit must not race against the interrupt, which
+      // disables itself once the queue has run empty.
+      msp430::disable_interrupts();
+      if (not msp430::Timer0_A3::is_interrupt_enabled()) {
+        msp430::Timer0_A3::set_compare(
+            static_cast<u16>(to_integral(msp430::Timer0_A3::count())
+                             + serial_bit_ticks_));
+        msp430::Timer0_A3::clear_interrupt_flag();
+        msp430::Timer0_A3::enable_interrupt();
+      }
+      msp430::enable_interrupts();
+    } else if constexpr (use_usi_) {
+      // Enabling the USI interrupt must not race against the interrupt
+      // itself clearing the flag.
+      msp430::disable_interrupts();
+      msp430::Timer0_A3::start_up(serial_timer_top_);
+      msp430::Usi_transmitter::enable_interrupt();
+      msp430::enable_interrupts();
+    } else {
+      // The timer interrupt stops the timer once the queue has run empty.
+      // Restarting it while it is still running has no effect.
+      msp430::Timer0_A3::start_up(serial_timer_top_);
+    }
+  }
+
+  /// Queues `length` characters of `data` and starts transmitting them.
+  ///
+  /// \return Whether there has been enough room.
+  bool transmit(const char *const data, const Size length) {
+    if (not serial.write(data, length)) {
+      return false;
+    }
+    start_transmission();
+    return true;
+  }
+
+  /// Queues the complete reading of `window` in the configured format,
+  /// taken at `ticks`.
+  void send(const Capture &window, const uint32_t ticks) {
+    const auto scope = Profile_scope_{profiler, Region::Send};
+    const auto timestamp = Timestamp{timestamp_mode == Timestamp_mode::Delta
+                                         ? ticks - last_reported
+                                         : ticks,
+                                     timestamp_mode};
+    auto sent = false;
+    if (format == Output_format::Scaled_binary) {
+      const auto frame = encode_scaled(window.reading);
+      sent = transmit(reinterpret_cast<const char *>(frame.data()),
+                      frame.size());
+    } else if (format == Output_format::Binary) {
+      if constexpr (timestamp_mode == Timestamp_mode::None) {
+        const auto frame = encode(window.reading);
+        sent = transmit(reinterpret_cast<const char *>(frame.data()),
+                        frame.size());
+      } else {
+        const auto frame = encode(window.reading, timestamp);
+        sent = transmit(reinterpret_cast<const char *>(frame.data()),
+                        frame.size());
+      }
+    } else {
+      auto scaled = Array<char, max_scaled_text_size>{};
+      const auto *reading = window.text.data();
+      auto reading_length = Size{window.length};
+      if (format == Output_format::Scaled_text) {
+        reading_length = format_scaled(scaled.data(), window.reading);
+        reading = scaled.data();
+      }
+      if constexpr (timestamp_mode == Timestamp_mode::None) {
+        sent = transmit(reading, reading_length);
+      } else {
+        // insert the timestamp before the line ending
+        constexpr auto max_line_length =
+            std::max(Capture::max_text_size, max_scaled_text_size) - 1
+            + timestamp_text_length;
+        auto line = Array<char, max_line_length>{};
+        const auto length = reading_length - 2;
+        std::copy_n(reading, length, line.data());
+        format_timestamp(&line[length], timestamp);
+        line[length + timestamp_text_length] = '\r';
+        line[length + timestamp_text_length + 1] = '\n';
+        sent = transmit(line.data(), length + timestamp_text_length + 2);
+      }
+    }
+    if (sent) {
+      last_reported = ticks;
+    }
+  }
+
+  /// Queues the `Bus_health` and starts counting anew. If there is no room,
+  /// counting continues until the next window.
+  void send_health() {
+    const auto line = bus_health.format();
+    if (transmit(line.data(), line.size())) {
+      bus_health.reset();
+    }
+  }
+
+  /// Queues the summary of the `Aggregator` and starts a new one. If there is
+  /// no room, it is sent after the next reading instead.
+  ///
+  /// \return Whether the summary has been queued.
+  bool send_summary() {
+    const auto line = aggregator.format();
+    if (transmit(line.data(), line.size())) {
+      aggregator.reset();
+      return true;
+    }
+    return false;
+  }
+
+  /// Queues the statistics of one region, so that the whole table is sent
+  /// over the course of `number_of_regions` readings.
+  void send_profile() {
+    msp430::disable_interrupts();
+    const auto line = profiler.format(next_profiled_region);
+    msp430::enable_interrupts();
+    if (transmit(line.data(), line.size())) {
+      next_profiled_region = static_cast<Region>(
+          (to_integral(next_profiled_region) + 1) % number_of_regions);
+    }
+  }
+
+  /// Executes the commands that have been received completely.
+  void execute_commands() {
+    auto character = char{};
+    auto command = Command{};
+    while (receiver.read(character)) {
+      if (not parser.feed(character, command)) {
+        continue;
+      }
+      switch (command.type) {
+      case Command_type::Read:
+        read_requested = true;
+        break;
+      case Command_type::Stream:
+        streaming = command.argument != 0;
+        break;
+      case Command_type::Format:
+        format = static_cast<Output_format>(command.argument);
+        break;
+      case Command_type::Deadband:
+        changes_only = command.argument >= 0;
+        change_filter.set_deadband(command.argument);
+        break;
+      case Command_type::Statistics:
+        send_health();
+        break;
+      case Command_type::Invalid:
+        (void)transmit("#?\r\n", 4);
+        break;
+      }
+    }
+  }
+
   void enable_nmup_interrupt() { store(msp430::P2IE, u8{nmup_mask_}); }
   void disable_nmup_interrupt() { store(msp430::P2IE, u8{0}); }
 
+  /// Decodes the samples taken by `on_strobe()` at the asserting edges of
+  /// the digit strobes, until /MUP has returned to high. Sleeps while there
+  /// is nothing to decode.
+  void capture_by_edge() {
+    // rising edge on /MUP ends the capture, and strobes that are asserted
+    // low interrupt on their falling edges
+    store(msp430::P2IES, port2_idle_);
+    store(msp430::P1IFG, u8{0});
+    store(msp430::P2IFG, u8{0});
+    store(msp430::P1IE, port1_strobes_mask_);
+    store(msp430::P2IE, port2_strobes_mask_ | nmup_mask_);
+
+    auto sample = Port_sample{};
+    while (true) {
+      msp430::disable_interrupts();
+      if (strobe_queue.pop(sample)) {
+        msp430::enable_interrupts();
+        const auto scope = Profile_scope_{profiler, Region::Decode};
+        decoder.latch(decode_signals(sample.port1, sample.port2));
+      } else if ((load(msp430::P2IN) & nmup_mask_) == u8{0}) {
+        msp430::enable_interrupts_and_sleep();
+      } else {
+        msp430::enable_interrupts();
+        break;
+      }
+    }
+
+    store(msp430::P1IE, u8{0});
+    store(msp430::P2IE, u8{0});
+    store(msp430::P2IES, port2_idle_ | nmup_mask_);
+    store(msp430::P2IFG, u8{0});
+  }
+
+  /// Reports the reading of the window that has just ended, or the summary
+  /// that it completes, if it is due, and starts decoding the next window.
+  void end_window() {
+    const auto window_end = (timestamp_mode == Timestamp_mode::None)
+                                    and (aggregate_period_s == 0)
+                                ? uint32_t{0}
+                                : read_ticks();
+
+    if constexpr ((health_report_interval != 0) or command_input) {
+      bus_health.update(decoder);
+    }
+
+    // The reading is queued for transmission before decoding resumes.
+    const auto &window = decoder.window();
+
+    const auto usable = window.complete
+                        and (report_unconfident or window.confident);
+
+    if constexpr (aggregating) {
+      // A reading in another unit, decimal point or overflow first reports
+      // the partial summary. If there is no room for it, the reading is
+      // skipped rather than the summary.
+      if (usable and streaming
+          and not (aggregator.interrupts(window.reading)
+                   and not send_summary())
+          and aggregator.add(window.reading, window_end)) {
+        send_summary();
+      }
+    }
+
+    if (usable
+        and (read_requested
+             or (streaming and not aggregating
+                 and (not changes_only
+                      or change_filter.update(window.reading))))) {
+      send(window, window_end);
+      read_requested = false;
+    }
+    decoder.start_window();
+
+    if constexpr (health_report_interval != 0) {
+      if (bus_health.windows() >= health_report_interval) {
+        send_health();
+      }
+    }
+
+    if constexpr (profiling) {
+      profiler.stop_laps();
+      send_profile();
+    }
+  }
+
   [[noreturn]] void run() {
     // Clear P2SEL reasonably early, because excess current will flow from
     // the oscillator driver output at P2.7.
@@ -74,78 +378,187 @@ namespace dou {
 
     // The watchdog timer will reset the device, if no nMUP signal has been
     // detected after expiration of the longest gate time of 10 seconds.
-    msp430::Watchdog_timer::hold(); // TODO set up watchdog
+    if constexpr (command_input) {
+      msp430::Watchdog_timer::hold_with_nmi(rx_start_edge_);
+      msp430::Nmi::arm();
+    } else {
+      msp430::Watchdog_timer::hold(); // TODO set up watchdog
+    }
 
     store(msp430::BCSCTL1, load(msp430::CAL_BC1_16MHz));
     store(msp430::DCOCTL, load(msp430::CAL_DCO_16MHz));
     store(msp430::BCSCTL3, u8{0x24}); // ACLK=VLOCLK
 
     store(msp430::P1OUT, u8{0});
-    store(msp430::P1DIR, tx_mask_);
-    store(msp430::P1IES, u8{0});
+    store(msp430::P1DIR, use_usi_ ? u8{0} : tx_mask_);
+    store(msp430::P1IES, port1_idle_);
     store(msp430::P1REN, u8{0});
     store(msp430::P2DIR, u8{0});
-    store(msp430::P2IES, u8{nmup_mask_});
+    store(msp430::P2IES, port2_idle_ | nmup_mask_);
     store(msp430::P2IE, u8{nmup_mask_});
     store(msp430::P2REN, u8{0});
 
-    auto uart_timer = msp430::Timer0_A3{msp430::Timer_A_clock_source::SMCLK, 1};
-    uart_timer.enable_interrupt();
+    auto uart_timer = msp430::Timer0_A3{serial_timing_};
+    if constexpr (free_running_timer) {
+      uart_timer.enable_overflow_interrupt();
+      uart_timer.start_continuous();
+    } else if constexpr (use_usi_) {
+      uart_timer.set_output_mode(msp430::Timer_A_output_mode::Toggle);
+      msp430::Usi_transmitter::configure(msp430::Usi_clock_source::TACCR0);
+    } else {
+      uart_timer.enable_interrupt();
+    }
 
     msp430::enable_interrupts();
 
     msp430::go_to_sleep();
 
+    auto in_window = false;
     while (true) {
       const auto port1 = load(msp430::P1IN);
       const auto port2 = load(msp430::P2IN);
 
       const auto update_memory = (port2 & nmup_mask_) == u8{0};
 
-      const auto input_state = decode_signals(port1, port2);
-
       if (update_memory) {
-        decoder.transit(input_state);
+        in_window = true;
+        if constexpr (strobe_capture == Strobe_capture::Edge) {
+          capture_by_edge();
+        } else {
+          if constexpr (profiling) {
+            profiler.lap(Region::Poll_period,
+                         to_integral(msp430::Timer0_A3::count()));
+          }
+          const auto scope = Profile_scope_{profiler, Region::Decode};
+          decoder.transit(decode_signals(port1, port2));
+        }
       } else {
         disable_nmup_interrupt();
 
-        const auto buffer = std::string_view{decoder.reading()};
+        // When woken up by a command, no window has ended.
+        if (in_window or not command_input) {
+          end_window();
+        }
+        in_window = false;
 
-        uart_timer.start_up(u16{(smclk_frequency_Hz / serial_baud_rate) - 1});
+        if constexpr (command_input) {
+          execute_commands();
+        }
 
-        for (const auto& character : buffer) {
-          serial.init_transmission(character);
-          auto bit = u8{0};
-          while (serial.get_next_bit(bit)) {
-            // Wait for the first and next bit.
-            msp430::go_to_sleep();
-            store(tx_port_, (load(tx_port_) & ~tx_mask_)
-                                | (bit != u8{0} ? u8{0} : tx_mask_));
+        // Wait for a falling edge on /MUP, while the reading is transmitted
+        // in the background.
+        enable_nmup_interrupt();
+        if constexpr (command_input) {
+          // ... or for the next command, which may just have arrived
+          msp430::disable_interrupts();
+          if (receiver.empty()) {
+            msp430::enable_interrupts_and_sleep();
+          } else {
+            msp430::enable_interrupts();
           }
-          // Wait for the last bit.
+        } else {
           msp430::go_to_sleep();
-          store(tx_port_, load(tx_port_) & ~tx_mask_);
         }
-        uart_timer.stop();
-        decoder = {};
-
-        // Wait for a falling edge on /MUP.
-        enable_nmup_interrupt();
-        msp430::go_to_sleep();
       }
     }
   }
 
   namespace {
 
-    /// Called on falling edge on /MUP.
-    [[gnu::interrupt]] void on_strobe() {
+    /// Called on falling edge on /MUP and, when capturing by edge, on the
+    /// rising edge of /MUP and the asserting edges of the digit strobes.
+    DOU_INTERRUPT void on_strobe() {
+      if constexpr (strobe_capture == Strobe_capture::Edge) {
+        const auto sample = Port_sample{load(msp430::P1IN),
+                                        load(msp430::P2IN)};
+        if (((load(msp430::P1IFG) & port1_strobes_mask_)
+             | (load(msp430::P2IFG) & port2_strobes_mask_))
+            != u8{0}) {
+          strobe_queue.push(sample);
+        }
+        store(msp430::P1IFG, u8{0});
+      }
       store(msp430::P2IFG, u8{0});
       msp430::stay_awake();
     }
 
-    [[gnu::interrupt]] void on_timer() { msp430::stay_awake(); }
+    /// Called once per bit period while characters are being transmitted.
+    DOU_INTERRUPT void on_timer() {
+      const auto scope = Profile_scope_{profiler, Region::Transmit};
+      auto bit = u8{0};
+      if (serial.get_next_bit(bit)) {
+        store(tx_port_,
+              (load(tx_port_) & ~tx_mask_) | (bit != u8{0} ? u8{0} : tx_mask_));
+        if constexpr (free_running_timer) {
+          msp430::Timer0_A3::set_compare(
+              static_cast<u16>(to_integral(msp430::Timer0_A3::compare())
+                               + serial_bit_ticks_));
+        }
+      } else {
+        store(tx_port_, load(tx_port_) & ~tx_mask_);
+        if constexpr (free_running_timer) {
+          msp430::Timer0_A3::disable_interrupt();
+        } else {
+          msp430::Timer0_A3::stop();
+        }
+      }
+    }
+
+    /// Called whenever the free-running timer wraps around and, when
+    /// receiving commands, in the middle of the stop bit of each frame.
+    DOU_INTERRUPT void on_timer_overflow() {
+      if constexpr (command_input) {
+        if (msp430::Timer0_A3::interrupt_vector()
+            == msp430::Timer_A_interrupt::Compare1) {
+          msp430::Timer0_A3::disable_compare1_interrupt();
+          // The NMI is not masked by GIE, and must not change the receiver
+          // while it completes the frame. An edge cannot be missed, as the
+          // next start bit falls half a bit period later at the earliest.
+          msp430::Nmi::disarm();
+          const auto received = receiver.end_frame();
+          msp430::Watchdog_timer::hold_with_nmi(rx_start_edge_);
+          msp430::Nmi::arm();
+          if (received) {
+            msp430::stay_awake();
+          }
+          return;
+        }
+      }
+      msp430::Timer0_A3::clear_overflow();
+      timer_overflows = static_cast<uint16_t>(timer_overflows + 1U);
+    }
+
+    /// Called on each edge of RX, which is received on RST/NMI.
+    DOU_INTERRUPT void on_nmi() {
+      const auto now = to_integral(msp430::Timer0_A3::count());
+      if (receiver.edge(now)) {
+        msp430::Timer0_A3::schedule_compare1(u16{receiver.frame_end()});
+      }
+      msp430::Watchdog_timer::hold_with_nmi(
+          receiver.is_mark() ? rx_start_edge_ : rx_mark_edge_);
+      msp430::Nmi::arm();
+    }
 
+    /// Called once per frame, after the USI has shifted out the stop bit.
+    DOU_INTERRUPT void on_usi() {
+      auto frame = u16{};
+      if (serial.get_next_frame(frame)) {
+        // inverted by the line driver
+        msp430::Usi_transmitter::shift_out(~frame, serial_frame_bits);
+      } else {
+        msp430::Usi_transmitter::disable_interrupt();
+        msp430::Timer0_A3::stop();
+      }
+    }
+
+#ifdef DOU_EMULATED_REGISTERS
+    /// Gives the variables their initial values, as the startup code does
+    /// with .data and .bss on every power-up clear of the device.
+    [[noreturn]] void on_reset() {
+      variables_ = Variables_{};
+      run();
+    }
+#else
     extern "C" [[noreturn, gnu::naked]] void on_reset() {
       // init stack pointer
       extern const uint16_t _stack;
@@ -187,20 +600,27 @@ namespace dou {
 
       run();
     }
+#endif
+
+    DOU_INTERRUPT void default_isr() {}
 
-    [[gnu::interrupt]] void default_isr() {}
+    constexpr auto nmi_isr_ = command_input ? on_nmi : default_isr;
 
     constexpr auto vtable_
         [[gnu::used, gnu::section(".vectors")]] = Array<void (*)(), 32>{
-            {nullptr,     nullptr,   nullptr,     nullptr,     nullptr, nullptr,
-             nullptr,     nullptr,   nullptr,     nullptr,     nullptr, nullptr,
-             nullptr,     nullptr,   nullptr,     nullptr,     nullptr, nullptr,
-             on_strobe,   on_strobe, default_isr, default_isr, nullptr, nullptr,
-             default_isr, on_timer,  default_isr, default_isr, nullptr, nullptr,
-             default_isr, on_reset}};
+            {nullptr,           nullptr,     nullptr,     nullptr,
+             nullptr,           nullptr,     nullptr,     nullptr,
+             nullptr,           nullptr,     nullptr,     nullptr,
+             nullptr,           nullptr,     nullptr,     nullptr,
+             nullptr,           nullptr,     on_strobe,   on_strobe,
+             on_usi,            default_isr, nullptr,     nullptr,
+             on_timer_overflow, on_timer,    default_isr, default_isr,
+             nullptr,           nullptr,     nmi_isr_,    on_reset}};
 
   } // namespace
 
 } // namespace dou
 
+#ifndef DOU_EMULATED_REGISTERS
 int main() { dou::run(); }
+#endif
@@ -7,6 +7,9 @@
 
 namespace msp430 {
 
+  constexpr auto IE1 = Register<u8>{0x00};
+  constexpr auto IFG1 = Register<u8>{0x02};
+
   constexpr auto P1IN = Register<const u8>{0x20};
   constexpr auto P1OUT = Register<u8>{0x21};
   constexpr auto P1DIR = Register<u8>{0x22};
@@ -24,6 +27,12 @@ namespace msp430 {
   constexpr auto P2SEL = Register<u8>{0x2e};
   constexpr auto P2REN = Register<u8>{0x2f};
 
+  constexpr auto USICTL0 = Register<u8>{0x78};
+  constexpr auto USICTL1 = Register<u8>{0x79};
+  constexpr auto USICKCTL = Register<u8>{0x7a};
+  constexpr auto USICNT = Register<u8>{0x7b};
+  constexpr auto USISR = Register<u16>{0x7c};
+
   constexpr auto BCSCTL3 = Register<u8>{0x53};
   constexpr auto DCOCTL = Register<u8>{0x56};
   constexpr auto BCSCTL1 = Register<u8>{0x57};
@@ -31,10 +40,32 @@ namespace msp430 {
   constexpr auto CAL_BC1_16MHz = Register<u8>{0x10f6 + 0x0003};
   constexpr auto CAL_DCO_16MHz = Register<u8>{0x10f6 + 0x0002};
 
+#ifdef DOU_EMULATED_REGISTERS
+
+// Implemented by the emulation on the host, where interrupt service routines
+// are called like any other function.
+#define DOU_INTERRUPT
+
+  void go_to_sleep();
+  void enable_interrupts_and_sleep();
+  void stay_awake();
+  void enable_interrupts();
+  void disable_interrupts();
+
+#else
+
+#define DOU_INTERRUPT [[gnu::interrupt]]
+
   [[gnu::always_inline]] inline void go_to_sleep() {
     asm volatile("nop { bis %0, SR { nop" : : "ri"(0x10));
   }
 
+  /// Enables interrupts and enters LPM0 in a single instruction, so that an
+  /// interrupt cannot slip in between checking for work and going to sleep.
+  [[gnu::always_inline]] inline void enable_interrupts_and_sleep() {
+    asm volatile("nop { bis %0, SR { nop" : : "ri"(0x18));
+  }
+
   [[gnu::always_inline]] inline void stay_awake() {
     __bic_SR_register_on_exit(0x10);
   }
@@ -42,6 +73,10 @@ namespace msp430 {
   void enable_interrupts() { asm volatile("eint"); }
   void disable_interrupts() { asm volatile("dint { nop"); }
 
+#endif
+
+  enum class Nmi_edge { Rising, Falling };
+
   enum class Watchdog_timer_clock_source { SMCLK, ACLK };
   enum class Watchdog_timer_interval { By32768, By8192, By512, By64 };
 
@@ -58,6 +93,14 @@ namespace msp430 {
 
       static void hold() { store(wdtctl_, wdt_unlock_ | wdt_hold_); }
 
+      /// Holds the watchdog timer and makes RST/NMI an input, whose `edge`
+      /// raises the NMI, see `Nmi`.
+      static void hold_with_nmi(const Nmi_edge edge) {
+        store(wdtctl_, wdt_unlock_ | wdt_hold_ | wdt_nmi_
+                           | (edge == Nmi_edge::Falling ? wdt_nmies_
+                                                        : u16{0}));
+      }
+
       static void feed() {
         store(wdtctl_, wdt_unlock_ | load(wdtctl_b_) | wdt_count_clear_);
       }
@@ -66,38 +109,173 @@ namespace msp430 {
       static constexpr auto wdt_unlock_ = u16{0x5a00};
       static constexpr auto wdt_hold_ = u16{0x0080};
       static constexpr auto wdt_count_clear_ = u16{0x0008};
+      static constexpr auto wdt_nmi_ = u16{0x0020};
+      static constexpr auto wdt_nmies_ = u16{0x0040};
       static constexpr auto wdtctl_ = Register<u16>{0x120};
       static constexpr auto wdtctl_b_ = Register<const u8>{0x120};
   };
 
+  /// The interrupt on RST/NMI, whose edge is selected by
+  /// `Watchdog_timer::hold_with_nmi()`. The level of the pin cannot be read.
+  class Nmi {
+    public:
+      /// Enables the interrupt, which is disabled again when it is accepted.
+      /// Selecting the edge may set the flag, which is why it is cleared.
+      static void arm() {
+        store(IFG1, load(IFG1) & ~nmiifg_);
+        store(IE1, load(IE1) | nmiie_);
+      }
+
+      /// Disables the interrupt, which GIE does not.
+      static void disarm() { store(IE1, load(IE1) & ~nmiie_); }
+
+    private:
+      static constexpr auto nmiie_ = u8{0x10};
+      static constexpr auto nmiifg_ = u8{0x10};
+  };
+
   enum class Timer_A_clock_source { TACLK, ACLK, SMCLK, INCLK };
 
-  template <intptr_t base_> class Timer_A_ {
+  /// The sources of the interrupt of capture/compare blocks 1 and 2 and of
+  /// the overflow, as read from TAIV.
+  enum class Timer_A_interrupt : uint16_t {
+    None = 0,
+    Compare1 = 2,
+    Compare2 = 4,
+    Overflow = 10
+  };
+
+  enum class Timer_A_output_mode {
+    Output,
+    Set,
+    Toggle_reset,
+    Set_reset,
+    Toggle,
+    Reset,
+    Toggle_set,
+    Reset_set
+  };
+
+  /// Period of a timer that shall expire at `rate_Hz`, derived at compile
+  /// time from its clock.
+  struct Timer_A_period {
+      Timer_A_clock_source clock_source;
+      long long clock_Hz;
+      uint8_t clock_divider;
+      long long rate_Hz;
+
+      /// \return The number of timer clocks per period, rounded to nearest.
+      [[nodiscard]] constexpr long long ticks() const {
+        const auto timer_clock_Hz = clock_Hz / clock_divider;
+        return (timer_clock_Hz + (rate_Hz / 2)) / rate_Hz;
+      }
+
+      [[nodiscard]] constexpr bool is_valid() const {
+        return std::has_single_bit(clock_divider) and (clock_divider <= 8)
+               and (ticks() >= 1) and (ticks() <= 0x10000);
+      }
+
+      /// \return The value for TACCR0 in up mode.
+      [[nodiscard]] constexpr u16 top() const {
+        return static_cast<u16>(ticks() - 1);
+      }
+
+      /// \return The deviation of the actual from the requested rate in
+      /// parts per million.
+      [[nodiscard]] constexpr long long error_ppm() const {
+        return ((clock_Hz * 1'000'000) / (clock_divider * ticks() * rate_Hz))
+               - 1'000'000;
+      }
+
+      /// \return The number of CPU cycles that pass during one period.
+      [[nodiscard]] constexpr long long
+      cpu_cycles_per_period(const long long cpu_clock_Hz) const {
+        return (cpu_clock_Hz * clock_divider * ticks()) / clock_Hz;
+      }
+  };
+
+  template <intptr_t base_, intptr_t taiv_> class Timer_A_ {
     public:
       Timer_A_(Timer_A_clock_source clock_source, uint8_t clock_divider) {
         store(tactl_,
               (u16{static_cast<uint16_t>(clock_source)} << 8U)
-                  | (u16{static_cast<uint16_t>(clock_divider - 1)} << 6U));
+                  | (u16{static_cast<uint16_t>(std::countr_zero(clock_divider))}
+                     << 6U));
       }
 
-      u16 count() const { return load(tar_); }
+      explicit Timer_A_(const Timer_A_period &period)
+          : Timer_A_{period.clock_source, period.clock_divider} {}
 
-      void enable_interrupt() {
+      static u16 count() { return load(tar_); }
+
+      /// Enables the interrupt on the timer counting from its maximum to
+      /// zero, i.e., TAIFG.
+      static void enable_overflow_interrupt() {
+        store(tactl_, load(tactl_) | u16{1U << 1U});
+      }
+
+      static bool has_overflowed() {
+        return (load(tactl_) & u16{1U}) != u16{0};
+      }
+
+      static void clear_overflow() {
+        store(tactl_, load(tactl_) & ~u16{1U});
+      }
+
+      static void enable_interrupt() {
         store(tacctl0_, load(tacctl0_) | u16{1U << 4U});
       }
 
-      void stop() { store(tactl_, load(tactl_) & ~(u16{3U} << 4U)); }
+      static void disable_interrupt() {
+        store(tacctl0_, load(tacctl0_) & ~u16{1U << 4U});
+      }
+
+      static void clear_interrupt_flag() {
+        store(tacctl0_, load(tacctl0_) & ~u16{1U});
+      }
+
+      static bool is_interrupt_enabled() {
+        return (load(tacctl0_) & u16{1U << 4U}) != u16{0};
+      }
+
+      static u16 compare() { return load(taccr0_); }
+
+      /// Schedules the interrupt of capture/compare block 1 at `value`,
+      /// which is disabled once it has been raised.
+      static void schedule_compare1(const u16 value) {
+        store(taccr1_, value);
+        store(tacctl1_, u16{1U << 4U});
+      }
+
+      static void disable_compare1_interrupt() {
+        store(tacctl1_, load(tacctl1_) & ~u16{1U << 4U});
+      }
+
+      /// \return The pending interrupt of highest priority, whose flag is
+      /// then reset.
+      static Timer_A_interrupt interrupt_vector() {
+        return static_cast<Timer_A_interrupt>(to_integral(load(taiv_reg_)));
+      }
+
+      static void set_compare(const u16 value) { store(taccr0_, value); }
+
+      static void set_output_mode(const Timer_A_output_mode mode) {
+        store(tacctl0_, (load(tacctl0_) & ~(u16{7U} << 5U))
+                            | (u16{static_cast<uint16_t>(mode)} << 5U));
+      }
+
+      static void stop() { store(tactl_, load(tactl_) & ~(u16{3U} << 4U)); }
 
-      void start_up(const u16 top) {
+      static void start_up(const u16 top) {
         store(taccr0_, top);
         store(tactl_, (load(tactl_) & ~(u16{3U} << 4U)) | (u16{1U} << 4U));
       }
 
-      void start_continuous() {
+      static void start_continuous() {
         store(tactl_, (load(tactl_) & ~(u16{3U} << 4U)) | (u16{2U} << 4U));
       }
 
-      void start_up_down(const u16 top) {
+      static void start_up_down(const u16 top) {
         store(taccr0_, top);
         store(tactl_, (load(tactl_) & ~(u16{3U} << 4U)) | (u16{3U} << 4U));
       }
@@ -107,9 +285,55 @@ namespace msp430 {
       static constexpr auto tacctl0_ = Register<u16>{base_ + 0x2};
       static constexpr auto tar_ = Register<const u16>{base_ + 0x10};
       static constexpr auto taccr0_ = Register<u16>{base_ + 0x12};
+      static constexpr auto tacctl1_ = Register<u16>{base_ + 0x4};
+      static constexpr auto taccr1_ = Register<u16>{base_ + 0x14};
+      static constexpr auto taiv_reg_ = Register<const u16>{taiv_};
   };
 
-  using Timer0_A3 = Timer_A_<0x160>;
+  using Timer0_A3 = Timer_A_<0x160, 0x12e>;
+
+  enum class Usi_clock_source { SCLK, ACLK, SMCLK, SMCLK_, USISWCLK, TACCR0,
+                                TACCR1, TACCR2 };
+
+  /// Universal serial interface, configured as an LSB-first transmit-only
+  /// shift register on SDO (P1.6).
+  class Usi_transmitter {
+    public:
+      static void configure(const Usi_clock_source clock_source) {
+        store(USICTL0, usipe6_ | usilsb_ | usimst_ | usioe_ | usiswrst_);
+        store(USICTL1, usiifg_);
+        store(USICKCTL,
+              u8{static_cast<uint8_t>(to_integral(clock_source) << 2U)});
+        store(USICTL0, load(USICTL0) & ~usiswrst_);
+      }
+
+      /// Starts shifting out the `bits` least significant bits of `data`.
+      /// This also clears the interrupt flag.
+      static void shift_out(const u16 data, const uint8_t bits) {
+        store(USISR, data);
+        store(USICNT, usi16b_ | u8{bits});
+      }
+
+      static void enable_interrupt() {
+        store(USICTL1, load(USICTL1) | usiie_);
+      }
+
+      /// Leaves the interrupt flag pending, so that the interrupt is raised
+      /// as soon as it is enabled again.
+      static void disable_interrupt() {
+        store(USICTL1, load(USICTL1) & ~usiie_);
+      }
+
+    private:
+      static constexpr auto usipe6_ = u8{0x40};
+      static constexpr auto usilsb_ = u8{0x10};
+      static constexpr auto usimst_ = u8{0x08};
+      static constexpr auto usioe_ = u8{0x02};
+      static constexpr auto usiswrst_ = u8{0x01};
+      static constexpr auto usiie_ = u8{0x10};
+      static constexpr auto usiifg_ = u8{0x01};
+      static constexpr auto usi16b_ = u8{0x40};
+  };
 
 } // namespace msp430
 
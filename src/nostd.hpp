@@ -4,6 +4,7 @@
 #define NOSTD_HPP_
 
 #include <algorithm>
+#include <atomic>
 #include <bit>
 #include <cstddef>
 #include <cstdint>
@@ -83,6 +84,26 @@ inline constexpr u32 operator>>(const u32 lhs, const unsigned rhs) {
 
 template <typename Tp_> struct Register { intptr_t address; };
 
+#ifdef DOU_EMULATED_REGISTERS
+
+// On the host, the registers are backed by the emulated peripherals of
+// host/emulator.cpp, which advance the virtual time with each access.
+uint16_t emulated_load(intptr_t address, Size size);
+void emulated_store(intptr_t address, Size size, uint16_t value);
+
+template <typename Tp_> inline Tp_ load(const Register<Tp_> a_register) {
+  return static_cast<Tp_>(
+      emulated_load(a_register.address, static_cast<Size>(sizeof(Tp_))));
+}
+
+template <typename Tp_>
+inline void store(const Register<Tp_> a_register, Tp_ const val) {
+  emulated_store(a_register.address, static_cast<Size>(sizeof(Tp_)),
+                 static_cast<uint16_t>(val));
+}
+
+#else
+
 template <typename Tp_> inline Tp_ load(const Register<Tp_> a_register) {
   return *reinterpret_cast<volatile Tp_ *>(a_register.address);
 }
@@ -92,6 +113,8 @@ inline void store(const Register<Tp_> a_register, Tp_ const val) {
   *reinterpret_cast<volatile Tp_ *>(a_register.address) = val;
 }
 
+#endif
+
 template <typename Tp_, Size nm_> class Array {
   public:
     using value_type = Tp_;
@@ -138,4 +161,59 @@ template <typename Tp_, Size nm_> class Array {
     constexpr const_pointer data() const { return items_; }
 };
 
+/// Single-producer/single-consumer FIFO that may be shared between the main
+/// loop and an interrupt service routine.
+///
+/// The producer only ever writes `head_` and the consumer only ever writes
+/// `tail_`. Both are free-running 8-bit counters, which the MSP430 reads and
+/// writes atomically; the signal fences keep the compiler from moving the
+/// slot access across the publication of the index.
+template <typename Tp_, Size nm_> class Ring_buffer {
+  public:
+    static_assert((nm_ > 0) and (nm_ <= 128) and ((nm_ & (nm_ - 1)) == 0),
+                  "capacity must be a power of two that fits the 8-bit index");
+
+    [[nodiscard]] Size size() const {
+      return static_cast<uint8_t>(head_ - tail_);
+    }
+
+    [[nodiscard]] Size available() const { return nm_ - size(); }
+
+    [[nodiscard]] bool empty() const { return head_ == tail_; }
+
+    static constexpr Size capacity() { return nm_; }
+
+    /// Called by the producer only.
+    bool push(const Tp_ &value) {
+      const auto head = head_;
+      if (static_cast<uint8_t>(head - tail_) == nm_) {
+        return false;
+      }
+      items_[head & mask_] = value;
+      std::atomic_signal_fence(std::memory_order_release);
+      head_ = static_cast<uint8_t>(head + 1U);
+      return true;
+    }
+
+    /// Called by the consumer only.
+    bool pop(Tp_ &value) {
+      const auto tail = tail_;
+      if (head_ == tail) {
+        return false;
+      }
+      std::atomic_signal_fence(std::memory_order_acquire);
+      value = items_[tail & mask_];
+      std::atomic_signal_fence(std::memory_order_release);
+      tail_ = static_cast<uint8_t>(tail + 1U);
+      return true;
+    }
+
+  private:
+    static constexpr auto mask_ = static_cast<uint8_t>(nm_ - 1);
+
+    Array<Tp_, nm_> items_{};
+    volatile uint8_t head_{0};
+    volatile uint8_t tail_{0};
+};
+
 #endif // NOSTD_HPP_
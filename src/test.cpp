@@ -1,11 +1,20 @@
 // Data Output Unit Firmware / Darius Kellermann <kellermann@protonmail.com>
 
+#include "bus.hpp"
 #include "dou.hpp"
 
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <string>
 #include <string_view>
+#include <tuple>
+#include <vector>
 
 using str = std::string_view;
 
@@ -99,6 +108,39 @@ namespace dou {
     CHECK(str{buffer.data()}.empty());
   }
 
+  SCENARIO("precomputed suffixes of readings", "[dou]") {
+    static_assert(reading_suffixes[to_integral(Unit::MHz)].length == 5);
+    static_assert(reading_suffixes[to_integral(Unit::None)].length == 2);
+    static_assert(text_length(3, Unit::kHz) == 13);
+    static_assert(text_length(0, Unit::None) == 9);
+
+    const auto unit = GENERATE(Unit::ms, Unit::us, Unit::MHz, Unit::kHz,
+                               Unit::None);
+    const auto &suffix = reading_suffixes[to_integral(unit)];
+
+    CHECK(str{suffix.text.data()} == std::string{unit_text(unit)} + "\r\n");
+    CHECK(suffix.length == static_cast<Size>(str{suffix.text.data()}.size()));
+
+    GIVEN("a reading in that unit") {
+      auto uut = Bus_decoder{};
+      const auto decimal_point_digit = static_cast<i8>(
+          unit == Unit::None ? 0 : GENERATE(1, 2, 3, 4, 5, 6));
+      for (auto strobe = i8{6}; strobe > 0; --strobe) {
+        uut.latch({strobe, 7, strobe == decimal_point_digit, false,
+                   (to_integral(unit) & 1) != 0,
+                   (to_integral(unit) & 2) != 0});
+      }
+
+      THEN("its length is known without scanning it") {
+        REQUIRE(uut.is_complete());
+        CHECK(uut.captured().unit() == unit);
+        CHECK(uut.reading_length()
+              == static_cast<Size>(str{uut.reading()}.size()));
+        CHECK(str{uut.reading()}.ends_with(suffix.text.data()));
+      }
+    }
+  }
+
   std::string_view get_display_for_(Bus_decoder &decoder,
                                     const std::string_view display_string) {
     auto bus = Input_state{0,
@@ -235,6 +277,24 @@ namespace dou {
       CHECK(get_display_for_(uut, "123456") == " 123456\r\n");
     }
 
+    GIVEN("the MSD is strobed only once at the start of a window") {
+      REQUIRE(get_display_for_(uut, "123456") == " 123456\r\n");
+      uut.start_window();
+
+      uut.transit({6, 5, true, false, false, false});
+      for (auto strobe = i8{5}; strobe > 0; --strobe) {
+        uut.transit({strobe, 7, false, false, false, false});
+        uut.transit({strobe, 7, false, false, false, false});
+      }
+      uut.transit({0, 7, false, false, false, false});
+      uut.transit({0, 7, false, false, false, false});
+
+      THEN("its digit and decimal point are taken from that sample") {
+        REQUIRE(uut.is_complete());
+        CHECK(str{uut.reading()} == " .577777ms\r\n");
+      }
+    }
+
     GIVEN("device is in period mode") {
       WHEN("range is ms") {
         WHEN("decimal point after two digits") {
@@ -296,4 +356,1152 @@ namespace dou {
     }
   }
 
+  SCENARIO("queueing through the ring buffer", "[nostd]") {
+    auto uut = Ring_buffer<int, 4>{};
+
+    CHECK(uut.empty());
+    CHECK(uut.available() == 4);
+
+    GIVEN("the buffer is full") {
+      for (auto i = 0; i < 4; ++i) {
+        REQUIRE(uut.push(i));
+      }
+
+      THEN("no more items are accepted") {
+        CHECK(uut.size() == 4);
+        CHECK_FALSE(uut.push(4));
+      }
+
+      THEN("items are returned in order and the indices wrap around") {
+        auto value = 0;
+        for (auto round = 0; round < 300; ++round) {
+          REQUIRE(uut.pop(value));
+          CHECK(value == round);
+          REQUIRE(uut.push(round + 4));
+        }
+        CHECK(uut.size() == 4);
+      }
+    }
+
+    GIVEN("the buffer is empty") {
+      auto value = -1;
+      CHECK_FALSE(uut.pop(value));
+      CHECK(value == -1);
+    }
+  }
+
+  /// Reassembles the characters from the bits put on the line by
+  /// `get_next_bit()` (start bit, 7 data bits LSB first, stop bit).
+  class Line_receiver_ {
+    public:
+      void sample(const u8 bit) {
+        const auto level = (bit != u8{0});
+        if (bit_count_ == 0) {
+          REQUIRE_FALSE(level); // start bit
+        } else if (bit_count_ <= serial_data_bits) {
+          character_ = static_cast<char>(
+              character_ | ((level ? 1 : 0) << (bit_count_ - 1)));
+        } else {
+          REQUIRE(level); // stop bit
+          text_.push_back(character_);
+          character_ = 0;
+          bit_count_ = 0;
+          return;
+        }
+        ++bit_count_;
+      }
+
+      const std::string &text() const { return text_; }
+
+    private:
+      std::string text_{};
+      char character_{0};
+      int bit_count_{0};
+  };
+
+  SCENARIO("transmitting while the next reading is decoded", "[app]") {
+    auto uut = Serial_transmitter{};
+    auto line = Line_receiver_{};
+
+    const auto tick = [&] {
+      auto bit = u8{};
+      if (uut.get_next_bit(bit)) {
+        line.sample(bit);
+        return true;
+      }
+      return false;
+    };
+
+    CHECK(uut.is_idle());
+    CHECK_FALSE(tick());
+
+    GIVEN("readings are queued at arbitrary points of the transmission") {
+      const auto first = str{" 123.456MHz\r\n"};
+      const auto second = str{">12.3456kHz\r\n"};
+
+      // Bit periods that pass between the two readings being queued, i.e.,
+      // where the timer interrupt preempts the main loop.
+      const auto ticks_in_between = GENERATE(range(0, 140, 7));
+      CAPTURE(ticks_in_between);
+
+      REQUIRE(uut.write(first.data(), static_cast<Size>(first.size())));
+      for (auto i = 0; i < ticks_in_between; ++i) {
+        tick();
+      }
+      REQUIRE(uut.write(second.data(), static_cast<Size>(second.size())));
+
+      while (tick()) {
+      }
+
+      THEN("both readings are transmitted back to back") {
+        CHECK(line.text() == std::string{first} + std::string{second});
+        CHECK(uut.is_idle());
+      }
+    }
+
+    GIVEN("the queue cannot take the complete reading") {
+      const auto reading = str{" 123456\r\n"};
+      const auto fitting = serial_queue_size / static_cast<int>(reading.size());
+      auto expected = std::string{};
+      for (auto i = 0; i < fitting; ++i) {
+        REQUIRE(uut.write(reading.data(), static_cast<Size>(reading.size())));
+        expected += reading;
+      }
+
+      THEN("nothing of the reading is queued") {
+        CHECK_FALSE(
+            uut.write(reading.data(), static_cast<Size>(reading.size())));
+
+        while (tick()) {
+        }
+        CHECK(line.text() == expected);
+      }
+    }
+  }
+
+  SCENARIO("transmitting whole frames through a shift register", "[app]") {
+    auto uut = Serial_transmitter{};
+    auto line = Line_receiver_{};
+
+    const auto reading = str{">1234.56us\r\n"};
+    REQUIRE(uut.write(reading.data(), static_cast<Size>(reading.size())));
+
+    auto frame = u16{};
+    while (uut.get_next_frame(frame)) {
+      for (auto i = 0U; i < serial_frame_bits; ++i) {
+        line.sample((frame >> i) & u8{1});
+      }
+
+      // The line is left idle after the frame.
+      CHECK((frame >> serial_frame_bits) == (u16{0xffff} >> serial_frame_bits));
+    }
+
+    CHECK(line.text() == reading);
+    CHECK(uut.is_idle());
+  }
+
+  Reading make_reading_(const std::string_view digits,
+                        const i8 decimal_point_digit = 0,
+                        const bool overflow = false, const bool nml = false,
+                        const bool rng_2 = false) {
+    auto reading = Reading{{}, decimal_point_digit, overflow, nml, rng_2};
+    for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+      reading.set_digit(static_cast<i8>(strobe),
+                        static_cast<i8>(digits[static_cast<std::size_t>(
+                                            number_of_digits - strobe)]
+                                        - '0'));
+    }
+    return reading;
+  }
+
+  SCENARIO("binary frames", "[dou]") {
+    GIVEN("any reading") {
+      const auto digits = GENERATE(str{"000000"}, str{"123456"},
+                                   str{"999999"}, str{"908070"});
+      const auto decimal_point_digit = GENERATE(range(0, number_of_digits + 1));
+      const auto flags = GENERATE(range(0, 8));
+
+      const auto reading = make_reading_(
+          digits, static_cast<i8>(decimal_point_digit), (flags & 1) != 0,
+          (flags & 2) != 0, (flags & 4) != 0);
+
+      const auto frame = encode(reading);
+
+      THEN("the sync byte only occurs at the start of the frame") {
+        CHECK(frame[0] == binary_frame_sync);
+        CHECK(std::count(frame.begin(), frame.end() - 1, binary_frame_sync)
+              == 1);
+      }
+
+      THEN("it is decoded from its frame") {
+        auto decoded = Reading{};
+        REQUIRE(decode(frame, decoded));
+        CHECK(decoded == reading);
+        for (auto strobe = number_of_digits; strobe > 0; --strobe) {
+          CHECK(decoded.digit(static_cast<i8>(strobe))
+                == digits[static_cast<std::size_t>(number_of_digits - strobe)]
+                       - '0');
+        }
+      }
+
+      THEN("any single bit error is detected") {
+        for (auto byte = 0; byte < frame.size(); ++byte) {
+          for (auto bit = 0U; bit < 8U; ++bit) {
+            auto corrupted = frame;
+            corrupted[byte] = static_cast<uint8_t>(corrupted[byte]
+                                                   ^ (1U << bit));
+            auto decoded = Reading{};
+            CHECK_FALSE(decode(corrupted, decoded));
+          }
+        }
+      }
+    }
+  }
+
+  SCENARIO("binary frames of decoded readings", "[app]") {
+    GIVEN("a reading whose MSD has been sampled only once") {
+      auto decoder = Bus_decoder{};
+      REQUIRE(get_display_for_(decoder, "987654") == " 987654\r\n");
+      decoder.start_window();
+
+      decoder.transit({6, 1, false, false, false, false});
+      for (auto strobe = i8{5}; strobe > 0; --strobe) {
+        decoder.transit({strobe, static_cast<i8>(7 - strobe), false, false,
+                         false, false});
+        decoder.transit({strobe, static_cast<i8>(7 - strobe), false, false,
+                         false, false});
+      }
+      decoder.transit({0, 0, false, false, false, false});
+      decoder.transit({0, 0, false, false, false, false});
+      REQUIRE(decoder.is_complete());
+
+      THEN("its frame carries that MSD") {
+        auto decoded = Reading{};
+        REQUIRE(decode(encode(decoder.captured()), decoded));
+        CHECK(decoded.counts() == 123'456);
+      }
+    }
+  }
+
+  SCENARIO("timestamped readings", "[dou]") {
+    const auto reading = make_reading_("123456", 3, true, false, true);
+    const auto ticks = GENERATE(uint32_t{0}, uint32_t{0x0123abcd},
+                                uint32_t{0xa5a6a5a6}, uint32_t{0xffffffff});
+    const auto mode = GENERATE(Timestamp_mode::Absolute,
+                               Timestamp_mode::Delta);
+    const auto timestamp = Timestamp{ticks, mode};
+
+    GIVEN("a timestamp as text") {
+      auto text = Array<char, timestamp_text_length + 1>{};
+      format_timestamp(text.data(), timestamp);
+
+      THEN("the ticks are in hexadecimal") {
+        CHECK(text[1] == (mode == Timestamp_mode::Delta ? '+' : '@'));
+        CHECK(std::strtoul(&text[2], nullptr, 16) == ticks);
+      }
+    }
+
+    GIVEN("a timestamped frame") {
+      const auto frame = encode(reading, timestamp);
+
+      THEN("no sync byte occurs after the start of the frame") {
+        CHECK(frame[0] == timestamped_frame_sync);
+        for (auto i = 1; i < (frame.size() - 1); ++i) {
+          CHECK(frame[i] != binary_frame_sync);
+          CHECK(frame[i] != timestamped_frame_sync);
+        }
+      }
+
+      THEN("reading and timestamp are decoded from it") {
+        auto decoded = Reading{};
+        auto decoded_timestamp = Timestamp{};
+        REQUIRE(decode(frame, decoded, decoded_timestamp));
+        CHECK(decoded == reading);
+        CHECK(decoded_timestamp.ticks == ticks);
+        CHECK(decoded_timestamp.mode == mode);
+      }
+
+      THEN("any single bit error is detected") {
+        for (auto byte = 0; byte < frame.size(); ++byte) {
+          for (auto bit = 0U; bit < 8U; ++bit) {
+            auto corrupted = frame;
+            corrupted[byte] = static_cast<uint8_t>(corrupted[byte]
+                                                   ^ (1U << bit));
+            auto decoded = Reading{};
+            auto decoded_timestamp = Timestamp{};
+            CHECK_FALSE(decode(corrupted, decoded, decoded_timestamp));
+          }
+        }
+      }
+    }
+  }
+
+  SCENARIO("scaled readings", "[dou]") {
+    GIVEN("readings in each unit") {
+      const auto [digits, decimal_point_digit, nml, rng_2, expected] =
+          GENERATE(std::tuple{str{"123456"}, 3, false, true,
+                              str{" 00123456000000mHz\r\n"}},
+                   std::tuple{str{"000012"}, 6, true, true,
+                              str{" 00000000000012mHz\r\n"}},
+                   std::tuple{str{"123456"}, 5, false, false,
+                              str{" 00001234560000ps\r\n"}},
+                   std::tuple{str{"999999"}, 1, true, false,
+                              str{" 00099999900000ps\r\n"}},
+                   std::tuple{str{"012345"}, 0, false, false,
+                              str{" 00000000012345\r\n"}});
+      const auto reading = make_reading_(
+          digits, static_cast<i8>(decimal_point_digit), false, nml, rng_2);
+
+      THEN("they are given as integers in the base units") {
+        auto text = Array<char, max_scaled_text_size>{};
+        const auto length = format_scaled(text.data(), reading);
+        CHECK(str(text.data(), static_cast<std::size_t>(length)) == expected);
+        CHECK(text[length] == '\0');
+        CHECK(scaled_value(reading)
+              == std::strtoull(&expected[1], nullptr, 10));
+      }
+    }
+
+    GIVEN("any reading and shift") {
+      auto random = std::minstd_rand{GENERATE(1U, 2U, 3U)};
+      const auto counts = std::uniform_int_distribution<int32_t>{0, 999'999}(
+          random);
+      const auto shift = GENERATE(range(-number_of_digits - 1,
+                                        scaled_digits - number_of_digits + 1));
+      auto digits = std::to_string(counts);
+      digits.insert(0, number_of_digits - digits.size(), '0');
+      const auto reading = make_reading_(digits);
+
+      THEN("the digits match the value in double precision, rounded half "
+           "up") {
+        auto text = Array<char, scaled_digits + 1>{};
+        format_scaled_digits(text.data(), reading, shift);
+        const auto expected = static_cast<unsigned long long>(
+            std::floor((counts * std::pow(10.0, shift)) + 0.5));
+        CHECK(std::strtoull(text.data(), nullptr, 10) == expected);
+      }
+    }
+
+    GIVEN("a scaled frame") {
+      const auto overflow = GENERATE(false, true);
+      const auto reading = make_reading_("999999", 1, overflow, true, false);
+      const auto frame = encode_scaled(reading);
+
+      THEN("no sync byte occurs after the start of the frame") {
+        CHECK(frame[0] == scaled_frame_sync);
+        for (auto i = 1; i < (frame.size() - 1); ++i) {
+          CHECK(frame[i] != binary_frame_sync);
+          CHECK(frame[i] != timestamped_frame_sync);
+          CHECK(frame[i] != scaled_frame_sync);
+        }
+      }
+
+      THEN("value, unit and overflow are decoded from it") {
+        auto decoded = Scaled_reading{};
+        REQUIRE(decode(frame, decoded));
+        CHECK(decoded.value == 99'999'900'000ULL);
+        CHECK(decoded.unit == Unit::us);
+        CHECK(decoded.overflow == overflow);
+      }
+
+      THEN("any single bit error is detected") {
+        for (auto byte = 0; byte < frame.size(); ++byte) {
+          for (auto bit = 0U; bit < 8U; ++bit) {
+            auto corrupted = frame;
+            corrupted[byte] = static_cast<uint8_t>(corrupted[byte]
+                                                   ^ (1U << bit));
+            auto decoded = Scaled_reading{};
+            CHECK_FALSE(decode(corrupted, decoded));
+          }
+        }
+      }
+    }
+  }
+
+  SCENARIO("capturing the digits of a reading", "[app]") {
+    auto uut = Bus_decoder{};
+
+    REQUIRE(get_display_for_(uut, "1234.56kHz") == " 1234.56kHz\r\n");
+
+    const auto &reading = uut.captured();
+    CHECK(reading.bcd[0] == 0x12);
+    CHECK(reading.bcd[1] == 0x34);
+    CHECK(reading.bcd[2] == 0x56);
+    CHECK(reading.decimal_point_digit == 2);
+    CHECK(reading.unit() == Unit::kHz);
+    CHECK_FALSE(reading.overflow);
+  }
+
+  SCENARIO("reporting readings on change only", "[app]") {
+    auto uut = Change_filter{5, 3};
+
+    REQUIRE(make_reading_("123456").counts() == 123456);
+
+    GIVEN("a reading has been reported") {
+      REQUIRE(uut.update(make_reading_("123456", 3)));
+
+      WHEN("the digits change within the deadband") {
+        THEN("the readings are suppressed") {
+          CHECK_FALSE(uut.update(make_reading_("123461", 3)));
+          CHECK_FALSE(uut.update(make_reading_("123451", 3)));
+        }
+      }
+
+      WHEN("the digits change beyond the deadband") {
+        THEN("the reading is reported") {
+          CHECK(uut.update(make_reading_("123462", 3)));
+          CHECK(uut.update(make_reading_("123456", 3)));
+          CHECK(uut.update(make_reading_("123450", 3)));
+        }
+      }
+
+      WHEN("the digits carry over into more significant digits") {
+        REQUIRE(uut.update(make_reading_("099998", 3)));
+
+        THEN("the difference is evaluated numerically") {
+          CHECK_FALSE(uut.update(make_reading_("100002", 3)));
+        }
+      }
+
+      WHEN("decimal point, overflow or unit change") {
+        const auto changed = GENERATE(make_reading_("123456", 4),
+                                      make_reading_("123456", 3, true),
+                                      make_reading_("123456", 3, false, true),
+                                      make_reading_("123456", 3, false, false,
+                                                    true));
+
+        THEN("the reading is reported") { CHECK(uut.update(changed)); }
+      }
+
+      WHEN("the reading does not change for a while") {
+        THEN("every fourth reading is reported to show that the unit is "
+             "alive") {
+          for (auto round = 0; round < 3; ++round) {
+            CHECK_FALSE(uut.update(make_reading_("123456", 3)));
+            CHECK_FALSE(uut.update(make_reading_("123456", 3)));
+            CHECK_FALSE(uut.update(make_reading_("123456", 3)));
+            CHECK(uut.update(make_reading_("123456", 3)));
+          }
+        }
+      }
+    }
+  }
+
+  /// \return `digits` as a reading with the decimal point before the third
+  /// digit, in kHz.
+  Reading make_aggregated_(const int32_t counts) {
+    auto digits = std::to_string(counts);
+    digits.insert(0, number_of_digits - digits.size(), '0');
+    return make_reading_(digits, 3, false, false, true);
+  }
+
+  SCENARIO("aggregating readings", "[app]") {
+    GIVEN("random readings in the same unit") {
+      auto random = std::minstd_rand{GENERATE(1U, 2U, 3U)};
+      const auto base = std::uniform_int_distribution<int32_t>{0, 999'000}(
+          random);
+      const auto spread = GENERATE(0, 3, 1'000);
+      const auto number = GENERATE(2, 17, 255);
+      auto counts = std::uniform_int_distribution<int32_t>{base,
+                                                           base + spread};
+      auto uut = Aggregator{0, 0};
+
+      auto values = std::vector<int32_t>{};
+      for (auto i = 0; i < number; ++i) {
+        values.push_back(counts(random));
+        REQUIRE(uut.add(make_aggregated_(values.back()), 0)
+                == (i == 254));
+      }
+
+      THEN("count, minimum and maximum are exact") {
+        CHECK(uut.count() == number);
+        CHECK(uut.min() == *std::min_element(values.begin(), values.end()));
+        CHECK(uut.max() == *std::max_element(values.begin(), values.end()));
+      }
+
+      THEN("mean and standard deviation match those in double precision") {
+        auto sum = 0.0;
+        for (const auto value : values) {
+          sum += value;
+        }
+        const auto mean = sum / number;
+        auto squares = 0.0;
+        for (const auto value : values) {
+          squares += (value - mean) * (value - mean);
+        }
+        const auto deviation = std::sqrt(squares / (number - 1));
+
+        // Each update rounds the mean, which is off by up to (n + 1) / 1024
+        // counts after n readings.
+        CHECK(uut.mean() / 256.0 == Approx(mean).margin((number + 1) / 1024.0));
+        CHECK(uut.standard_deviation() / 256.0
+              == Approx(deviation).epsilon(0.001).margin(0.01));
+      }
+    }
+
+    GIVEN("three readings") {
+      auto uut = Aggregator{3, 0};
+      REQUIRE_FALSE(uut.add(make_aggregated_(100), 0));
+      REQUIRE_FALSE(uut.add(make_aggregated_(200), 0));
+
+      THEN("the summary is due with the third") {
+        REQUIRE(uut.add(make_aggregated_(300), 0));
+
+        AND_THEN("it is formatted in hexadecimal") {
+          const auto line = uut.format();
+          CHECK(str{line.data(), line.size()}
+                == "#A 03 0000c800 00064 0012c 006400 23\r\n");
+        }
+      }
+
+      WHEN("the unit changes") {
+        const auto changed = make_reading_("000300", 3, false, true, true);
+
+        THEN("the partial summary is to be reported first") {
+          REQUIRE(uut.interrupts(changed));
+          const auto line = uut.format();
+          CHECK(str{line.data(), line.size()}
+                == "#A 02 00009600 00064 000c8 0046b5 23\r\n");
+        }
+
+        THEN("a new summary is started") {
+          CHECK_FALSE(uut.add(changed, 0));
+          CHECK(uut.count() == 1);
+          CHECK(uut.min() == 300);
+          CHECK(uut.standard_deviation() == 0);
+        }
+      }
+
+      WHEN("the decimal point moves") {
+        const auto changed = make_reading_("000300", 4, false, false, true);
+
+        THEN("a new summary is started") {
+          REQUIRE(uut.interrupts(changed));
+          CHECK_FALSE(uut.add(changed, 0));
+          CHECK(uut.count() == 1);
+        }
+      }
+
+      THEN("a reading like the others continues the summary") {
+        CHECK_FALSE(uut.interrupts(make_aggregated_(300)));
+      }
+    }
+
+    GIVEN("a period") {
+      auto uut = Aggregator{0, 1'000};
+      REQUIRE_FALSE(uut.add(make_aggregated_(1), 0xffff'ff00));
+
+      THEN("the summary is due once it has passed, even across the "
+           "wrap-around of the ticks") {
+        CHECK_FALSE(uut.add(make_aggregated_(1), 0x0000'0000));
+        CHECK(uut.add(make_aggregated_(1), 0x0000'02e8));
+      }
+
+      WHEN("it has been reset") {
+        uut.reset();
+
+        THEN("the period starts with the next reading") {
+          CHECK_FALSE(uut.add(make_aggregated_(1), 0x0000'02e8));
+          CHECK(uut.count() == 1);
+        }
+      }
+    }
+  }
+
+  SCENARIO("decoding the port levels by table", "[app]") {
+    for (auto port1 = 0; port1 < 256; ++port1) {
+      for (auto port2 = 0; port2 < 256; ++port2) {
+        const auto expected = decode_signals_by_bits(static_cast<u8>(port1),
+                                                     static_cast<u8>(port2));
+        const auto actual = decode_signals(static_cast<u8>(port1),
+                                           static_cast<u8>(port2));
+
+        if ((actual.digit_strobe != expected.digit_strobe)
+            or (actual.out != expected.out)
+            or (actual.decimal_strobe != expected.decimal_strobe)
+            or (actual.overflow != expected.overflow)
+            or (actual.nml != expected.nml)
+            or (actual.rng_2 != expected.rng_2)) {
+          CAPTURE(port1, port2);
+          FAIL("decode_signals() differs from decode_signals_by_bits()");
+        }
+      }
+    }
+  }
+
+  SCENARIO("decoding samples latched at the strobe edges", "[app]") {
+    auto uut = Bus_decoder{};
+
+    WHEN("every digit strobe is sampled once") {
+      const auto overflow = GENERATE(false, true);
+
+      uut.latch({6, 1, false, overflow, true, true});
+      uut.latch({5, 2, false, overflow, true, true});
+      uut.latch({4, 3, false, overflow, true, true});
+      uut.latch({3, 4, true, overflow, true, true});
+      uut.latch({2, 5, false, overflow, true, true});
+      uut.latch({1, 6, false, overflow, true, true});
+
+      THEN("the reading is complete after the LSD") {
+        REQUIRE(uut.is_complete());
+        CHECK(uut.state() == Data_state::Init);
+        CHECK(str{uut.reading()}
+              == (overflow ? ">123.456kHz\r\n" : " 123.456kHz\r\n"));
+      }
+    }
+
+    WHEN("the scan starts in the middle") {
+      uut.latch({3, 4, false, false, false, false});
+      uut.latch({2, 5, false, false, false, false});
+      uut.latch({1, 6, false, false, false, false});
+
+      THEN("the partial pass is ignored") { CHECK_FALSE(uut.is_complete()); }
+    }
+  }
+
+  /// An instrument with more digits, active-low strobes and a different
+  /// encoding of the range signals than the 1900A.
+  struct Eight_digit_counter_ {
+      static constexpr auto digits = 8;
+      static constexpr auto strobes_active_high = false;
+
+      static constexpr Unit unit(const bool nml, const bool rng_2,
+                                 const bool has_decimal_point) {
+        if (not has_decimal_point) {
+          return Unit::None;
+        }
+        if (rng_2) {
+          return nml ? Unit::ms : Unit::us;
+        }
+        return nml ? Unit::kHz : Unit::MHz;
+      }
+
+      static constexpr auto unit_texts = Unit_texts{
+          {{"mS"}, {"uS"}, {"MHZ"}, {"KHZ"}, {""}}};
+  };
+
+  /// An instrument with an odd number of digits, which leaves the upper
+  /// nibble of the packed BCD unused.
+  struct Seven_digit_counter_ {
+      static constexpr auto digits = 7;
+      static constexpr auto strobes_active_high = true;
+
+      static constexpr Unit unit(const bool nml, const bool rng_2,
+                                 const bool has_decimal_point) {
+        return Fluke_1900a::unit(nml, rng_2, has_decimal_point);
+      }
+
+      static constexpr auto unit_texts = Fluke_1900a::unit_texts;
+  };
+
+  /// Checks that random displays of `Instrument_` are decoded, both from
+  /// the bus state sampled twice per strobe and from latched strobes, and
+  /// with the MSD sampled only once by a decoder that keeps running across
+  /// the displays, so that a stale MSD would show.
+  template <typename Instrument_> void check_decoding_of_() {
+    constexpr auto digits = Instrument_::digits;
+    auto random = std::minstd_rand{static_cast<unsigned>(digits)};
+
+    auto once = Basic_bus_decoder<Instrument_>{};
+    for (auto i = 0; i < 1000; ++i) {
+      auto display = std::string(static_cast<std::size_t>(digits), '0');
+      for (auto &character : display) {
+        character = static_cast<char>('0' + (random() % 10));
+      }
+      const auto dp = static_cast<i8>(random() % (digits + 1));
+      const auto overflow = (random() % 2) != 0;
+      const auto nml = (random() % 2) != 0;
+      const auto rng_2 = (random() % 2) != 0;
+      CAPTURE(display, dp, overflow, nml, rng_2);
+
+      const auto unit = Instrument_::unit(nml, rng_2, dp != 0);
+      auto expected = std::string{overflow ? ">" : " "};
+      for (auto strobe = digits; strobe > 0; --strobe) {
+        if (strobe == dp) {
+          expected += '.';
+        }
+        expected += display[static_cast<std::size_t>(digits - strobe)];
+      }
+      expected += Instrument_::unit_texts[to_integral(unit)].data();
+      expected += "\r\n";
+
+      auto sampled = Basic_bus_decoder<Instrument_>{};
+      auto latched = Basic_bus_decoder<Instrument_>{};
+      once.start_window();
+      for (auto strobe = i8{digits}; strobe > 0; --strobe) {
+        const auto bus = Input_state{
+            strobe,
+            static_cast<i8>(
+                display[static_cast<std::size_t>(digits - strobe)] - '0'),
+            strobe == dp,
+            overflow,
+            nml,
+            rng_2};
+        sampled.transit(bus);
+        sampled.transit(bus);
+        REQUIRE(sampled.state() == digit_state(strobe));
+        latched.latch(bus);
+        once.transit(bus);
+        if (strobe != digits) {
+          once.transit(bus);
+        }
+      }
+      auto blanking = Input_state{0, 0, false, overflow, nml, rng_2};
+      once.transit(blanking);
+      once.transit(blanking);
+      sampled.transit(blanking);
+      REQUIRE(sampled.state() == Data_state::OverflowUnit);
+      sampled.transit(blanking);
+      REQUIRE(sampled.state() == Data_state::Init);
+
+      REQUIRE(sampled.is_complete());
+      REQUIRE(latched.is_complete());
+      CHECK(str{sampled.reading()} == expected);
+      CHECK(sampled.reading_length() == static_cast<Size>(expected.size()));
+      CHECK(str{latched.reading()} == expected);
+      CHECK(sampled.captured() == latched.captured());
+      CHECK(sampled.captured().unit() == unit);
+      CHECK(sampled.captured().counts() == std::stol(display));
+      REQUIRE(once.is_complete());
+      CHECK(once.captured() == sampled.captured());
+    }
+  }
+
+  SCENARIO("decoding the display bus of other instruments", "[app]") {
+    GIVEN("the 1900A") { check_decoding_of_<Fluke_1900a>(); }
+
+    GIVEN("an instrument with eight digits") {
+      check_decoding_of_<Eight_digit_counter_>();
+
+      THEN("its active-low strobes are decoded as the active-high ones") {
+        for (auto port1 = 0; port1 < 256; ++port1) {
+          for (auto port2 = 0; port2 < 256; ++port2) {
+            const auto high = decode_signals_by_bits<Fluke_1900a>(
+                static_cast<u8>(port1), static_cast<u8>(port2));
+            const auto low = decode_signals_by_bits<Eight_digit_counter_>(
+                static_cast<u8>(port1) ^ port1_strobes_mask_,
+                static_cast<u8>(port2) ^ port2_strobes_mask_);
+            if ((high.digit_strobe != low.digit_strobe)
+                or (high.out != low.out)) {
+              CAPTURE(port1, port2);
+              FAIL("the strobes are decoded differently");
+            }
+          }
+        }
+      }
+    }
+
+    GIVEN("an instrument with an odd number of digits") {
+      check_decoding_of_<Seven_digit_counter_>();
+
+      THEN("the unused nibble stays zero") {
+        auto reading = Basic_reading<Seven_digit_counter_>{};
+        reading.set_digit(7, 9);
+        reading.set_digit(1, 3);
+        CHECK(reading.bcd[0] == 0x09);
+        CHECK(reading.bcd[3] == 0x03);
+        CHECK(reading.counts() == 9'000'003);
+      }
+    }
+  }
+
+  SCENARIO("profiling code regions", "[dou]") {
+    auto uut = Profiler{};
+
+    GIVEN("nothing has been recorded") {
+      THEN("the statistics are empty") {
+        CHECK(uut.statistics(Region::Send).count == 0);
+        CHECK(str{uut.format(Region::Send).data(), 19}
+              == "#2 0000 0000 0000\r\n");
+      }
+    }
+
+    GIVEN("several durations have been recorded") {
+      uut.record(Region::Decode, 100, 150);
+      uut.record(Region::Decode, 200, 220);
+      uut.record(Region::Decode, 0xfff0, 0x0010); // counter wrapped around
+
+      THEN("minimum, maximum and count are kept") {
+        const auto &statistics = uut.statistics(Region::Decode);
+        CHECK(statistics.min == 20);
+        CHECK(statistics.max == 50);
+        CHECK(statistics.count == 3);
+        CHECK(uut.statistics(Region::Send).count == 0);
+      }
+
+      THEN("they are formatted in hexadecimal") {
+        CHECK(str{uut.format(Region::Decode).data(), 19}
+              == "#1 0014 0032 0003\r\n");
+      }
+    }
+
+    GIVEN("a region has been recorded very often") {
+      for (auto i = 0; i < 0x10010; ++i) {
+        uut.record(Region::Transmit, 0, 1);
+      }
+
+      THEN("the count saturates") {
+        CHECK(uut.statistics(Region::Transmit).count == 0xffff);
+      }
+    }
+
+    GIVEN("the period of a loop is measured") {
+      uut.lap(Region::Poll_period, 1000);
+      uut.lap(Region::Poll_period, 1040);
+      uut.lap(Region::Poll_period, 1100);
+      uut.stop_laps();
+      uut.lap(Region::Poll_period, 9000);
+      uut.lap(Region::Poll_period, 9030);
+
+      THEN("only the laps in between stops are recorded") {
+        const auto &statistics = uut.statistics(Region::Poll_period);
+        CHECK(statistics.min == 30);
+        CHECK(statistics.max == 60);
+        CHECK(statistics.count == 3);
+      }
+    }
+  }
+
+  SCENARIO("counting the health of the bus decoding", "[app]") {
+    auto uut = Bus_health{};
+    auto decoder = Bus_decoder{};
+
+    GIVEN("a window with a complete pass, followed by an aborted one") {
+      for (auto pass = 0; pass < 2; ++pass) {
+        for (auto strobe = i8{6}; strobe > (pass == 0 ? 0 : 3); --strobe) {
+          decoder.latch({strobe, 1, false, false, false, false});
+        }
+      }
+      uut.update(decoder);
+
+      THEN("a reading and an aborted pass are counted") {
+        CHECK(uut.windows() == 1);
+        CHECK(uut.readings() == 1);
+        CHECK(uut.incomplete_windows() == 0);
+        CHECK(uut.aborted_passes() == 1);
+        CHECK(str{uut.format().data(), 19} == "#H 01 00 00 01 00\r\n");
+      }
+    }
+
+    GIVEN("a window where a strobe has been missed") {
+      decoder.transit({6, 1, false, false, false, false});
+      decoder.transit({6, 1, false, false, false, false});
+      decoder.transit({4, 1, false, false, false, false});
+      decoder.transit({3, 1, false, false, false, false});
+      uut.update(decoder);
+
+      THEN("the window is incomplete with strobes out of sequence") {
+        CHECK(decoder.out_of_sequence() == 2);
+        CHECK(uut.readings() == 0);
+        CHECK(uut.incomplete_windows() == 1);
+        CHECK(uut.aborted_passes() == 1);
+        CHECK(uut.out_of_sequence() == 2);
+      }
+    }
+
+    GIVEN("many empty windows") {
+      for (auto i = 0; i < 300; ++i) {
+        uut.update(decoder);
+      }
+
+      THEN("the counters saturate") {
+        CHECK(uut.windows() == 0xff);
+        CHECK(uut.empty_windows() == 0xff);
+        CHECK(str{uut.format().data(), 19} == "#H 00 00 ff 00 00\r\n");
+      }
+
+      THEN("they start anew after a reset") {
+        uut.reset();
+        CHECK(uut.windows() == 0);
+        CHECK(uut.empty_windows() == 0);
+      }
+    }
+  }
+
+  SCENARIO("voting the digits of several passes", "[app]") {
+    GIVEN("three nibble-packed votes") {
+      auto has_majority = true;
+
+      THEN("each nibble is voted separately") {
+        CHECK(majority(0x12, 0x13, 0x42, has_majority) == 0x12);
+        CHECK(majority(0x95, 0x35, 0x37, has_majority) == 0x35);
+        CHECK(has_majority);
+      }
+
+      THEN("the first vote is taken without a majority") {
+        CHECK(majority(0x12, 0x34, 0x56, has_majority) == 0x12);
+        CHECK_FALSE(has_majority);
+      }
+    }
+
+    auto uut = Bus_decoder{};
+    const auto scan = [&uut](const char *const digits, const i8 dp) {
+      for (auto strobe = i8{6}; strobe > 0; --strobe) {
+        uut.latch({strobe, static_cast<i8>(digits[6 - strobe] - '0'),
+                   strobe == dp, false, false, false});
+      }
+    };
+
+    GIVEN("a single pass") {
+      scan("123456", 3);
+
+      THEN("it is taken") {
+        CHECK(str{uut.reading()} == " 123.456ms\r\n");
+        CHECK(uut.is_confident());
+      }
+    }
+
+    GIVEN("two passes that disagree") {
+      scan("123456", 3);
+      scan("123455", 0);
+
+      THEN("the latest one is taken, without confidence") {
+        CHECK(str{uut.reading()} == " 123455\r\n");
+        CHECK_FALSE(uut.is_confident());
+      }
+    }
+
+    GIVEN("three passes, of which one has been corrupted") {
+      const auto corrupted = GENERATE(0, 1, 2);
+      for (auto pass = 0; pass < 3; ++pass) {
+        if (pass == corrupted) {
+          scan("923455", 0);
+        } else {
+          scan("123456", 3);
+        }
+      }
+
+      THEN("the corrupted pass is outvoted") {
+        CHECK(str{uut.reading()} == " 123.456ms\r\n");
+        CHECK(uut.captured().decimal_point_digit == 3);
+        CHECK(uut.is_confident());
+      }
+    }
+
+    GIVEN("three passes that all disagree on a digit") {
+      scan("123456", 3);
+      scan("123457", 3);
+      scan("123458", 3);
+
+      THEN("the latest one is taken, without confidence") {
+        CHECK(str{uut.reading()} == " 123.458ms\r\n");
+        CHECK_FALSE(uut.is_confident());
+      }
+    }
+  }
+
+
+  SCENARIO("ending the measurement window", "[app]") {
+    auto uut = Bus_decoder{};
+    const auto scan = [&uut](const char *const digits, const i8 dp) {
+      for (auto strobe = i8{6}; strobe > 0; --strobe) {
+        uut.latch({strobe, static_cast<i8>(digits[6 - strobe] - '0'),
+                   strobe == dp, false, false, false});
+      }
+    };
+
+    GIVEN("a complete window") {
+      scan("123456", 3);
+      const auto &window = uut.window();
+
+      THEN("its reading is available") {
+        CHECK(window.complete);
+        CHECK(window.confident);
+        CHECK(str{window.text.data(), window.length} == " 123.456ms\r\n");
+      }
+
+      WHEN("the next window is started") {
+        uut.start_window();
+
+        THEN("decoding starts anew") {
+          CHECK(uut.state() == Data_state::Init);
+          CHECK_FALSE(uut.is_complete());
+          CHECK_FALSE(window.complete);
+          CHECK(str{uut.reading()}.empty());
+        }
+
+        AND_WHEN("it is decoded") {
+          scan("654321", 0);
+          scan("654322", 0);
+
+          THEN("the passes of the earlier window take no part in the vote") {
+            CHECK(str{uut.reading()} == " 654322\r\n");
+            CHECK_FALSE(uut.is_confident());
+          }
+        }
+      }
+    }
+
+    GIVEN("an incomplete window") {
+      uut.latch({6, 1, false, false, false, false});
+
+      THEN("there is no reading") {
+        CHECK_FALSE(uut.window().complete);
+        uut.start_window();
+        CHECK(uut.state() == Data_state::Init);
+      }
+    }
+  }
+
+  SCENARIO("receiving characters from the edges on the line", "[app]") {
+    constexpr auto bit_ticks = uint16_t{833};
+    auto uut = Serial_receiver{bit_ticks};
+    auto transmitter = Serial_transmitter{};
+
+    // Drives the line by `transmitter`, starting at `start` ticks, with the
+    // edges delayed by up to `max_latency` ticks, and receives from it. As
+    // on RST/NMI, only the edge that the receiver expects is seen, and the
+    // `dropped_edge`-th of these is missed.
+    const auto receive = [&](const uint16_t start, const int max_latency,
+                             const int dropped_edge = -1) {
+      auto random = std::minstd_rand{5};
+      auto mark = true;
+      auto frame_end = std::optional<uint16_t>{};
+      auto ticks = start;
+      auto seen_edges = 0;
+      auto bit = u8{};
+      while (transmitter.get_next_bit(bit)) {
+        if ((bit != u8{0}) != mark) {
+          mark = not mark;
+          const auto edge = static_cast<uint16_t>(
+              ticks
+              + static_cast<int>(random()
+                                 % static_cast<unsigned>(max_latency + 1)));
+          if (frame_end
+              and (static_cast<int16_t>(edge - *frame_end) >= 0)) {
+            uut.end_frame();
+            frame_end.reset();
+          }
+          if ((uut.is_mark() != mark) and (seen_edges++ != dropped_edge)
+              and uut.edge(edge)) {
+            frame_end = uut.frame_end();
+          }
+        }
+        ticks = static_cast<uint16_t>(ticks + bit_ticks);
+      }
+      if (frame_end) {
+        uut.end_frame();
+      }
+
+      auto text = std::string{};
+      auto character = char{};
+      while (uut.read(character)) {
+        text += character;
+      }
+      return text;
+    };
+
+    GIVEN("characters are sent back to back") {
+      const auto sent = str{"S1\rD25\r"};
+      REQUIRE(transmitter.write(sent.data(), static_cast<Size>(sent.size())));
+
+      WHEN("the edges are seen with latency, while the timer wraps around") {
+        const auto start = GENERATE(uint16_t{0}, uint16_t{0xfc00});
+        const auto max_latency = GENERATE(0, bit_ticks / 8);
+        CAPTURE(start, max_latency);
+
+        THEN("the characters are received") {
+          CHECK(receive(start, max_latency) == sent);
+          CHECK(uut.is_mark());
+        }
+      }
+    }
+
+    GIVEN("an edge is missed") {
+      const auto dropped_edge = GENERATE(range(0, 6));
+      CAPTURE(dropped_edge);
+      const auto garbled = str{"S1\r"};
+      REQUIRE(transmitter.write(garbled.data(),
+                                static_cast<Size>(garbled.size())));
+      CHECK(receive(0, 0, dropped_edge) != garbled);
+
+      WHEN("the line has been idle for a frame") {
+        const auto sent = str{"D25\r"};
+        REQUIRE(transmitter.write(sent.data(), static_cast<Size>(sent.size())));
+
+        THEN("the following characters are received") {
+          CHECK(receive(40'000, bit_ticks / 8) == sent);
+          CHECK(uut.is_mark());
+        }
+      }
+    }
+
+    GIVEN("the line is held at space beyond the stop bit") {
+      REQUIRE(uut.edge(100));
+
+      THEN("the character is dropped") {
+        CHECK_FALSE(uut.end_frame());
+        CHECK(uut.empty());
+        AND_THEN("the falling edge of the next start bit is awaited, as the "
+                 "return to mark is not seen") {
+          CHECK(uut.is_mark());
+          CHECK(uut.edge(21'000));
+        }
+      }
+    }
+  }
+
+  SCENARIO("parsing commands", "[app]") {
+    auto uut = Command_parser{};
+
+    const auto parse = [&uut](const str text) {
+      auto commands = std::vector<std::pair<Command_type, int32_t>>{};
+      for (const auto character : text) {
+        auto command = Command{};
+        if (uut.feed(character, command)) {
+          commands.emplace_back(command.type, command.argument);
+        }
+      }
+      return commands;
+    };
+
+    using Commands = std::vector<std::pair<Command_type, int32_t>>;
+
+    GIVEN("valid commands") {
+      THEN("they are parsed with their arguments") {
+        CHECK(parse("R\r") == Commands{{Command_type::Read, -1}});
+        CHECK(parse("S0\rS1\n")
+              == Commands{{Command_type::Stream, 0},
+                          {Command_type::Stream, 1}});
+        CHECK(parse("F1\r\nF3\r")
+              == Commands{{Command_type::Format, 1},
+                          {Command_type::Format, 3}});
+        CHECK(parse("D25\rD\rD0\r")
+              == Commands{{Command_type::Deadband, 25},
+                          {Command_type::Deadband, -1},
+                          {Command_type::Deadband, 0}});
+        CHECK(parse("D999999\r")
+              == Commands{{Command_type::Deadband, 999999}});
+        CHECK(parse("H\r") == Commands{{Command_type::Statistics, -1}});
+      }
+    }
+
+    GIVEN("a command arrives in pieces") {
+      THEN("it is completed by the line ending") {
+        CHECK(parse("D1").empty());
+        CHECK(parse("2").empty());
+        CHECK(parse("\r") == Commands{{Command_type::Deadband, 12}});
+      }
+    }
+
+    GIVEN("empty lines") {
+      THEN("they are ignored") { CHECK(parse("\r\n\r\n").empty()); }
+    }
+
+    GIVEN("invalid commands") {
+      const auto text = GENERATE(str{"X\r"}, str{"R1\r"}, str{"S2\r"},
+                                 str{"S\r"}, str{"F4\r"}, str{"D1x\r"},
+                                 str{"D1234567\r"}, str{"H0\r"},
+                                 str{"F10\r"});
+      CAPTURE(text);
+
+      THEN("they are rejected as a whole") {
+        CHECK(parse(text) == Commands{{Command_type::Invalid, -1}});
+        AND_THEN("the next command is parsed again") {
+          CHECK(parse("R\r") == Commands{{Command_type::Read, -1}});
+        }
+      }
+    }
+  }
+
 } // namespace dou
@@ -47,6 +47,30 @@ namespace dou {
            + used_characters;
   }
 
+  /// \return The CRC-8 (polynomial 0x07, initial value 0) of `data`.
+  constexpr uint8_t crc8(const uint8_t *const data, const Size length) {
+    auto crc = uint8_t{0};
+    for (auto i = Size{0}; i < length; ++i) {
+      crc = static_cast<uint8_t>(crc ^ data[i]);
+      for (auto bit = 0; bit < 8; ++bit) {
+        crc = static_cast<uint8_t>(((crc & 0x80U) != 0U) ? ((crc << 1U) ^ 0x07U)
+                                                         : (crc << 1U));
+      }
+    }
+    return crc;
+  }
+
+  /// Writes the `digits` least significant hexadecimal digits of `value` to
+  /// `text`, most significant first.
+  constexpr void format_hex(char *const text, const uint16_t value,
+                            const int digits) {
+    for (auto i = 0; i < digits; ++i) {
+      const auto nibble = (value >> (4 * (digits - 1 - i))) & 0x0f;
+      text[i] = static_cast<char>(nibble < 10 ? ('0' + nibble)
+                                              : ('a' - 10 + nibble));
+    }
+  }
+
   template <Size buffer_length_, typename... Args_>
   inline int print(Array<char, buffer_length_> &buffer, const Args_ &...args) {
     return print(buffer.data(), buffer_length_, args...);